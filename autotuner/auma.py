@@ -12,6 +12,7 @@ import os
 import random
 
 from kfold_ann import KFoldAnn
+from native_ann import NativeKFoldAnn
 from autotuner import *
 from settings import Settings 
 from datautil import *
@@ -33,11 +34,12 @@ if settings.command1 != None:
     os.system(settings.command1)
     
 
-print "Reading", settings.file2, "..."
-
 inputData = []
 outputData = []
-readData(inputData, outputData, settings.file2, settings.parameterRanges)
+trainingFiles = ([settings.file2] if settings.file2 != None else []) + settings.trainingFiles
+for trainingFile in trainingFiles:
+    print "Reading", trainingFile, "..."
+    readData(inputData, outputData, trainingFile, settings.parameterRanges, settings.maxRelativeStddev, settings.problemParameters)
 
 
 print "Filtering data..."
@@ -48,13 +50,14 @@ filterData(inputData, outputData, filteredInputData, filteredOutputData)
 filteredInputData = transformInput(filteredInputData, settings.parameterRanges)
 
 if settings.nTrainingSamples > len(filteredInputData) or settings.nTrainingSamples > len(inputData):
-    print "WARNING: {} training samples requested, but only {} samples in {} and only {} samples after filtering".format(settings.nTrainingSamples, len(inputData), settings.file2, len(filteredInputData))
+    print "WARNING: {} training samples requested, but only {} samples in {} and only {} samples after filtering".format(settings.nTrainingSamples, len(inputData), " ".join(trainingFiles), len(filteredInputData))
     print "Reducing number of training samples to {}".format(len(filteredInputData))
     settings.nTrainingSamples = len(filteredInputData)
         
 
 print "Training model and predicting..."
-secondStageTimeThreshold, secondStage = tune(filteredInputData, filteredOutputData, settings, KFoldAnn(settings))
+kfa = NativeKFoldAnn(settings) if settings.engine == "native" else KFoldAnn(settings)
+secondStageTimeThreshold, secondStage = tune(filteredInputData, filteredOutputData, settings, kfa)
 
 print "Generating", settings.file3, "..."
 createFile3(secondStage, secondStageTimeThreshold, settings)
@@ -65,7 +68,7 @@ os.system(settings.command2)
 print "Reading", settings.file4, "..."
 finalConfigs = []
 finalTimes = []
-readData(finalConfigs, finalTimes, settings.file4, settings.parameterRanges)
+readData(finalConfigs, finalTimes, settings.file4, settings.parameterRanges, settings.maxRelativeStddev)
 validFinalConfigs = []
 validFinalTimes = []
 filterData(finalConfigs, finalTimes, validFinalConfigs, validFinalTimes)
@@ -9,11 +9,25 @@ import math
 import random
 import copy
 import sys
+import heapq
 import scipy as sp
 import scipy.stats
 from kfold_ann import KFoldAnn
 from datautil import * 
 
+# Number of configurations predicted at a time
+PREDICTION_BATCH_SIZE = 4096
+
+# With a threshold based second stage, the number of candidates written to file 3 for each of the
+# N_SECOND_STAGE_MAX configurations the benchmark may count, so that configurations which fail, or are
+# measured to be faster than predicted, do not leave the second stage short
+SECOND_STAGE_MARGIN = 2
+
+# Integration points used by probIsOptimal, and how many standard deviations around the
+# predicted times are integrated over
+PROBABILITY_POINTS = 400
+PROBABILITY_SDS = 8
+
 def probIsMin(mu_a, mu_b, stdev_a, stdev_b):
     #The probability that a is less than b, e.g. a < b, e.g. b - a > 0
     
@@ -34,16 +48,57 @@ def invProbIsMin(mu_b, stdev_a, stdev_b, threshold):
 
 
 def getSecondStageTimeThreshold(bestEstimate, kfa, settings):
+    # The time a for which invProbIsMin(bestEstimate, e*bestEstimate, e*a, threshold) = a, that is,
+    # a = mu + z*sqrt(sa**2 + e**2*a**2) with z = ppf(1-threshold). Squaring this gives a quadratic
+    # equation in a, of whose roots the one with a - mu of the same sign as z is used.
     e = kfa.getErrorEstimate()
     
-    #TODO: Calculate this directly
-    a = invProbIsMin(bestEstimate, e*bestEstimate, e*bestEstimate, settings.secondStageThreshold)
-    b = a - 1
-    while abs(a-b) > 0.01:
-        b = a
-        a = invProbIsMin(bestEstimate, e*bestEstimate, e*b, settings.secondStageThreshold)
-        
-    return a
+    mu = bestEstimate
+    sa = e*bestEstimate
+    z = sp.stats.norm().ppf(1-settings.secondStageThreshold)
+    d = 1 - z**2 * e**2
+    if d <= 0:
+        # No configuration is slow enough to be discarded, or fast enough to be included
+        return float("inf") if z > 0 else 0.0
+    
+    return (mu + math.copysign(math.sqrt(mu**2 - d*(mu**2 - z**2 * sa**2)), z))/d
+
+
+def logSurvival(x):
+    # log(1 - cdf(x)) of the standard normal distribution
+    return math.log(max(0.5*math.erfc(x/math.sqrt(2)), 1e-300))
+
+
+def probIsOptimal(times, e, nPoints=PROBABILITY_POINTS):
+    # The probability that each of the configurations is the fastest of them, if their actual times are
+    # independent and normally distributed around the predicted times, with standard deviations e times
+    # the predicted times. This is the integral of pdf_i(x)*prod_j!=i (1 - cdf_j(x)), computed for all the
+    # configurations at once with the midpoint rule, using the sum of the logarithms of the survival
+    # functions at each point. Beyond where the fastest configuration is almost surely faster than x,
+    # the integrand is negligible, and configurations which are almost surely slower get probability 0.
+    if e <= 0:
+        best = min(times)
+        return [1.0/times.count(best) if t == best else 0.0 for t in times]
+    
+    sds = [e*t for t in times]
+    high = min(t + PROBABILITY_SDS*sd for t, sd in zip(times, sds))
+    low = min(t - PROBABILITY_SDS*sd for t, sd in zip(times, sds))
+    relevant = [i for i in range(0, len(times)) if times[i] - PROBABILITY_SDS*sds[i] < high]
+    step = (high - low)/nPoints
+    
+    probabilities = [0.0]*len(times)
+    for p in range(0, nPoints):
+        x = low + (p + 0.5)*step
+        logSurvivals = [logSurvival((x - times[i])/sds[i]) for i in relevant]
+        total = sum(logSurvivals)
+        for i, logSurvivalI in zip(relevant, logSurvivals):
+            y = (x - times[i])/sds[i]
+            density = math.exp(-0.5*y*y)/(sds[i]*math.sqrt(2*math.pi))
+            probabilities[i] += density*math.exp(total - logSurvivalI)*step
+    
+    # The probabilities are normalized to account for the error of the integration
+    totalProbability = sum(probabilities)
+    return [x/totalProbability for x in probabilities]
         
 
 def getSubset(full1, full2, subset1, subset2, subsetSize):
@@ -58,6 +113,47 @@ def getAllInputCombinations(settings):
     return [getConfigurationForNumber(x, settings.parameterRanges) for x in range(0,settings.nConfigurations)]
     
 
+def iterInputCombinations(settings, batchSize=PREDICTION_BATCH_SIZE):
+    # The same configurations as getAllInputCombinations, in the same order, but generated
+    # in batches, so that only one batch is in memory at a time
+    for start in xrange(0, settings.nConfigurations, batchSize):
+        end = min(start + batchSize, settings.nConfigurations)
+        yield [getConfigurationForNumber(x, settings.parameterRanges) for x in xrange(start, end)]
+    
+
+
+class SecondStageSelector:
+    # Selects the size fastest configurations while the predictions are made, without storing all of
+    # them. They are kept in a heap with the slowest on top, so that it can be replaced when a faster
+    # configuration is predicted.
+    #
+    # With a threshold, no configuration is left out for being predicted slower than it. The benchmark
+    # applies the threshold, N_SECOND_STAGE_MIN and N_SECOND_STAGE_MAX to the measured times, and only
+    # counts the configurations which run, so it needs candidates past both the threshold and the maximum.
+    
+    def __init__(self, size):
+        self.size = size
+        self.bestPrediction = None
+        # The predictions and numbers are negated, to make the heap a max heap. Configurations with
+        # the same prediction are ordered by number.
+        self.heap = []
+        
+    def add(self, predictions, numbers):
+        for prediction, number in zip(predictions, numbers):
+            if self.bestPrediction == None or prediction < self.bestPrediction:
+                self.bestPrediction = prediction
+            
+            entry = (-prediction, -number)
+            if len(self.heap) < self.size:
+                heapq.heappush(self.heap, entry)
+            elif entry > self.heap[0]:
+                heapq.heapreplace(self.heap, entry)
+                
+    def getSelected(self):
+        # The predictions and numbers of the selected configurations, from the fastest predicted
+        return [(-prediction, -number) for prediction, number in sorted(self.heap, reverse=True)]
+    
+
 
 def tune(inputData, outputData, settings, kfa):
     
@@ -70,22 +166,42 @@ def tune(inputData, outputData, settings, kfa):
     
     kfa.train(ti, to)
     
-    print "Predicting..."
-    allInputCombinations = getAllInputCombinations(settings)
-    allInputCombinations = transformInput(allInputCombinations, settings.parameterRanges)
-    
-    predictions = kfa.runAll(allInputCombinations)
-    
-    bestPredictedTime = min(predictions)
-    secondStageTimeThreshold = getSecondStageTimeThreshold(math.exp(bestPredictedTime), kfa, settings)
+    useThreshold = settings.useSecondStageThreshold and not settings.useSecondStageAbs
+    if useThreshold:
+        selector = SecondStageSelector(SECOND_STAGE_MARGIN*settings.nSecondStageMax)
+    else:
+        selector = SecondStageSelector(settings.nSecondStage)
     
-    print "Finding best predictions..."
+    print "Predicting..."
+    # Configurations which do not satisfy the constraints are not predicted
+    start = 0
+    for inputCombinations in iterInputCombinations(settings):
+        batchNumbers = range(start, start + len(inputCombinations))
+        start += len(inputCombinations)
+        if settings.constraints != None:
+            valid = [settings.constraints.isValid(c) for c in inputCombinations]
+            batchNumbers = [n for n, v in zip(batchNumbers, valid) if v]
+            inputCombinations = [c for c, v in zip(inputCombinations, valid) if v]
+        if len(settings.problemValues) > 0:
+            inputCombinations = [c + settings.problemValues for c in inputCombinations]
+        selector.add(kfa.runAll(transformInput(inputCombinations, settings.parameterRanges)), batchNumbers)
     
-    predictions, allInputCombinations = [list(t) for t in zip(*sorted(zip(predictions,allInputCombinations)))]
-    secondStageConfigs = [untransformSingle(x, settings.parameterRanges) for x in allInputCombinations]
+    selected = selector.getSelected()
+    if len(selected) == 0:
+        print "ERROR: no configuration satisfies the constraints"
+        exit(-1)
     
+    # The second stage is ordered by the probability of each configuration being the fastest of them
+    probabilities = probIsOptimal([math.exp(prediction) for prediction, number in selected], kfa.getErrorEstimate())
+    order = sorted(range(0, len(selected)), key=lambda i: -probabilities[i])
+    secondStageConfigs = [getConfigurationForNumber(selected[i][1], settings.parameterRanges) for i in order]
         
-    if settings.useSecondStageThreshold and not settings.useSecondStageAbs:
-        return secondStageTimeThreshold, secondStageConfigs
+    if useThreshold:
+        # The benchmark stops on measured times, which these probabilities say nothing about, so the
+        # probabilities only order the second stage, and it is still cut off by a time threshold.
+        # The first N_SECOND_STAGE_MIN configurations are always run.
+        nFirst = min(settings.nSecondStageMin, len(order))
+        print "Probability that the fastest of the {} selected configurations is among the first {}: {:.3f}".format(len(order), nFirst, sum(probabilities[i] for i in order[0:nFirst]))
+        return getSecondStageTimeThreshold(math.exp(selector.bestPrediction), kfa, settings), secondStageConfigs
     else:
-        return 0, secondStageConfigs[0:settings.nSecondStage]
+        return 0, secondStageConfigs
@@ -0,0 +1,229 @@
+# Copyright (c) 2015, Thomas L. Falch
+# For conditions of distribution and use, see the accompanying LICENSE and README files
+
+# This file is part of the AUMA machine learning based auto tuning application
+# developed at the Norwegian University of Science and technology
+
+
+import re
+
+# Reads the constraints files of the benchmarks, the format is described in benchmarks/common/constraints.c,
+# which this must be kept in sync with.
+
+TOKEN_PATTERN = re.compile(r"\s*(?:(\d+)|([A-Za-z_]\w*)|(\|\||&&|==|!=|<=|>=|<<|>>|[-+*/%<>!()\[\]=]))")
+
+# The binary operators by precedence, from lowest to highest
+OPERATOR_LEVELS = [["||"], ["&&"], ["==", "!="], ["<", "<=", ">", ">="], ["<<", ">>"], ["+", "-"], ["*", "/", "%"]]
+
+
+class InvalidConfiguration(Exception):
+    pass
+
+
+def divide(a, b):
+    # Rounds towards 0, as in C
+    if b == 0:
+        raise InvalidConfiguration()
+    q = abs(a) // abs(b)
+    return q if (a < 0) == (b < 0) else -q
+
+def shift(a, b):
+    if a < 0 or b < 0 or b > 62:
+        raise InvalidConfiguration()
+    return b
+
+BINARY_OPERATORS = {
+    "==": lambda a, b: int(a == b),
+    "!=": lambda a, b: int(a != b),
+    "<": lambda a, b: int(a < b),
+    "<=": lambda a, b: int(a <= b),
+    ">": lambda a, b: int(a > b),
+    ">=": lambda a, b: int(a >= b),
+    "<<": lambda a, b: a << shift(a, b),
+    ">>": lambda a, b: a >> shift(a, b),
+    "+": lambda a, b: a + b,
+    "-": lambda a, b: a - b,
+    "*": lambda a, b: a * b,
+    "/": divide,
+    "%": lambda a, b: a - b*divide(a, b),
+}
+
+
+class Constraints:
+    # The expressions are compiled to functions of the configuration and the values of the lets
+
+    def __init__(self, fileName, constants):
+        self.fileName = fileName
+        self.constants = constants
+        self.parameters = None
+        self.tables = {}
+        self.letNames = []
+        self.lets = []
+        self.requirements = []
+
+        constraintsFile = open(fileName, "r")
+        for lineNumber, line in enumerate(constraintsFile, 1):
+            self.lineNumber = lineNumber
+            self.tokenize(line.split("#")[0])
+            if self.peek() == None:
+                continue
+
+            keyword = self.next()
+            if self.parameters == None and keyword != "parameters":
+                self.error("the first line must be the parameters line")
+            if keyword == "parameters":
+                self.parameters = []
+                while self.peek() != None:
+                    self.parameters.append(self.next())
+            elif keyword == "table":
+                name = self.newName()
+                values = []
+                while self.peek() != None:
+                    sign = -1 if self.peek() == "-" else 1
+                    if sign == -1:
+                        self.next()
+                    values.append(sign*self.number())
+                self.tables[name] = values
+            elif keyword == "let":
+                name = self.newName()
+                self.expect("=")
+                self.lets.append(self.parseExpression(0))
+                self.letNames.append(name)
+            elif keyword == "require":
+                self.requirements.append(self.parseExpression(0))
+            else:
+                self.error("expected parameters, table, let or require, not " + str(keyword))
+
+            if self.peek() != None:
+                self.error("unexpected text at the end of the line")
+        constraintsFile.close()
+
+
+    def error(self, message):
+        print "ERROR: line {} of {}: {}".format(self.lineNumber, self.fileName, message)
+        exit(-1)
+
+    def tokenize(self, line):
+        self.tokens = []
+        position = 0
+        line = line.rstrip()
+        while position < len(line):
+            match = TOKEN_PATTERN.match(line, position)
+            if match == None:
+                self.error("unexpected character " + line[position:].strip()[0])
+            number, name, operator = match.groups()
+            if number != None:
+                self.tokens.append(int(number))
+            else:
+                self.tokens.append(name if name != None else operator)
+            position = match.end()
+        self.tokens.reverse()
+
+    def peek(self):
+        return self.tokens[-1] if len(self.tokens) > 0 else None
+
+    def next(self):
+        return self.tokens.pop() if len(self.tokens) > 0 else None
+
+    def expect(self, token):
+        if self.next() != token:
+            self.error("expected " + token)
+
+    def number(self):
+        token = self.next()
+        if not isinstance(token, (int, long)):
+            self.error("expected a number")
+        return token
+
+    def isName(self, token):
+        return isinstance(token, str) and re.match(r"[A-Za-z_]", token) != None
+
+    def newName(self):
+        name = self.next()
+        if not self.isName(name):
+            self.error("expected a name")
+        if self.resolveName(name) != None:
+            self.error("already defined: " + name)
+        return name
+
+    def resolveName(self, name):
+        # Returns a function of the configuration and lets, or None if the name is not defined
+        if name in self.letNames:
+            index = self.letNames.index(name)
+            return lambda config, lets: lets[index]
+        if name in self.tables:
+            return self.tables[name]
+        if self.parameters != None and name in self.parameters:
+            index = self.parameters.index(name)
+            return lambda config, lets: config[index]
+        if name in self.constants:
+            value = self.constants[name]
+            return lambda config, lets: value
+        return None
+
+    def parsePrimary(self):
+        token = self.next()
+        if isinstance(token, (int, long)):
+            return lambda config, lets: token
+        if token == "(":
+            expression = self.parseExpression(0)
+            self.expect(")")
+            return expression
+        if self.isName(token):
+            value = self.resolveName(token)
+            if value == None:
+                self.error("unknown name {}, the problem parameters and device limits must be given with PROBLEM and DEVICE_LIMITS".format(token))
+            if isinstance(value, list):
+                self.expect("[")
+                index = self.parseExpression(0)
+                self.expect("]")
+                return lambda config, lets: self.lookup(value, index(config, lets))
+            return value
+        self.error("expected a number, a name or (")
+
+    def lookup(self, table, index):
+        if index < 0 or index >= len(table):
+            raise InvalidConfiguration()
+        return table[index]
+
+    def parseUnary(self):
+        if self.peek() == "!":
+            self.next()
+            operand = self.parseUnary()
+            return lambda config, lets: int(not operand(config, lets))
+        if self.peek() == "-":
+            self.next()
+            operand = self.parseUnary()
+            return lambda config, lets: -operand(config, lets)
+        return self.parsePrimary()
+
+    def parseExpression(self, level):
+        if level == len(OPERATOR_LEVELS):
+            return self.parseUnary()
+        left = self.parseExpression(level + 1)
+        while self.peek() in OPERATOR_LEVELS[level]:
+            operator = self.next()
+            right = self.parseExpression(level + 1)
+            left = self.binary(operator, left, right)
+        return left
+
+    def binary(self, operator, left, right):
+        # As in C, the right operand of || and && is only evaluated if it decides the result
+        if operator == "||":
+            return lambda config, lets: int(left(config, lets) != 0 or right(config, lets) != 0)
+        if operator == "&&":
+            return lambda config, lets: int(left(config, lets) != 0 and right(config, lets) != 0)
+        function = BINARY_OPERATORS[operator]
+        return lambda config, lets: function(left(config, lets), right(config, lets))
+
+    def isValid(self, config):
+        try:
+            lets = []
+            for let in self.lets:
+                lets.append(let(config, lets))
+            for requirement in self.requirements:
+                if requirement(config, lets) == 0:
+                    return False
+        except InvalidConfiguration:
+            return False
+        return True
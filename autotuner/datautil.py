@@ -6,8 +6,16 @@
 
 
 import math
+import random
+
+FEISTEL_ROUNDS = 4
+
+def transformProblemValue(value):
+    # Problem sizes span orders of magnitude, so the networks get their logarithm
+    return math.copysign(math.log(1 + abs(value), 2), value)
 
 def transformInput(inputData, dimensions):
+    # Any values after the parameters are problem parameters
     
     newInputData = []
     for i in range(0, len(inputData)):
@@ -19,6 +27,7 @@ def transformInput(inputData, dimensions):
                 r[j] = 1 if inputData[i][j] == 1 else -1
             else:
                 r[j] = inputData[i][j] - dimensions[j]/2
+        r += [transformProblemValue(x) for x in inputData[i][len(dimensions):]]
         
         newInputData.append(r)
         
@@ -59,6 +68,49 @@ def getConfigurationForNumber(number, parameterRanges):
 
     return parameters
 
+class RandomPermutation:
+    # A pseudo-random permutation of range(n), computed one element at a time rather than stored, the same
+    # way as the benchmarks do it (benchmarks/common/configurations.c). A Feistel network permutes the numbers
+    # below the smallest power of four not less than n, and numbers not below n are permuted again until they are.
+    
+    def __init__(self, n, rng=random):
+        self.n = n
+        self.halfBits = 1
+        while 4**self.halfBits < n:
+            self.halfBits += 1
+        self.mask = (1 << self.halfBits) - 1
+        self.keys = [rng.getrandbits(32) for r in range(0, FEISTEL_ROUNDS)]
+        
+    def feistelRound(self, right, key):
+        h = (right*0x9e3779b1 + key) & 0xffffffff
+        h ^= h >> 15
+        h = (h*0x85ebca6b) & 0xffffffff
+        h ^= h >> 13
+        return h & self.mask
+        
+    def encrypt(self, x):
+        left = x >> self.halfBits
+        right = x & self.mask
+        for key in self.keys:
+            left, right = right, left ^ self.feistelRound(right, key)
+        return (left << self.halfBits) | right
+        
+    def __len__(self):
+        return self.n
+        
+    def __getitem__(self, i):
+        if i < 0 or i >= self.n:
+            raise IndexError("permutation index out of range")
+        x = self.encrypt(i)
+        while x >= self.n:
+            x = self.encrypt(x)
+        return int(x)
+        
+    def __iter__(self):
+        for i in xrange(0, self.n):
+            yield self[i]
+        
+
 def configurationToString(configuration):
     
     s = ""
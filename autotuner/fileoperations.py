@@ -5,11 +5,19 @@
 # developed at the Norwegian University of Science and technology
 
 
-import random
 import math
 import os
+import mmap
+import struct
+from array import array
 from datautil import *
 
+# Binary results files written by the benchmarks with -o, see benchmarks/common/results.h
+RESULTS_MAGIC = "AUMARES2"
+# Files written before the columns were split into blocks
+RESULTS_MAGIC_V1 = "AUMARES1"
+RESULTS_NAME_LENGTH = 32
+
 def deleteFiles(settings):
     if settings.file1 != None:
         os.system("rm {}".format(settings.file1))
@@ -36,37 +44,186 @@ def parseLine(line, dimensions):
     return None
         
 
-def readData(inputData, outputData, fileName, dimensions):
+def isNoisy(d, dimensions, maxRelativeStddev):
+    # Lines may be followed by the min, mean and standard deviation of repeated launches, and their number
+    if maxRelativeStddev <= 0 or len(d) < len(dimensions) + 4:
+        return False
+    
+    mean = d[len(dimensions)+2]
+    stddev = d[len(dimensions)+3]
+    
+    return mean > 0 and float(stddev)/mean > maxRelativeStddev
+    
+
+def readProblemComments(dataFile):
+    # Returns the problem parameters printed by the benchmarks as "# NAME value" comments before the first row
+    problem = {}
+    for line in dataFile:
+        if len(line.strip()) > 0 and line[0] != '#':
+            break
+        fields = line.split()
+        if len(fields) == 3 and fields[0] == '#':
+            try:
+                problem[fields[1]] = int(fields[2])
+            except ValueError:
+                pass
+    return problem
+    
+
+def getProblemValues(problem, problemParameters, fileName):
+    values = []
+    for name in problemParameters:
+        if name not in problem:
+            print "ERROR:", fileName, "does not give the problem parameter", name, "exiting."
+            exit(-1)
+        values.append(problem[name])
+    return values
+    
+
+def padTo8(offset):
+    return offset + (8 - offset % 8) % 8
+
+
+def checkBinaryParameters(dataFile, nParameters, dimensions):
+    if nParameters != len(dimensions):
+        print "ERROR:", dataFile.name, "has", nParameters, "parameters, expected", len(dimensions), "exiting."
+        exit(-1)
+
+
+def readBinaryColumnsV1(data, dataFile, dimensions):
+    nParameters, nRows = struct.unpack("ii", data[8:16])
+    checkBinaryParameters(dataFile, nParameters, dimensions)
+    
+    offset = 16 + nParameters*(4 + RESULTS_NAME_LENGTH)
+    columns = []
+    for p in range(0, nParameters):
+        columns.append(array('b', data[offset:offset+nRows]))
+        offset += nRows
+    
+    offset = padTo8(offset)
+    for c in range(0, 4):
+        columns.append(array('d', data[offset:offset+8*nRows]))
+        offset += 8*nRows
+    columns.append(array('i', data[offset:offset+4*nRows]))
+    offset += 2*4*nRows
+    
+    # Files written before the problem parameters were added end here
+    problem = {}
+    if len(data) > offset:
+        nProblem = struct.unpack("i", data[offset:offset+4])[0]
+        offset += 4
+        names = [data[offset+i*RESULTS_NAME_LENGTH:offset+(i+1)*RESULTS_NAME_LENGTH].split("\0")[0] for i in range(0, nProblem)]
+        offset += nProblem*RESULTS_NAME_LENGTH
+        problem = dict(zip(names, array('i', data[offset:offset+4*nProblem]).tolist()))
+    
+    return columns, problem
+
+
+def readBinaryColumns(data, dataFile, dimensions):
+    nParameters, nRows, blockRows, nProblem = struct.unpack("iiii", data[8:24])
+    checkBinaryParameters(dataFile, nParameters, dimensions)
+    
+    offset = 24 + nParameters*(4 + RESULTS_NAME_LENGTH)
+    names = [data[offset+i*RESULTS_NAME_LENGTH:offset+(i+1)*RESULTS_NAME_LENGTH].split("\0")[0] for i in range(0, nProblem)]
+    offset += nProblem*RESULTS_NAME_LENGTH
+    problem = dict(zip(names, array('i', data[offset:offset+4*nProblem]).tolist()))
+    offset = padTo8(offset + 4*nProblem)
+    
+    # The rows of each block are appended to the columns, the rest of the last block is unused
+    columns = [array('b') for p in range(0, nParameters)] + [array('d') for c in range(0, 4)] + [array('i')]
+    parameterLength = padTo8(nParameters*blockRows)
+    blockLength = parameterLength + blockRows*(4*8 + 2*4)
+    for start in xrange(0, nRows, blockRows):
+        n = min(blockRows, nRows - start)
+        block = offset + start/blockRows*blockLength
+        for p in range(0, nParameters):
+            columns[p].fromstring(data[block+p*blockRows:block+p*blockRows+n])
+        block += parameterLength
+        for c in range(0, 4):
+            columns[nParameters+c].fromstring(data[block+c*8*blockRows:block+c*8*blockRows+8*n])
+        block += 4*8*blockRows
+        columns[nParameters+4].fromstring(data[block:block+4*n])
+    
+    return columns, problem
+
+
+def readBinaryResults(dataFile, dimensions):
+    # Returns the columns of a binary results file, the parameters followed by the time, minimum, mean,
+    # standard deviation and number of launches, and its problem parameters. The file is memory mapped,
+    # and each column of a block is converted to an array in one go.
+    data = mmap.mmap(dataFile.fileno(), 0, access=mmap.ACCESS_READ)
+    if data[0:len(RESULTS_MAGIC)] == RESULTS_MAGIC:
+        columns, problem = readBinaryColumns(data, dataFile, dimensions)
+    else:
+        columns, problem = readBinaryColumnsV1(data, dataFile, dimensions)
+    data.close()
+    return columns, problem
+    
+    
+def readBinaryData(inputData, outputData, columns, dimensions, maxRelativeStddev, problemValues):
+    # The same as the loop of readData over the rows, but filtering the columns, so that only the
+    # configurations which are kept are turned into lists
+    nParameters = len(dimensions)
+    times = columns[nParameters]
+    means = columns[nParameters+2]
+    stddevs = columns[nParameters+3]
+    
+    if maxRelativeStddev > 0:
+        kept = [i for i in xrange(0, len(times)) if not (means[i] > 0 and stddevs[i]/means[i] > maxRelativeStddev)]
+    else:
+        kept = xrange(0, len(times))
+    
+    configurations = zip(*columns[0:nParameters])
+    for i in kept:
+        inputData.append(list(configurations[i]) + problemValues)
+        outputData.append([times[i]])
+    
+
+def readData(inputData, outputData, fileName, dimensions, maxRelativeStddev=0, problemParameters=[]):
+    # The values of problemParameters in the file are appended to each configuration read
     
     try:
-        dataFile = open(fileName)
+        dataFile = open(fileName, "rb")
     except:
         print "ERROR: could not open:", fileName, "exiting."
         exit(-1)
     
+    if dataFile.read(len(RESULTS_MAGIC)) in [RESULTS_MAGIC, RESULTS_MAGIC_V1]:
+        columns, problem = readBinaryResults(dataFile, dimensions)
+        problemValues = getProblemValues(problem, problemParameters, fileName)
+        readBinaryData(inputData, outputData, columns, dimensions, maxRelativeStddev, problemValues)
+        dataFile.close()
+        return
+    
+    dataFile.seek(0)
+    problem = readProblemComments(dataFile)
     dataFile.seek(0)
+    problemValues = getProblemValues(problem, problemParameters, fileName)
+    
     for line in dataFile:
-        
         d = parseLine(line, dimensions)
-        
-        if d != None:
-            inputData.append(d[:-1])
-            outputData.append([d[-1]])
+        if d != None and not isNoisy(d, dimensions, maxRelativeStddev):
+            inputData.append(d[:len(dimensions)] + problemValues)
+            outputData.append([d[len(dimensions)]])
             
     dataFile.close()
             
 def createFile1(settings):
     
-    configurations = range(0, settings.nConfigurations)
-    random.shuffle(configurations)
+    # Configurations which do not satisfy the constraints would not be run, so they are left out
+    configurations = []
+    for number in RandomPermutation(settings.nConfigurations):
+        if len(configurations) == settings.nTrainingSamples:
+            break
+        configuration = getConfigurationForNumber(number, settings.parameterRanges)
+        if settings.constraints == None or settings.constraints.isValid(configuration):
+            configurations.append(configuration)
     
     
     file1 = open(settings.file1, "w+")
-    file1.write("{} {}\n".format(settings.nTrainingSamples, len(settings.parameterRanges)))
-        
-    for n in range(0, settings.nTrainingSamples):
+    file1.write("{} {}\n".format(len(configurations), len(settings.parameterRanges)))
         
-        configuration = getConfigurationForNumber(configurations[n], settings.parameterRanges)
+    for configuration in configurations:
         
         parametersString = configurationToString(configuration)
         
@@ -17,9 +17,9 @@ if loadError == 1:
     except:
         loadError += 1
 
+# The error is reported when the networks are created, so that the native engine can be used without FANN
 if loadError == 2:
-    print "ERROR: could not load python fann bindings"
-    exit(-1)
+    libfann = None
 
 import random
 import math
@@ -29,13 +29,17 @@ from settings import Settings
 class KFoldAnn:
     
     def __init__(self, settings):
+        if libfann == None:
+            print "ERROR: could not load python fann bindings"
+            exit(-1)
+            
         self.k = settings.k 
         self.networks = []
         self.mses = [0]*settings.k
         
         for i in range(0,settings.k):
             self.networks.append(libfann.neural_net())
-            self.networks[i].create_standard_array((len(settings.parameterRanges),settings.networkSize,1))
+            self.networks[i].create_standard_array((len(settings.parameterRanges) + len(settings.problemParameters),settings.networkSize,1))
             self.networks[i].set_activation_function_output(libfann.LINEAR)
             
             
@@ -68,28 +72,33 @@ class KFoldAnn:
         self.mses[networkIndex] = mses[9]
                 
             
-    def train(self, trainingInput, trainingOutput):
-        
-        inputs = []
-        outputs = []
-        testInputs = []
-        testOutputs = []
+    def getFolds(self, trainingInput, trainingOutput):
+        # The training and test data of each network, as the arguments of trainSingleNetwork
+        folds = []
         n = len(trainingInput)/self.k
         for i in range(0, self.k):
-            inputs.append(trainingInput[0:i*n] + trainingInput[(i+1)*n:])
-            testInputs.append(trainingInput[i*n:(i+1)*n])
-            outputs.append(trainingOutput[0:i*n] + trainingOutput[(i+1)*n:])
-            testOutputs.append(trainingOutput[i*n:(i+1)*n])
+            folds.append((trainingInput[0:i*n] + trainingInput[(i+1)*n:],
+                          trainingOutput[0:i*n] + trainingOutput[(i+1)*n:],
+                          trainingInput[i*n:(i+1)*n],
+                          trainingOutput[i*n:(i+1)*n]))
             
+        return folds
+    
+    
+    def printProgress(self, nTrained):
+        pct = 100*float(nTrained)/self.k 
+        sys.stdout.write("\rTraining: %f%%" % pct)
+        sys.stdout.flush()
+        
             
+    def train(self, trainingInput, trainingOutput):
         
-        sys.stdout.write("\rTraining: %f%%" % 0.0)
-        sys.stdout.flush()
+        folds = self.getFolds(trainingInput, trainingOutput)
+        
+        self.printProgress(0)
         for i in range(0, self.k):
-            self.trainSingleNetwork(i, inputs[i], outputs[i], testInputs[i], testOutputs[i])
-            pct = 100*float(i+1)/self.k 
-            sys.stdout.write("\rTraining: %f%%" % pct)
-            sys.stdout.flush()
+            self.trainSingleNetwork(i, *folds[i])
+            self.printProgress(i+1)
         
         print
             
@@ -132,18 +141,7 @@ class KFoldAnn:
         
             
     def validate(self, validationInput, validationOutput):
-        predictions = []
-        
-        for i in range(0, self.k):
-            predictions.append([self.networks[i].run(x) for x in validationInput])
-            
-        meanPredictions = []
-        for i in range(0, len(validationInput)):
-            temp = []
-            for j in range(0, self.k):
-                temp.append(predictions[j][i][0])
-                
-            meanPredictions.append(self.mean(temp))
+        meanPredictions = self.runAll(validationInput)
             
         
         relativeErrorMean = []
@@ -0,0 +1,351 @@
+// Copyright (c) 2015, Thomas L. Falch
+// For conditions of distribution and use, see the accompanying LICENSE and README files
+
+// This file is part of the AUMA machine learning based auto tuning application
+// developed at the Norwegian University of Science and technology
+
+
+// Native replacement for the FANN networks of kfold_ann.py. The networks are the same as those made by
+// FANN's create_standard_array, with its defaults: stepwise sigmoid hidden neurons and a linear output
+// with steepness 0.5, weights initialized in [-0.1, 0.1], trained with iRPROP- and the tanh error function.
+// Unlike with FANN, all the configurations are run in one call, in tiles which are run by all the
+// networks at once, in loops which are vectorized by the compiler.
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "ann.h"
+
+#define STEEPNESS 0.5f
+
+// Number of inputs run at a time, small enough for the tile and the weights of all the networks to stay in the cache
+#define TILE_SIZE 64
+
+#define INITIAL_WEIGHT 0.1f
+#define MAX_WEIGHT 1500.0f
+
+// RPROP parameters, as in FANN
+#define INCREASE_FACTOR 1.2f
+#define DECREASE_FACTOR 0.5f
+#define DELTA_MIN 0.0f
+#define DELTA_MAX 50.0f
+#define DELTA_ZERO 0.1f
+#define STEP_MIN 0.0001f
+
+// The test error is computed after every ROUND_EPOCHS epochs, and training stops when it has decreased
+// fewer than MIN_DECREASES times in the last N_ROUND_ERRORS rounds, or after MAX_ROUNDS rounds
+#define ROUND_EPOCHS 10
+#define MAX_ROUNDS 300
+#define N_ROUND_ERRORS 10
+#define MIN_DECREASES 2
+
+// The weights of a network are stored in one array, so that they can be updated in one loop. The first
+// (n_inputs + 1)*n_hidden are those of the hidden layer, stored input by input, so that the weights from
+// an input to all the hidden neurons are consecutive. The last row is the bias. The remaining n_hidden + 1
+// are those of the output neuron, the last being the bias.
+typedef struct{
+    float* weights;
+    float* slopes;
+    float* previous_slopes;
+    float* steps;
+} network;
+
+struct ensemble{
+    int k;
+    int n_inputs;
+    int n_hidden;
+    int n_weights;
+    network* networks;
+};
+
+static unsigned int next_random(unsigned int* state){
+    // xorshift32
+    unsigned int x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static float* allocate(int n){
+    return (float*)calloc(n, sizeof(float));
+}
+
+ensemble* create_ensemble(int k, int n_inputs, int n_hidden, unsigned int seed){
+    ensemble* e = (ensemble*)malloc(sizeof(ensemble));
+    e->k = k;
+    e->n_inputs = n_inputs;
+    e->n_hidden = n_hidden;
+    e->n_weights = (n_inputs + 1)*n_hidden + n_hidden + 1;
+    e->networks = (network*)malloc(sizeof(network)*k);
+
+    for(int i = 0; i < k; i++){
+        network* net = &e->networks[i];
+        net->weights = allocate(e->n_weights);
+        net->slopes = allocate(e->n_weights);
+        net->previous_slopes = allocate(e->n_weights);
+        net->steps = allocate(e->n_weights);
+
+        // Each network has its own sequence, which must not start at 0
+        unsigned int state = seed ^ (0x9e3779b9u*(unsigned int)(i + 1));
+        if(state == 0){
+            state = 1;
+        }
+        for(int w = 0; w < e->n_weights; w++){
+            float r = (float)(next_random(&state) >> 8)/(float)(1 << 24);
+            net->weights[w] = INITIAL_WEIGHT*(2.0f*r - 1.0f);
+        }
+    }
+    return e;
+}
+
+void destroy_ensemble(ensemble* e){
+    for(int i = 0; i < e->k; i++){
+        free(e->networks[i].weights);
+        free(e->networks[i].slopes);
+        free(e->networks[i].previous_slopes);
+        free(e->networks[i].steps);
+    }
+    free(e->networks);
+    free(e);
+}
+
+// FANN's piecewise linear approximation of the sigmoid 1/(1 + exp(-2*sum)), between the points (step_sums[i], step_values[i]).
+// It is computed as a sum of clamped line segments, without branches, so that the loops calling it are vectorized.
+static const float step_sums[6] = {-2.64665246009826660156e+00f, -1.47221946716308593750e+00f, -5.49306154251098632812e-01f,
+                                   5.49306154251098632812e-01f, 1.47221934795379638672e+00f, 2.64665293693542480469e+00f};
+static const float step_values[6] = {4.99999988824129104614e-03f, 5.00000007450580596924e-02f, 2.50000000000000000000e-01f,
+                                     7.50000000000000000000e-01f, 9.49999988079071044922e-01f, 9.95000004768371582031e-01f};
+
+static inline float sigmoid_stepwise(float sum){
+    float value = step_values[0];
+    for(int i = 0; i < 5; i++){
+        float width = step_sums[i + 1] - step_sums[i];
+        float x = sum - step_sums[i];
+        x = x < 0.0f ? 0.0f : x;
+        x = x > width ? width : x;
+        value += x*((step_values[i + 1] - step_values[i])/width);
+    }
+    value = sum < step_sums[0] ? 0.0f : value;
+    return sum < step_sums[5] ? value : 1.0f;
+}
+
+static float sigmoid_derived(float value){
+    value = value < 0.01f ? 0.01f : (value > 0.99f ? 0.99f : value);
+    return 2.0f*STEEPNESS*value*(1.0f - value);
+}
+
+// Computes the hidden neuron values of the network for input, and returns the output
+static float run_network(ensemble* e, network* net, float* input, float* hidden){
+    int n_hidden = e->n_hidden;
+    float* bias = net->weights + e->n_inputs*n_hidden;
+    float* output_weights = net->weights + (e->n_inputs + 1)*n_hidden;
+
+    memcpy(hidden, bias, sizeof(float)*n_hidden);
+    for(int i = 0; i < e->n_inputs; i++){
+        float x = input[i];
+        float* w = net->weights + i*n_hidden;
+        for(int j = 0; j < n_hidden; j++){
+            hidden[j] += x*w[j];
+        }
+    }
+
+    float sum = output_weights[n_hidden];
+    for(int j = 0; j < n_hidden; j++){
+        hidden[j] = sigmoid_stepwise(STEEPNESS*hidden[j]);
+        sum += hidden[j]*output_weights[j];
+    }
+    return STEEPNESS*sum;
+}
+
+static float test_network(ensemble* e, network* net, float* inputs, float* outputs, int n, float* hidden){
+    float error = 0.0f;
+    for(int s = 0; s < n; s++){
+        float diff = outputs[s] - run_network(e, net, inputs + s*e->n_inputs, hidden);
+        error += diff*diff;
+    }
+    return error/n;
+}
+
+static void update_slopes(ensemble* e, network* net, float* input, float output, float* hidden, float* deltas){
+    int n_hidden = e->n_hidden;
+    float* output_weights = net->weights + (e->n_inputs + 1)*n_hidden;
+    float* output_slopes = net->slopes + (e->n_inputs + 1)*n_hidden;
+
+    float diff = output - run_network(e, net, input, hidden);
+    // The tanh error function, which emphasizes large errors
+    if(diff < -0.9999999f){
+        diff = -17.0f;
+    }
+    else if(diff > 0.9999999f){
+        diff = 17.0f;
+    }
+    else{
+        diff = logf((1.0f + diff)/(1.0f - diff));
+    }
+    float delta = STEEPNESS*diff;
+
+    for(int j = 0; j < n_hidden; j++){
+        output_slopes[j] += delta*hidden[j];
+        deltas[j] = delta*output_weights[j]*sigmoid_derived(hidden[j]);
+    }
+    output_slopes[n_hidden] += delta;
+
+    for(int i = 0; i < e->n_inputs; i++){
+        float x = input[i];
+        float* slopes = net->slopes + i*n_hidden;
+        for(int j = 0; j < n_hidden; j++){
+            slopes[j] += deltas[j]*x;
+        }
+    }
+    float* bias_slopes = net->slopes + e->n_inputs*n_hidden;
+    for(int j = 0; j < n_hidden; j++){
+        bias_slopes[j] += deltas[j];
+    }
+}
+
+// The same update as fann_update_weights_irpropm. As there, a slope of 0, which is also what a sign change
+// leaves behind, counts as the same sign, and the weight is then moved up.
+static void update_weights(ensemble* e, network* net){
+    for(int w = 0; w < e->n_weights; w++){
+        float slope = net->slopes[w];
+        float step = fmaxf(net->steps[w], STEP_MIN);
+        float same_sign = slope*net->previous_slopes[w];
+
+        if(same_sign >= 0.0f){
+            step = fminf(step*INCREASE_FACTOR, DELTA_MAX);
+        }
+        else{
+            step = fmaxf(step*DECREASE_FACTOR, DELTA_MIN);
+            slope = 0.0f;
+        }
+
+        if(slope < 0.0f){
+            net->weights[w] = fmaxf(net->weights[w] - step, -MAX_WEIGHT);
+        }
+        else{
+            net->weights[w] = fminf(net->weights[w] + step, MAX_WEIGHT);
+        }
+
+        net->steps[w] = step;
+        net->previous_slopes[w] = slope;
+        net->slopes[w] = 0.0f;
+    }
+}
+
+float train_network(ensemble* e, int index,
+                    float* inputs, float* outputs, int n,
+                    float* test_inputs, float* test_outputs, int n_test){
+    network* net = &e->networks[index];
+    float* hidden = allocate(e->n_hidden);
+    float* deltas = allocate(e->n_hidden);
+
+    for(int w = 0; w < e->n_weights; w++){
+        net->slopes[w] = 0.0f;
+        net->previous_slopes[w] = 0.0f;
+        net->steps[w] = DELTA_ZERO;
+    }
+
+    float errors[N_ROUND_ERRORS + 1];
+    int n_errors = 0;
+    for(int round = 0; round < MAX_ROUNDS; round++){
+        for(int epoch = 0; epoch < ROUND_EPOCHS; epoch++){
+            for(int s = 0; s < n; s++){
+                update_slopes(e, net, inputs + s*e->n_inputs, outputs[s], hidden, deltas);
+            }
+            update_weights(e, net);
+        }
+
+        errors[n_errors++] = test_network(e, net, test_inputs, test_outputs, n_test, hidden);
+
+        if(n_errors > N_ROUND_ERRORS){
+            memmove(errors, errors + 1, sizeof(float)*N_ROUND_ERRORS);
+            n_errors--;
+
+            int decreases = 0;
+            for(int i = 0; i < N_ROUND_ERRORS - 1; i++){
+                if(errors[i + 1] - errors[i] < 0){
+                    decreases++;
+                }
+            }
+            if(decreases < MIN_DECREASES){
+                break;
+            }
+        }
+    }
+
+    free(hidden);
+    free(deltas);
+    return errors[n_errors - 1];
+}
+
+// Runs all the networks for a tile of inputs, which are transposed so that input i of the tile's
+// inputs are consecutive. The hidden neurons are computed one at a time for the whole tile, in
+// loops over the inputs of the tile which are vectorized.
+static void run_tile(ensemble* e, float* inputs, float* outputs){
+    int n_hidden = e->n_hidden;
+    float sums[TILE_SIZE];
+    float network_outputs[TILE_SIZE];
+
+    for(int s = 0; s < TILE_SIZE; s++){
+        outputs[s] = 0.0f;
+    }
+
+    for(int n = 0; n < e->k; n++){
+        float* weights = e->networks[n].weights;
+        float* output_weights = weights + (e->n_inputs + 1)*n_hidden;
+
+        for(int s = 0; s < TILE_SIZE; s++){
+            network_outputs[s] = output_weights[n_hidden];
+        }
+
+        for(int j = 0; j < n_hidden; j++){
+            float bias = weights[e->n_inputs*n_hidden + j];
+            for(int s = 0; s < TILE_SIZE; s++){
+                sums[s] = bias;
+            }
+            for(int i = 0; i < e->n_inputs; i++){
+                float w = weights[i*n_hidden + j];
+                float* x = inputs + i*TILE_SIZE;
+                for(int s = 0; s < TILE_SIZE; s++){
+                    sums[s] += w*x[s];
+                }
+            }
+
+            float w = output_weights[j];
+            for(int s = 0; s < TILE_SIZE; s++){
+                network_outputs[s] += w*sigmoid_stepwise(STEEPNESS*sums[s]);
+            }
+        }
+
+        for(int s = 0; s < TILE_SIZE; s++){
+            outputs[s] += STEEPNESS*network_outputs[s];
+        }
+    }
+
+    for(int s = 0; s < TILE_SIZE; s++){
+        outputs[s] /= e->k;
+    }
+}
+
+void run_ensemble(ensemble* e, float* inputs, int n, float* outputs){
+    float* tile_inputs = allocate(e->n_inputs*TILE_SIZE);
+    float tile_outputs[TILE_SIZE];
+
+    for(int start = 0; start < n; start += TILE_SIZE){
+        // The last tile is padded with zeros
+        int tile_size = n - start < TILE_SIZE ? n - start : TILE_SIZE;
+        for(int s = 0; s < TILE_SIZE; s++){
+            for(int i = 0; i < e->n_inputs; i++){
+                tile_inputs[i*TILE_SIZE + s] = s < tile_size ? inputs[(start + s)*e->n_inputs + i] : 0.0f;
+            }
+        }
+
+        run_tile(e, tile_inputs, tile_outputs);
+        memcpy(outputs + start, tile_outputs, sizeof(float)*tile_size);
+    }
+
+    free(tile_inputs);
+}
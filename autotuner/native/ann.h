@@ -0,0 +1,29 @@
+// Copyright (c) 2015, Thomas L. Falch
+// For conditions of distribution and use, see the accompanying LICENSE and README files
+
+// This file is part of the AUMA machine learning based auto tuning application
+// developed at the Norwegian University of Science and technology
+
+
+#ifndef ANN_H
+#define ANN_H
+
+// An ensemble of k networks with the same topology as the FANN networks of kfold_ann.py: the inputs,
+// one hidden layer of stepwise sigmoid neurons and a single linear output, all with bias connections.
+typedef struct ensemble ensemble;
+
+// The weights are initialized from seed, so the same seed and training data give the same networks
+ensemble* create_ensemble(int k, int n_inputs, int n_hidden, unsigned int seed);
+
+void destroy_ensemble(ensemble* e);
+
+// Trains network index with RPROP on the n training samples, stopping when the mean squared error of the
+// n_test test samples no longer decreases. Inputs are stored row by row. Returns the final test error.
+float train_network(ensemble* e, int index,
+                    float* inputs, float* outputs, int n,
+                    float* test_inputs, float* test_outputs, int n_test);
+
+// Writes the mean output of the networks for each of the n inputs to outputs
+void run_ensemble(ensemble* e, float* inputs, int n, float* outputs);
+
+#endif
@@ -0,0 +1,125 @@
+# Copyright (c) 2015, Thomas L. Falch
+# For conditions of distribution and use, see the accompanying LICENSE and README files
+
+# This file is part of the AUMA machine learning based auto tuning application
+# developed at the Norwegian University of Science and technology
+
+
+import os
+import random
+import array
+import ctypes
+import threading
+from kfold_ann import KFoldAnn
+
+LIBRARY_PATH = os.path.join(os.path.dirname(os.path.abspath(__file__)), "native", "libauma_ann.so")
+
+FLOAT_POINTER = ctypes.POINTER(ctypes.c_float)
+
+
+def loadLibrary():
+    try:
+        library = ctypes.CDLL(LIBRARY_PATH)
+    except OSError:
+        return None
+
+    library.create_ensemble.argtypes = [ctypes.c_int, ctypes.c_int, ctypes.c_int, ctypes.c_uint]
+    library.create_ensemble.restype = ctypes.c_void_p
+    library.destroy_ensemble.argtypes = [ctypes.c_void_p]
+    library.destroy_ensemble.restype = None
+    library.train_network.argtypes = [ctypes.c_void_p, ctypes.c_int,
+                                      FLOAT_POINTER, FLOAT_POINTER, ctypes.c_int,
+                                      FLOAT_POINTER, FLOAT_POINTER, ctypes.c_int]
+    library.train_network.restype = ctypes.c_float
+    library.run_ensemble.argtypes = [ctypes.c_void_p, FLOAT_POINTER, ctypes.c_int, FLOAT_POINTER]
+    library.run_ensemble.restype = None
+    return library
+
+
+def toFloatArray(rows):
+    # Flattens a list of rows into an array of floats, which can be passed to the library
+    values = array.array('f')
+    for row in rows:
+        values.extend(row)
+    return values
+
+
+def floatPointer(values):
+    # values must be kept alive while the pointer is used
+    return ctypes.cast(values.buffer_info()[0], FLOAT_POINTER)
+
+
+class NativeKFoldAnn(KFoldAnn):
+    # The same networks as KFoldAnn, trained and run by the library in native/, which must be
+    # compiled with make. All the inputs are run in one call to the library. The networks are
+    # trained in parallel by several threads, which run at the same time since ctypes releases
+    # the interpreter lock while the library is called.
+
+    def __init__(self, settings):
+        self.library = loadLibrary()
+        if self.library == None:
+            print "ERROR: could not load {}, compile it with make in {}".format(LIBRARY_PATH, os.path.dirname(LIBRARY_PATH))
+            exit(-1)
+
+        self.k = settings.k
+        self.mses = [0]*settings.k
+        self.nThreads = settings.nThreads
+        self.nInputs = len(settings.parameterRanges) + len(settings.problemParameters)
+        self.ensemble = self.library.create_ensemble(settings.k, self.nInputs, settings.networkSize, random.getrandbits(32))
+
+
+    def __del__(self):
+        if hasattr(self, "ensemble"):
+            self.library.destroy_ensemble(self.ensemble)
+
+
+    def trainSingleNetwork(self, networkIndex, trainingInput, trainingOutput, testInput, testOutput):
+        inputs = toFloatArray(trainingInput)
+        outputs = toFloatArray(trainingOutput)
+        testInputs = toFloatArray(testInput)
+        testOutputs = toFloatArray(testOutput)
+
+        self.mses[networkIndex] = self.library.train_network(self.ensemble, networkIndex,
+                                                             floatPointer(inputs), floatPointer(outputs), len(trainingInput),
+                                                             floatPointer(testInputs), floatPointer(testOutputs), len(testInput))
+
+
+    def train(self, trainingInput, trainingOutput):
+        
+        folds = self.getFolds(trainingInput, trainingOutput)
+        
+        # Each network is initialized from its own seed and has its own training data, so the
+        # result does not depend on the number of threads or the order the networks are trained in
+        untrained = range(0, self.k)
+        nTrained = [0]
+        lock = threading.Lock()
+        
+        def trainNetworks():
+            while True:
+                with lock:
+                    if len(untrained) == 0:
+                        return
+                    i = untrained.pop(0)
+                    
+                self.trainSingleNetwork(i, *folds[i])
+                
+                with lock:
+                    nTrained[0] += 1
+                    self.printProgress(nTrained[0])
+        
+        self.printProgress(0)
+        threads = [threading.Thread(target=trainNetworks) for t in range(0, min(self.nThreads, self.k))]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+            
+        print
+
+
+    def runAll(self, inputData):
+        inputs = toFloatArray(inputData)
+        outputs = array.array('f', [0])*len(inputData)
+        self.library.run_ensemble(self.ensemble, floatPointer(inputs), len(inputData), floatPointer(outputs))
+
+        return outputs.tolist()
@@ -4,6 +4,13 @@
 # This file is part of the AUMA machine learning based auto tuning application
 # developed at the Norwegian University of Science and technology
 
+import multiprocessing
+from constraints import Constraints
+
+def parseAssignments(value):
+    # Space separated NAME=VALUE pairs, with integer values
+    return dict((p.split("=")[0], int(p.split("=")[1])) for p in value.split())
+
 
 class Settings:
     
@@ -57,11 +64,37 @@ class Settings:
                 self.keepFiles = int(l[1])
             if l[0] == "K":
                 self.k = int(l[1])
+            if l[0] == "MAX_RELATIVE_STDDEV":
+                self.maxRelativeStddev = float(l[1])
+            if l[0] == "TRAINING_FILES":
+                self.trainingFiles = l[1].split()
+            if l[0] == "PROBLEM_PARAMETERS":
+                self.problemParameters = l[1].split()
+            if l[0] == "PROBLEM":
+                self.problem = parseAssignments(l[1])
+            if l[0] == "CONSTRAINTS":
+                self.constraintsFile = l[1].strip()
+            if l[0] == "DEVICE_LIMITS":
+                self.deviceLimits = parseAssignments(l[1])
+            if l[0] == "ENGINE":
+                self.engine = l[1].strip()
+            if l[0] == "N_THREADS":
+                self.nThreads = int(l[1])
                 
         self.computeNConfigurations()
         
         self.checkSettings()
         
+        self.problemValues = [self.problem[p] for p in self.problemParameters]
+        
+        if self.constraintsFile != None:
+            constants = dict(self.deviceLimits)
+            constants.update(self.problem)
+            self.constraints = Constraints(self.constraintsFile, constants)
+            if len(self.constraints.parameters) != len(self.parameterRanges):
+                print "ERROR: {} has {} parameters, but there are {} parameter ranges".format(self.constraintsFile, len(self.constraints.parameters), len(self.parameterRanges))
+                exit(-1)
+        
         
     def computeNConfigurations(self):
         n = 1
@@ -96,8 +129,8 @@ class Settings:
             print "ERROR: maximum number of samples in second stage must be larger than minimum"
             exit(-1)
 
-        if self.secondStageThreshold < 0.0 or self.secondStageThreshold > 1.0:
-            print "ERROR: second stage threshold must be between 0 and 1.0"
+        if self.secondStageThreshold <= 0.0 or self.secondStageThreshold >= 1.0:
+            print "ERROR: second stage threshold must be between 0 and 1.0, exclusive"
             exit(-1)
             
         if self.useSecondStageAbs and self.useSecondStageThreshold:
@@ -110,8 +143,12 @@ class Settings:
             print "ERROR: k must be positive"
             exit(-1)
             
-        if self.file2 == None:
-            print "ERROR: must specify file 2."
+        if self.maxRelativeStddev < 0.0:
+            print "ERROR: maximum relative standard deviation cannot be negative"
+            exit(-1)
+            
+        if self.file2 == None and len(self.trainingFiles) == 0:
+            print "ERROR: must specify file 2 or training files."
             exit(-1)
             
         if self.file4 != None and self.command2 == None:
@@ -126,6 +163,19 @@ class Settings:
             print "ERROR: parameter ranges cannot be 0"
             exit(-1)
             
+        if self.nThreads <= 0:
+            print "ERROR: number of threads must be positive"
+            exit(-1)
+            
+        if self.engine not in ["fann", "native"]:
+            print "ERROR: engine must be fann or native, not {}".format(self.engine)
+            exit(-1)
+            
+        for p in self.problemParameters:
+            if p not in self.problem:
+                print "ERROR: the problem parameter {} is not given a value in PROBLEM".format(p)
+                exit(-1)
+            
         if self.nConfigurations < self.nTrainingSamples:
             print "WARNING: {} training samples requested, but only {} unique exists.".format(self.nTrainingSamples, self.nConfigurations)
             print "Reducing numer of training samples to {}".format(self.nConfigurations)
@@ -149,6 +199,16 @@ class Settings:
         self.secondStageThreshold = 0.1
         self.keepFiles = 0
         self.k = 10
+        self.maxRelativeStddev = 0.0
+        self.trainingFiles = []
+        self.problemParameters = []
+        self.problem = {}
+        self.problemValues = []
+        self.constraintsFile = None
+        self.deviceLimits = {}
+        self.constraints = None
+        self.engine = "fann"
+        self.nThreads = multiprocessing.cpu_count()
         
         self.useSecondStageAbs = False
         self.useSecondStageThreshold = False
@@ -168,4 +228,12 @@ class Settings:
         print "N_SECOND_STAGE", self.nSecondStage
         print "KEEP_FILES", self.keepFiles
         print "K", self.k
+        print "MAX_RELATIVE_STDDEV", self.maxRelativeStddev
+        print "TRAINING_FILES", self.trainingFiles
+        print "PROBLEM_PARAMETERS", self.problemParameters
+        print "PROBLEM", self.problem
+        print "CONSTRAINTS", self.constraintsFile
+        print "DEVICE_LIMITS", self.deviceLimits
+        print "ENGINE", self.engine
+        print "N_THREADS", self.nThreads
             
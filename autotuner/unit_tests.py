@@ -5,12 +5,15 @@
 # developed at the Norwegian University of Science and technology
 
 import os
+import struct
 from settings import Settings
 from autotuner import *
 from datautil import * 
 import fileoperations
 import unittest
 from fileoperations import createFile3
+from constraints import Constraints
+from native_ann import NativeKFoldAnn, loadLibrary
 
 class TestSettings(unittest.TestCase):
     
@@ -58,8 +61,157 @@ class TestFileoperations(unittest.TestCase):
         d_short = fileoperations.parseLine(line_short, dimensions)
         
         self.assertEqual(None, d_short)
+
+
+    def test_readData_statistics(self):
+        dimensions = [4,4,4,4]
+        dataFile = open("test_file2.txt", "w+")
+        dataFile.write("# comment\n")
+        dataFile.write("2 3 1 0 34.4\n")
+        dataFile.write("1 0 2 3 20.5 20.1 20.6 0.3\n")
+        dataFile.write("0 0 1 1 -1.000000 0.000000 0.000000 0.000000\n")
+        dataFile.write("3 0 2 1 11.2 11.0 11.3 0.1 16\n")
+        dataFile.close()
+
+        inputData = []
+        outputData = []
+        fileoperations.readData(inputData, outputData, "test_file2.txt", dimensions)
+        os.remove("test_file2.txt")
+
+        self.assertEqual([[2,3,1,0],[1,0,2,3],[0,0,1,1],[3,0,2,1]], inputData)
+        self.assertEqual([[34.4],[20.5],[-1],[11.2]], outputData)
+
+
+    def test_readData_noisy(self):
+        dimensions = [4,4,4,4]
+        dataFile = open("test_file2.txt", "w+")
+        dataFile.write("2 3 1 0 34.4\n")
+        dataFile.write("1 0 2 3 20.5 20.1 20.6 0.3\n")
+        dataFile.write("1 1 2 3 20.5 12.1 25.6 8.3\n")
+        dataFile.close()
+
+        inputData = []
+        outputData = []
+        fileoperations.readData(inputData, outputData, "test_file2.txt", dimensions, 0.1)
+        os.remove("test_file2.txt")
+
+        self.assertEqual([[2,3,1,0],[1,0,2,3]], inputData)
+        self.assertEqual([[34.4],[20.5]], outputData)
+
+
+    def test_readData_binary(self):
+        dimensions = [4,4,4,4]
+        rows = [[2,3,1,0],[1,0,2,3],[0,0,1,1]]
+        times = [[34.5,34.1,34.6,0.2],[20.5,12.1,25.6,8.3],[-1.0,0.0,0.0,0.0]]
+        
+        dataFile = open("test_file2.bin", "wb")
+        dataFile.write(fileoperations.RESULTS_MAGIC_V1)
+        dataFile.write(struct.pack("ii", 4, 3))
+        dataFile.write(struct.pack("iiii", *dimensions))
+        dataFile.write("".join(struct.pack("32s", name) for name in ["A", "B", "C", "D"]))
+        for p in range(0, 4):
+            dataFile.write(struct.pack("3b", *[r[p] for r in rows]))
+        dataFile.write("\0"*4)
+        for c in range(0, 4):
+            dataFile.write(struct.pack("3d", *[t[c] for t in times]))
+        dataFile.write(struct.pack("3i", 16, 16, 0))
+        dataFile.write(struct.pack("3i", 0, 0, 0))
+        dataFile.close()
         
-    
+        inputData = []
+        outputData = []
+        fileoperations.readData(inputData, outputData, "test_file2.bin", dimensions, 0.1)
+        os.remove("test_file2.bin")
+        
+        self.assertEqual([[2,3,1,0],[0,0,1,1]], inputData)
+        self.assertEqual([[34.5],[-1.0]], outputData)
+
+
+    def test_readData_binary_blocks(self):
+        dimensions = [4,4,4]
+        rows = [[2,3,1],[1,0,2],[0,0,1]]
+        times = [[34.5,34.1,34.6,0.2],[20.5,12.1,25.6,8.3],[-1.0,0.0,0.0,0.0]]
+        
+        # Blocks of 2 rows, the second with one unused row
+        dataFile = open("test_file2.bin", "wb")
+        dataFile.write(fileoperations.RESULTS_MAGIC)
+        dataFile.write(struct.pack("iiii", 3, 3, 2, 1))
+        dataFile.write(struct.pack("iii", *dimensions))
+        dataFile.write("".join(struct.pack("32s", name) for name in ["A", "B", "C", "RADIUS"]))
+        dataFile.write(struct.pack("i", 2))
+        for block in [rows[0:2], rows[2:3] + [[5,5,5]]]:
+            blockTimes = [times[rows.index(r)] if r in rows else [9.0]*4 for r in block]
+            for p in range(0, 3):
+                dataFile.write(struct.pack("2b", *[r[p] for r in block]))
+            dataFile.write("\0"*2)
+            for c in range(0, 4):
+                dataFile.write(struct.pack("2d", *[t[c] for t in blockTimes]))
+            dataFile.write(struct.pack("2i", 16, 16))
+            dataFile.write(struct.pack("2i", 0, 0))
+        dataFile.close()
+        
+        inputData = []
+        outputData = []
+        fileoperations.readData(inputData, outputData, "test_file2.bin", dimensions, 0.1, ["RADIUS"])
+        os.remove("test_file2.bin")
+        
+        self.assertEqual([[2,3,1,2],[0,0,1,2]], inputData)
+        self.assertEqual([[34.5],[-1.0]], outputData)
+
+
+    def test_readData_problem(self):
+        dimensions = [4,4]
+        dataFile = open("test_file2.txt", "w+")
+        dataFile.write("#Warning: No correct file provided, output check will not be performed\n")
+        dataFile.write("# ./convolution\n")
+        dataFile.write("\n")
+        dataFile.write("# IMAGE_HEIGHT 512\n")
+        dataFile.write("# IMAGE_WIDTH 2048\n")
+        dataFile.write("# CPU_REFERENCE_TIME 2040.5\n")
+        dataFile.write("\n")
+        dataFile.write("2 3 34.4\n")
+        dataFile.write("# IMAGE_WIDTH 16\n")
+        dataFile.write("1 0 20.5\n")
+        dataFile.close()
+
+        inputData = []
+        outputData = []
+        fileoperations.readData(inputData, outputData, "test_file2.txt", dimensions, 0, ["IMAGE_WIDTH", "IMAGE_HEIGHT"])
+        os.remove("test_file2.txt")
+
+        self.assertEqual([[2,3,2048,512],[1,0,2048,512]], inputData)
+        self.assertEqual([[34.4],[20.5]], outputData)
+
+
+    def test_readData_binary_problem(self):
+        dimensions = [4,4]
+        
+        dataFile = open("test_file2.bin", "wb")
+        dataFile.write(fileoperations.RESULTS_MAGIC_V1)
+        dataFile.write(struct.pack("ii", 2, 2))
+        dataFile.write(struct.pack("ii", *dimensions))
+        dataFile.write("".join(struct.pack("32s", name) for name in ["A", "B"]))
+        dataFile.write(struct.pack("2b", 2, 1))
+        dataFile.write(struct.pack("2b", 3, 0))
+        dataFile.write("\0"*4)
+        for c in range(0, 4):
+            dataFile.write(struct.pack("2d", 34.5, 20.5))
+        dataFile.write(struct.pack("2i", 1, 1))
+        dataFile.write(struct.pack("2i", 0, 0))
+        dataFile.write(struct.pack("i", 2))
+        dataFile.write("".join(struct.pack("32s", name) for name in ["MIN_DISPARITY", "RADIUS"]))
+        dataFile.write(struct.pack("2i", -8, 2))
+        dataFile.close()
+        
+        inputData = []
+        outputData = []
+        fileoperations.readData(inputData, outputData, "test_file2.bin", dimensions, 0, ["RADIUS", "MIN_DISPARITY"])
+        os.remove("test_file2.bin")
+        
+        self.assertEqual([[2,3,2,-8],[1,0,2,-8]], inputData)
+        self.assertEqual([[34.5],[20.5]], outputData)
+
+
     def test_createFile3(self):
         settings = Settings()
         settings.file3 = "test_file3.txt"
@@ -83,6 +235,90 @@ class TestFileoperations(unittest.TestCase):
         self.assertEqual("10 11 12", lines[4])
         
         os.remove("test_file3.txt")
+        
+        
+    def test_createFile1_constraints(self):
+        settings = Settings()
+        settings.file1 = "test_file1.txt"
+        settings.parameterRanges = [4,4]
+        settings.computeNConfigurations()
+        settings.nTrainingSamples = 8
+        
+        constraintsFile = open("test_constraints.txt", "w+")
+        constraintsFile.write("parameters A B\n")
+        constraintsFile.write("require A <= B\n")
+        constraintsFile.close()
+        settings.constraints = Constraints("test_constraints.txt", {})
+        os.remove("test_constraints.txt")
+        
+        fileoperations.createFile1(settings)
+        
+        file1 = open("test_file1.txt")
+        lines = [[int(x) for x in line.split()] for line in file1]
+        file1.close()
+        os.remove("test_file1.txt")
+        
+        self.assertEqual([8,2], lines[0])
+        self.assertEqual(8, len(lines[1:]))
+        self.assertTrue(all(c[0] <= c[1] for c in lines[1:]))
+        
+
+class TestConstraints(unittest.TestCase):
+    
+    def setUp(self):
+        return None
+        
+    def createConstraints(self, lines, constants={}):
+        constraintsFile = open("test_constraints.txt", "w+")
+        constraintsFile.write("\n".join(lines) + "\n")
+        constraintsFile.close()
+        constraints = Constraints("test_constraints.txt", constants)
+        os.remove("test_constraints.txt")
+        return constraints
+        
+    def test_Constraints(self):
+        constraints = self.createConstraints(["# Comment",
+                                              "parameters A B",
+                                              "",
+                                              "table SIZE 1 2 4 6",
+                                              "let a = SIZE[A]   # Comment",
+                                              "let b = 1 << B",
+                                              "require a*b <= LIMIT",
+                                              "require !(A == 3 && B == 0)"], {"LIMIT" : 12})
+        
+        self.assertEqual(["A", "B"], constraints.parameters)
+        self.assertTrue(constraints.isValid([0,0]))
+        self.assertTrue(constraints.isValid([2,1]))
+        self.assertFalse(constraints.isValid([2,2]))
+        self.assertFalse(constraints.isValid([3,0]))
+        self.assertTrue(constraints.isValid([3,1]))
+        self.assertFalse(constraints.isValid([4,0]))
+        
+    def test_Constraints_expressions(self):
+        constraints = self.createConstraints(["parameters A",
+                                              "require 1 + 2*3 == 7 && (1 + 2)*3 == 9",
+                                              "require -7/2 == -3 && -7%2 == -1 && 7/-2 == -3",
+                                              "require 1 < 2 == 1 && !0 == 1 && 2 - 1 - 1 == 0",
+                                              "require 1 << 2 + 1 == 8 && 1 || 1/0",
+                                              "require 12/A > 2"])
+        
+        self.assertTrue(constraints.isValid([4]))
+        self.assertFalse(constraints.isValid([6]))
+        self.assertFalse(constraints.isValid([0]))
+        
+    def test_Constraints_benchmark(self):
+        deviceLimits = {"MAX_WORK_GROUP_SIZE" : 1024, "MAX_WORK_ITEM_SIZE_0" : 1024, "MAX_WORK_ITEM_SIZE_1" : 1024,
+                        "MAX_WORK_ITEM_SIZE_2" : 64, "LOCAL_MEM_SIZE" : 65536, "MAX_CONSTANT_BUFFER_SIZE" : 65536}
+        problem = {"MIN_DISPARITY" : -8, "MAX_DISPARITY" : 8, "RADIUS" : 2, "IMAGE_WIDTH" : 256, "IMAGE_HEIGHT" : 256}
+        problem.update(deviceLimits)
+        constraints = Constraints("../benchmarks/stereo/stereo.constraints", problem)
+        
+        self.assertEqual(11, len(constraints.parameters))
+        self.assertTrue(constraints.isValid([3,1,1,3,1,0,2,0,2,1,1]))
+        self.assertFalse(constraints.isValid([2,5,6,1,0,1,2,1,1,1,0]))
+        self.assertFalse(constraints.isValid([6,5,0,0,0,0,0,0,0,0,0]))
+        self.assertFalse(constraints.isValid([3,0,6,0,0,0,0,0,0,0,0]))
+        
 
 class TestTransformer(unittest.TestCase):
 
@@ -104,6 +340,14 @@ class TestTransformer(unittest.TestCase):
         self.assertEqual([-1,3,2,1], newInputData[1])
         
         
+    def test_transformInput_problem(self):
+        inputData = [[1,3,2047,-7,0]]
+        dimensions = [2,8]
+        newInputData = transformInput(inputData,dimensions)
+        
+        self.assertEqual([1,-1,11,-3,0], newInputData[0])
+        
+        
     def test_filterData(self):
         inputData = [[1],[2],[3],[4]]
         outputData = [[-1],[1],[-1],[1]]
@@ -128,6 +372,18 @@ class TestTransformer(unittest.TestCase):
         self.assertEqual([3,1,3,2], getConfigurationForNumber(4*2*4*3-1, parameterRanges))
         
         
+    def test_RandomPermutation(self):
+        for n in [1,2,3,4,5,17,1000]:
+            permutation = RandomPermutation(n)
+            
+            self.assertEqual(n, len(permutation))
+            self.assertEqual(range(0,n), sorted(permutation))
+            
+        permutation = RandomPermutation(1000)
+        self.assertNotEqual(range(0,1000), list(permutation))
+        self.assertRaises(IndexError, permutation.__getitem__, 1000)
+        
+        
     def test_configurationToString(self):
         c = [2,4,3,1,6]
         
@@ -136,6 +392,45 @@ class TestTransformer(unittest.TestCase):
         self.assertEqual("2 4 3 1 6 \n", s)
 
 
+@unittest.skipIf(loadLibrary() == None, "the native library is not compiled")
+class TestNativeKFoldAnn(unittest.TestCase):
+    
+    def setUp(self):
+        self.settings = Settings()
+        self.settings.parameterRanges = [4,4,2]
+        self.settings.k = 4
+        self.settings.networkSize = 10
+        
+        self.inputData = [[a-2, b-2, c] for a in range(0,4) for b in range(0,4) for c in [-1,1]]
+        self.outputData = [[0.3*x[0] - 0.2*x[1] + 0.1*x[2] + 0.05*x[0]*x[1]] for x in self.inputData]
+        
+    def train(self, seed, nThreads=1):
+        random.seed(seed)
+        self.settings.nThreads = nThreads
+        kfa = NativeKFoldAnn(self.settings)
+        kfa.train(self.inputData*3, self.outputData*3)
+        return kfa
+        
+    def test_train(self):
+        kfa = self.train(0)
+        
+        predictions = kfa.runAll(self.inputData)
+        self.assertEqual(len(self.inputData), len(predictions))
+        for p, o in zip(predictions, self.outputData):
+            self.assertAlmostEqual(o[0], p, delta=0.05)
+            
+        self.assertTrue(0 < kfa.getErrorEstimate() < 0.05)
+        
+    def test_train_seed(self):
+        self.assertEqual(self.train(1).runAll(self.inputData), self.train(1).runAll(self.inputData))
+        self.assertNotEqual(self.train(1).runAll(self.inputData), self.train(2).runAll(self.inputData))
+        
+    def test_train_threads(self):
+        kfa = self.train(1, nThreads=3)
+        self.assertEqual(self.train(1).runAll(self.inputData), kfa.runAll(self.inputData))
+        self.assertEqual(self.train(1).mses, kfa.mses)
+        
+        
 class  Mock_KFoldAnn:
     
     def train(self, a, b):
@@ -200,6 +495,33 @@ class TestAutotuner(unittest.TestCase):
 
         self.assertAlmostEqual(t,110.000,places=3)
         
+        # Above 0.5, the threshold is below the best time
+        settings.secondStageThreshold = 0.7
+        t = getSecondStageTimeThreshold(100, kfa, settings)
+        self.assertAlmostEqual(t,92.844,places=3)
+        
+        # No configuration can be discarded if the error is too large
+        kfa.getErrorEstimate = lambda : 2.0
+        settings.secondStageThreshold = 0.1
+        self.assertEqual(float("inf"), getSecondStageTimeThreshold(100, kfa, settings))
+        
+        
+    def test_probIsOptimal(self):
+        p = probIsOptimal([100, 100], 0.1)
+        self.assertAlmostEqual(0.5, p[0], 6)
+        self.assertAlmostEqual(0.5, p[1], 6)
+        
+        # The first is faster than the second with probability probIsMin
+        p = probIsOptimal([100, 110], 0.1)
+        self.assertAlmostEqual(probIsMin(100, 110, 10, 11), p[0], 3)
+        
+        p = probIsOptimal([100, 105, 120, 200], 0.1)
+        self.assertAlmostEqual(1.0, sum(p))
+        self.assertTrue(p[0] > p[1] > p[2] > 0)
+        self.assertTrue(p[3] < 1e-5)
+        
+        self.assertEqual([0.5, 0.0, 0.5], probIsOptimal([100, 110, 100], 0.0))
+        
         
     def test_getSubset(self):
         full1 = [[1],[2],[3],[4],[5]]
@@ -251,6 +573,33 @@ class TestAutotuner(unittest.TestCase):
         self.assertFalse([0,0,2,0] in allCombinations)
         self.assertFalse([0,0,0,5] in allCombinations)
         
+    def test_iterInputCombinations(self):
+        settings= Settings()
+        settings.parameterRanges = [3,4,2,5]
+        settings.computeNConfigurations()
+        
+        batches = list(iterInputCombinations(settings, 7))
+        
+        self.assertEqual(18, len(batches))
+        self.assertTrue(all(len(b) == 7 for b in batches[:-1]))
+        self.assertEqual(getAllInputCombinations(settings), sum(batches, []))
+        
+    def test_SecondStageSelector(self):
+        random.seed(0)
+        predictions = [random.choice([0.5, 1.0, 1.5]) + random.random() for i in range(0, 1000)]
+        expected = sorted(range(0, 1000), key=predictions.__getitem__)
+        
+        selector = SecondStageSelector(10)
+        for start in range(0, 1000, 64):
+            selector.add(predictions[start:start+64], range(start, min(start+64, 1000)))
+        self.assertEqual(expected[0:10], [number for prediction, number in selector.getSelected()])
+        self.assertEqual(sorted(predictions)[0:10], [prediction for prediction, number in selector.getSelected()])
+        self.assertEqual(min(predictions), selector.bestPrediction)
+        
+        selector = SecondStageSelector(10)
+        selector.add([1.0]*20, range(0, 20))
+        self.assertEqual(range(0, 10), [number for prediction, number in selector.getSelected()])
+        
     def test_tune(self):
         inputData = []
         outputData = []
@@ -263,13 +612,128 @@ class TestAutotuner(unittest.TestCase):
         
         secondStageTimeThreshold, secondStageConfigs = tune(inputData, outputData, settings, Mock_KFoldAnn())
         
-        self.assertEqual(2*3*4, len(secondStageConfigs))
+        # Only 3 configurations are predicted to be faster than the threshold, but the benchmark
+        # decides where to stop, so SECOND_STAGE_MARGIN candidates are selected for each it may count
+        self.assertEqual(SECOND_STAGE_MARGIN*settings.nSecondStageMax, len(secondStageConfigs))
         self.assertEqual([0,0,0], secondStageConfigs[0])
         self.assertEqual(1, sum(secondStageConfigs[1]))
         self.assertEqual(1, sum(secondStageConfigs[2]))
         self.assertEqual(1, sum(secondStageConfigs[2]))
         self.assertAlmostEqual(7.201, secondStageTimeThreshold, 3)
         
+        settings.nSecondStageMax = 2
+        secondStageTimeThreshold, secondStageConfigs = tune(inputData, outputData, settings, Mock_KFoldAnn())
+        self.assertEqual(2*SECOND_STAGE_MARGIN, len(secondStageConfigs))
+        self.assertEqual([0,0,0], secondStageConfigs[0])
+        
+    def runSecondStage(self, secondStageConfigs, timeThreshold, nMin, nMax, measure):
+        # The stopping rules of record_result in driver.c. Returns the number of configurations counted.
+        nCounted = 0
+        for config in secondStageConfigs:
+            time = measure(config)
+            if time > 0:
+                nCounted += 1
+            if time > timeThreshold and nCounted >= nMin:
+                break
+            if nCounted >= nMax:
+                break
+        return nCounted
+        
+    def test_tune_failures(self):
+        settings = Settings()
+        settings.useSecondStageThreshold = True
+        settings.parameterRanges = [2,3,4]
+        settings.computeNConfigurations()
+        settings.nTrainingSamples = 0
+        settings.nSecondStageMin = 2
+        settings.nSecondStageMax = 4
+        settings.secondStageThreshold = 0.1
+        
+        secondStageTimeThreshold, secondStageConfigs = tune([], [], settings, Mock_KFoldAnn())
+        
+        # The first 3 configurations fail, and the rest are measured to be faster than the threshold,
+        # so the benchmark still counts N_SECOND_STAGE_MAX configurations
+        failed = secondStageConfigs[0:3]
+        measure = lambda config: -1 if config in failed else secondStageTimeThreshold/2
+        nCounted = self.runSecondStage(secondStageConfigs, secondStageTimeThreshold, settings.nSecondStageMin, settings.nSecondStageMax, measure)
+        self.assertEqual(settings.nSecondStageMax, nCounted)
+        
+    def test_tune_zeroThreshold(self):
+        settings = Settings()
+        settings.useSecondStageThreshold = True
+        settings.parameterRanges = [2,3,4]
+        settings.computeNConfigurations()
+        settings.nTrainingSamples = 0
+        settings.nSecondStageMin = 2
+        settings.secondStageThreshold = 0.99
+        
+        # With a large error, the time threshold above 0.5 is 0, so the benchmark stops after the minimum
+        kfa = Mock_KFoldAnn()
+        kfa.getErrorEstimate = lambda : 0.5
+        secondStageTimeThreshold, secondStageConfigs = tune([], [], settings, kfa)
+        
+        self.assertEqual(0.0, secondStageTimeThreshold)
+        self.assertEqual(SECOND_STAGE_MARGIN*settings.nSecondStageMax, len(secondStageConfigs))
+        self.assertEqual([0,0,0], secondStageConfigs[0])
+        nCounted = self.runSecondStage(secondStageConfigs, secondStageTimeThreshold, settings.nSecondStageMin, settings.nSecondStageMax, lambda config: 1.0)
+        self.assertEqual(settings.nSecondStageMin, nCounted)
+        
+    def test_tune_problem(self):
+        settings = Settings()
+        settings.useSecondStageAbs = True
+        settings.parameterRanges = [2,3]
+        settings.computeNConfigurations()
+        settings.nTrainingSamples = 0
+        settings.nSecondStage = 2
+        settings.problemParameters = ["IMAGE_WIDTH"]
+        settings.problemValues = [1023]
+        
+        kfa = Mock_KFoldAnn()
+        predicted = []
+        kfa.runAll = lambda inputData: predicted.extend(inputData) or [math.log(sum(x[:2])+10) for x in inputData]
+        
+        secondStageTimeThreshold, secondStageConfigs = tune([], [], settings, kfa)
+        
+        self.assertEqual(2*3, len(predicted))
+        self.assertTrue(all(len(x) == 3 and x[2] == 10 for x in predicted))
+        self.assertEqual([[0,0],[0,1]], sorted(secondStageConfigs))
+        
+    def test_tune_constraints(self):
+        settings = Settings()
+        settings.useSecondStageThreshold = True
+        settings.parameterRanges = [3,4]
+        settings.computeNConfigurations()
+        settings.nTrainingSamples = 0
+        settings.secondStageThreshold = 0.1
+        
+        constraintsFile = open("test_constraints.txt", "w+")
+        constraintsFile.write("parameters A B\nrequire A + B != 1\n")
+        constraintsFile.close()
+        settings.constraints = Constraints("test_constraints.txt", {})
+        os.remove("test_constraints.txt")
+        
+        secondStageTimeThreshold, secondStageConfigs = tune([], [], settings, Mock_KFoldAnn())
+        
+        self.assertEqual(3*4-2, len(secondStageConfigs))
+        self.assertEqual([0,0], secondStageConfigs[0])
+        self.assertEqual([0,2], secondStageConfigs[1])
+        self.assertFalse([1,0] in secondStageConfigs)
+        
+    def test_tune_noValidConfigurations(self):
+        settings = Settings()
+        settings.useSecondStageThreshold = True
+        settings.parameterRanges = [3,4]
+        settings.computeNConfigurations()
+        settings.nTrainingSamples = 0
+        
+        constraintsFile = open("test_constraints.txt", "w+")
+        constraintsFile.write("parameters A B\nrequire A + B > 10\n")
+        constraintsFile.close()
+        settings.constraints = Constraints("test_constraints.txt", {})
+        os.remove("test_constraints.txt")
+        
+        self.assertRaises(SystemExit, tune, [], [], settings, Mock_KFoldAnn())
+        
     def test_tune_secondStageSize(self):
         inputData = []
         outputData = []
@@ -283,7 +747,7 @@ class TestAutotuner(unittest.TestCase):
         
         secondStageTimeThreshold, secondStageConfigs = tune(inputData, outputData, settings, Mock_KFoldAnn())
         
-        self.assertEqual(2*3*4, len(secondStageConfigs))
+        self.assertEqual(SECOND_STAGE_MARGIN*settings.nSecondStageMax, len(secondStageConfigs))
         
         settings.useSecondStageAbs = True
         secondStageTimeThreshold, secondStageConfigs = tune(inputData, outputData, settings, Mock_KFoldAnn())
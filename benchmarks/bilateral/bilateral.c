@@ -17,6 +17,15 @@
 #include "../common/configurations.h"
 #include "../common/io.h"
 #include "../common/parser.h"
+#include "../common/session.h"
+#include "../common/pipeline.h"
+#include "../common/timing.h"
+#include "../common/driver.h"
+#include "../common/compare.h"
+#include "../common/device_check.h"
+#include "../common/reference.h"
+#include "../common/problem.h"
+#include "../common/constraints.h"
 
 // Tuning parameters
 int LOCAL_SIZE_X =              0;
@@ -35,16 +44,22 @@ int PRECOMPUTE_DIST =           9;
 
 int global_config[] = {3,3,2,0,0,0,0,0,0,0};
 int param_limits[] =  {6,6,6,6,6,6,2,2,2,2}; //Or, rather, the limit + 1
+char* param_names[] = {"LOCAL_SIZE_X", "LOCAL_SIZE_Y", "LOCAL_SIZE_Z", "ELEMENTS_PER_THREAD_X", "ELEMENTS_PER_THREAD_Y", "ELEMENTS_PER_THREAD_Z", "USE_TEXTURE", "USE_LOCAL", "PRECOMPUTE", "PRECOMPUTE_DIST"};
 int n_parameters = 10;
 
-//Problem parameters
-const int IMAGE_WIDTH = 128;
-const int IMAGE_HEIGHT = 64;
-const int IMAGE_DEPTH = 64;
-const int PADDING = 2;
-const int FILTER_WIDTH = 5;
-const int FILTER_HEIGHT = 5;
-const int FILTER_DEPTH = 3;
+//Problem parameters, can be set with -D
+int IMAGE_WIDTH = 128;
+int IMAGE_HEIGHT = 64;
+int IMAGE_DEPTH = 64;
+int PADDING = 2;
+int FILTER_WIDTH = 5;
+int FILTER_HEIGHT = 5;
+int FILTER_DEPTH = 3;
+
+problem_parameter problem_parameters[] = {{"IMAGE_HEIGHT", &IMAGE_HEIGHT}, {"IMAGE_WIDTH", &IMAGE_WIDTH}, {"IMAGE_DEPTH", &IMAGE_DEPTH},
+                                          {"PADDING", &PADDING}, {"FILTER_WIDTH", &FILTER_WIDTH}, {"FILTER_HEIGHT", &FILTER_HEIGHT},
+                                          {"FILTER_DEPTH", &FILTER_DEPTH}};
+int n_problem_parameters = 7;
 
 
 int index(int x, int y, int z){
@@ -144,38 +159,80 @@ unsigned char* create_input(){
 
 
 
-void bilateral_cpu(unsigned char* input, unsigned char* output){
-    
-    float* dist_filter = create_distance_filter();
-    float* color_filter = create_color_filter();
-    
-    for(int x = 0; x < IMAGE_WIDTH; x++){
-        for(int y = 0; y < IMAGE_HEIGHT; y++){
-            for(int z = 0; z < IMAGE_DEPTH; z++){
-                
-                float sum = 0.0;
-                int ci = index(x,y,z);
-                float norm = 0.0;
-                
+typedef struct{
+    unsigned char* padded_input;
+    unsigned char* output;
+    float* dist_filter;
+    float* color_filter;
+} bilateral_reference;
+
+// Computes rows [start, end) of the output, counting the rows of all slices. A row is accumulated one
+// filter element at a time, in the kernel's order, so that the inner loop is over consecutive pixels.
+void bilateral_rows(int start, int end, void* arg){
+    bilateral_reference* r = (bilateral_reference*)arg;
+    float* norm = (float*)malloc(sizeof(float)*IMAGE_WIDTH);
+    float* sum = (float*)malloc(sizeof(float)*IMAGE_WIDTH);
+
+    for(int row = start; row < end; row++){
+        int y = row % IMAGE_HEIGHT;
+        int z = row / IMAGE_HEIGHT;
+        unsigned char* center = r->padded_input + index(0, y, z);
+        for(int x = 0; x < IMAGE_WIDTH; x++){
+            norm[x] = 0.0;
+            sum[x] = 0.0;
+        }
+
+        for(int fx = 0; fx < FILTER_WIDTH; fx++){
+            for(int fy = 0; fy < FILTER_HEIGHT; fy++){
                 for(int fz = 0; fz < FILTER_DEPTH; fz++){
-                    for(int fy = 0; fy < FILTER_HEIGHT; fy++){
-                        for(int fx = 0; fx < FILTER_WIDTH; fx++){
-                            int i = index(x + fx - FILTER_WIDTH/2, y + fy - FILTER_HEIGHT/2, z + fz - FILTER_DEPTH/2);
-                            int fi = fz*FILTER_WIDTH*FILTER_HEIGHT + fy * FILTER_WIDTH + fx;
-                            
-                            int color_diff = abs(input[ci] - input[i]);
-                            
-                            
-                            norm += dist_filter[fi]*color_filter[color_diff];
-                            sum += input[i]*dist_filter[fi]*color_filter[color_diff];
-                        }       
+                    float df = r->dist_filter[fz*FILTER_WIDTH*FILTER_HEIGHT + fy * FILTER_WIDTH + fx];
+                    unsigned char* neighbour = r->padded_input + index(fx - FILTER_WIDTH/2, y + fy - FILTER_HEIGHT/2, z + fz - FILTER_DEPTH/2);
+                    for(int x = 0; x < IMAGE_WIDTH; x++){
+                        int b = neighbour[x];
+                        float cf = r->color_filter[abs(center[x] - b)];
+                        norm[x] += df*cf;
+                        sum[x] += b*df*cf;
                     }
                 }
-                
-                output[index(x,y,z)] = sum/norm;
+            }
+        }
+
+        unsigned char* output = r->output + (z*IMAGE_HEIGHT + y)*IMAGE_WIDTH;
+        for(int x = 0; x < IMAGE_WIDTH; x++){
+            output[x] = sum[x]/norm[x];
+        }
+    }
+
+    free(norm);
+    free(sum);
+}
+
+// Computes the unpadded output on the CPU, in the format of the correct file. The filters are
+// computed like in the kernel without PRECOMPUTE and PRECOMPUTE_DIST, which is how correct files are made.
+void bilateral_cpu(void* arg){
+    bilateral_reference* r = (bilateral_reference*)arg;
+    r->dist_filter = (float*)malloc(sizeof(float)*FILTER_WIDTH*FILTER_HEIGHT*FILTER_DEPTH);
+    r->color_filter = (float*)malloc(sizeof(float)*256);
+
+    for(int fz = 0; fz < FILTER_DEPTH; fz++){
+        for(int fy = 0; fy < FILTER_HEIGHT; fy++){
+            for(int fx = 0; fx < FILTER_WIDTH; fx++){
+                int dx = fx - FILTER_WIDTH/2;
+                int dy = fy - FILTER_HEIGHT/2;
+                int dz = fz - FILTER_DEPTH/2;
+                float d = sqrtf((float)(dx*dx + dy*dy + dz*dz));
+                r->dist_filter[fz*FILTER_WIDTH*FILTER_HEIGHT + fy * FILTER_WIDTH + fx] = expf(-(d*d)/(2.0f*4.0f));
             }
         }
     }
+    for(int i = 0; i < 256; i++){
+        r->color_filter[i] = expf(-(i*i)/(2.0f*85.0f));
+    }
+
+    parallel_for(IMAGE_HEIGHT*IMAGE_DEPTH, bilateral_rows, r);
+
+    free(r->dist_filter);
+    free(r->color_filter);
 }
 
 void print2d(float* buffer, int width, int height){
@@ -188,7 +245,7 @@ void print2d(float* buffer, int width, int height){
     printf("\n");
 }
 
-double bilateral_ocl(unsigned char* input, unsigned char* output, cl_device_id device, int* config){
+int bilateral_options(bench_session* session, int* config, char* options_buffer){
     
     int lwsx = pow(2, config[LOCAL_SIZE_X]);
     int lwsy = pow(2, config[LOCAL_SIZE_Y]);
@@ -199,29 +256,13 @@ double bilateral_ocl(unsigned char* input, unsigned char* output, cl_device_id d
     const size_t local_work_size[3] = {lwsx,lwsy,lwsz};
     const size_t global_work_size[3] = {(IMAGE_WIDTH/eptx),IMAGE_HEIGHT/epty, IMAGE_DEPTH/eptz};
     
-    if(invalid_work_group_size_static(device, 3, local_work_size, global_work_size)){
-        return -1;
+    if(invalid_work_group_size_static(session->device, 3, local_work_size, global_work_size)){
+        return 0;
     }
     
-    cl_int error;
-    cl_context context;
-    cl_command_queue queue;
-    cl_kernel kernel;
-    
-    
-    context = clCreateContext(NULL, 1, &device, NULL, NULL, &error);
-    clError("Couldn't get context", error);
-    
-    queue = clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &error);
-    clError("Couldn't create command queue", error);
-    
-    char* kernelName = "bilateral.cl";
-    char options_buffer [400];
     sprintf(options_buffer, "-D ELEMENTS_PER_THREAD_X=%d -D ELEMENTS_PER_THREAD_Y=%d -D ELEMENTS_PER_THREAD_Z=%d"
     " -D LOCAL_SIZE_X=%d -D LOCAL_SIZE_Y=%d -D LOCAL_SIZE_Z=%d"
-    " -D FILTER_WIDTH=%d -D FILTER_HEIGHT=%d -D FILTER_DEPTH=%d"
-    " -D IMAGE_WIDTH=%d -D IMAGE_HEIGHT=%d -D IMAGE_DEPTH=%d"
-    " -D PADDING=%d -D USE_TEXTURE=%d -D USE_LOCAL=%d -D PRECOMPUTE=%d -D PRECOMPUTE_DIST=%d -D INTERLEAVED=%d"
+    " -D USE_TEXTURE=%d -D USE_LOCAL=%d -D PRECOMPUTE=%d -D PRECOMPUTE_DIST=%d -D INTERLEAVED=%d"
     " -D INNER_LOOP=%d -D OUTER_LOOP=%d",
     (int)pow(2,config[ELEMENTS_PER_THREAD_X]),
             (int)pow(2,config[ELEMENTS_PER_THREAD_Y]),
@@ -229,13 +270,6 @@ double bilateral_ocl(unsigned char* input, unsigned char* output, cl_device_id d
             (int)pow(2,config[LOCAL_SIZE_X]),
             (int)pow(2,config[LOCAL_SIZE_Y]),
             (int)pow(2,config[LOCAL_SIZE_Z]),
-            FILTER_WIDTH,
-            FILTER_HEIGHT,
-            FILTER_DEPTH,
-            IMAGE_WIDTH,
-            IMAGE_HEIGHT,
-            IMAGE_DEPTH,
-            PADDING,
             config[USE_TEXTURE],
             config[USE_LOCAL],
             config[PRECOMPUTE],
@@ -244,20 +278,45 @@ double bilateral_ocl(unsigned char* input, unsigned char* output, cl_device_id d
             0,
             0
     );
+    append_problem_options(options_buffer);
+    
+    return 1;
+}
+
+// If checker is given, the output is only read back if it is wrong, otherwise output_checked is set
+double bilateral_ocl(unsigned char* input, unsigned char* output, bench_session* session, int* config, kernel_timing* timing, device_checker* checker, int* output_checked){
+    
+    cl_device_id device = session->device;
+    cl_context context = session->context;
+    cl_command_queue queue = session->queue;
+    
+    int lwsx = pow(2, config[LOCAL_SIZE_X]);
+    int lwsy = pow(2, config[LOCAL_SIZE_Y]);
+    int lwsz = pow(2, config[LOCAL_SIZE_Z]);
+    int eptx = pow(2, config[ELEMENTS_PER_THREAD_X]);
+    int epty = pow(2, config[ELEMENTS_PER_THREAD_Y]);
+    int eptz = pow(2, config[ELEMENTS_PER_THREAD_Z]);
+    const size_t local_work_size[3] = {lwsx,lwsy,lwsz};
+    const size_t global_work_size[3] = {(IMAGE_WIDTH/eptx),IMAGE_HEIGHT/epty, IMAGE_DEPTH/eptz};
+    
+    cl_int error;
+    cl_kernel kernel;
     
-    kernel = buildKernel(kernelName, "bilateral", options_buffer, context, device, &error);
+    char* kernelName = "bilateral.cl";
+    char options_buffer[MAX_OPTIONS_LENGTH];
+    if(!bilateral_options(session, config, options_buffer)){
+        return -1;
+    }
+    
+    kernel = build_session_kernel(session, kernelName, "bilateral", options_buffer, &error);
     if(error != CL_SUCCESS){
         clReleaseKernel(kernel);
-        clReleaseCommandQueue(queue);
-        clReleaseContext(context);
         return -3.0;
     }
     
     
     if(invalid_work_group_size(device, kernel, 3, local_work_size, global_work_size)){
         clReleaseKernel(kernel);
-        clReleaseCommandQueue(queue);
-        clReleaseContext(context);
         return  -1.0;
     }
     
@@ -269,37 +328,41 @@ double bilateral_ocl(unsigned char* input, unsigned char* output, cl_device_id d
         cl_image_format image_format;
         image_format.image_channel_order = CL_R;
         image_format.image_channel_data_type = CL_UNSIGNED_INT8;
-        input_device = clCreateImage3D(context,
-                                       CL_MEM_READ_ONLY|CL_MEM_COPY_HOST_PTR,
-                                       &image_format,
-                                       IMAGE_WIDTH+2*PADDING,
-                                       IMAGE_HEIGHT+2*PADDING,
-                                       IMAGE_DEPTH+2*PADDING,
-                                       IMAGE_WIDTH+2*PADDING*sizeof(unsigned char),
-                                       (IMAGE_WIDTH+2*PADDING)*(IMAGE_HEIGHT+2*PADDING)*sizeof(unsigned char),
-                                       input,
-                                       &error);
+        input_device = get_input_image3d(session,
+                                         &image_format,
+                                         IMAGE_WIDTH+2*PADDING,
+                                         IMAGE_HEIGHT+2*PADDING,
+                                         IMAGE_DEPTH+2*PADDING,
+                                         IMAGE_WIDTH+2*PADDING*sizeof(unsigned char),
+                                         (IMAGE_WIDTH+2*PADDING)*(IMAGE_HEIGHT+2*PADDING)*sizeof(unsigned char),
+                                         input,
+                                         &error);
     }else{
-        input_device = clCreateBuffer(context, CL_MEM_READ_WRITE|CL_MEM_COPY_HOST_PTR,  size, input, &error);
+        input_device = get_input_buffer(session, CL_MEM_READ_WRITE, size, input, &error);
     }
     
     cl_mem output_device = clCreateBuffer(context, CL_MEM_READ_WRITE, size, NULL, &error);
     
-    float* dist_filter = create_distance_filter();
-    float* color_filter = create_color_filter();
+    // Created once, so that the device copies can be reused by later configurations
+    static float* dist_filter = NULL;
+    static float* color_filter = NULL;
+    if(dist_filter == NULL){
+        dist_filter = create_distance_filter();
+        color_filter = create_color_filter();
+    }
     
     cl_mem dist_filter_device;
     if(config[PRECOMPUTE_DIST]){
-        dist_filter_device = clCreateBuffer(context,
-                                            CL_MEM_READ_ONLY|CL_MEM_COPY_HOST_PTR,
-                                            FILTER_HEIGHT*FILTER_WIDTH*FILTER_DEPTH*sizeof(float),
-                                            dist_filter, &error);
+        dist_filter_device = get_input_buffer(session,
+                                              CL_MEM_READ_ONLY,
+                                              FILTER_HEIGHT*FILTER_WIDTH*FILTER_DEPTH*sizeof(float),
+                                              dist_filter, &error);
     }
     cl_mem color_filter_device;
     if(config[PRECOMPUTE]){
-        color_filter_device = clCreateBuffer(context,
-                                             CL_MEM_READ_ONLY|CL_MEM_COPY_HOST_PTR,
-                                             256*sizeof(float), color_filter, &error);
+        color_filter_device = get_input_buffer(session,
+                                               CL_MEM_READ_ONLY,
+                                               256*sizeof(float), color_filter, &error);
     }
     
     clError("Error allocating memory",error);
@@ -328,41 +391,11 @@ double bilateral_ocl(unsigned char* input, unsigned char* output, cl_device_id d
     arg++;
     
     
-    cl_event event;
-    double time;
-    error = clEnqueueNDRangeKernel(queue, kernel, 3, NULL, global_work_size, local_work_size, 0, NULL, &event);
-    clError("enqueue kernel", error);
-    if(error != CL_SUCCESS){
-        clReleaseKernel(kernel);
-        clReleaseCommandQueue(queue);
-        clReleaseContext(context);
-        if(config[PRECOMPUTE_DIST]){
-            clReleaseMemObject(dist_filter_device);
-        }
-        if(config[PRECOMPUTE]){
-            clReleaseMemObject(color_filter_device);
-        }
-        clReleaseMemObject(input_device);
-        clReleaseMemObject(output_device);
-        //clWaitForEvents(1, &event);
-        //clReleaseEvent(event);
-        return -4.0;
+    double time = time_kernel(queue, kernel, 3, global_work_size, local_work_size, timing);
+    if(time >= 0 && checker != NULL && count_wrong_elements(checker, session, output_device, index(0,0,0), IMAGE_WIDTH+2*PADDING, (IMAGE_WIDTH+2*PADDING)*(IMAGE_HEIGHT+2*PADDING)) == 0){
+        *output_checked = 1;
     }
-    
-    error = clFinish(queue);
-    clError("Error waiting for kernel",error);
-    if(error != CL_SUCCESS){
-        return -1.0;
-    }
-    else{
-        cl_ulong start_time, end_time;
-        error = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start_time, NULL);
-        error = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end_time, NULL);
-        time = (double)(end_time-start_time)/1000.0;
-        clError("Error timing",error);
-        
-        
-        
+    else if(time >= 0){
         error = clEnqueueReadBuffer(queue,
                                     output_device,
                                     CL_TRUE,
@@ -374,52 +407,31 @@ double bilateral_ocl(unsigned char* input, unsigned char* output, cl_device_id d
                                     NULL);
         clError("Error reading stuff", error);
     }
-    clWaitForEvents(1, &event);
-    clReleaseEvent(event);
     
-    clReleaseMemObject(input_device);
     clReleaseMemObject(output_device);
-    if(config[PRECOMPUTE_DIST]){
-        clReleaseMemObject(dist_filter_device);
-    }
-    if(config[PRECOMPUTE]){
-        clReleaseMemObject(color_filter_device);
-    }
     clReleaseKernel(kernel);
-    clReleaseCommandQueue(queue);
-    clReleaseContext(context);
     
     return time;
 }
 
 
 
-char* timestamp(){
-    time_t ltime;
-    ltime=time(NULL);
-    char* ts = malloc(50);
-    sprintf(ts, "%s",asctime( localtime(&ltime) ) );
-    return ts;
-}
-
 int compare(unsigned char* a, unsigned char* b, int length){
     
     if(a == NULL || b == NULL){
         return 1;
     }
     
-    int n_errors = 0;
-    for(int i = 0; i < length; i++){
-        float diff = abs((int)a[i] - (int)b[i]);
-        if(diff > 3){
-            fprintf(stderr,"Error at: %d: %d %d\n", i, a[i], b[i]);
-            n_errors++;
-        }
-        if(n_errors > 10){
-            break;
-        }
+    compare_result result;
+    compare_uchar(a, b, length, 3, &result);
+    for(int k = 0; k < result.n_positions; k++){
+        int i = result.positions[k];
+        fprintf(stderr,"Error at: %d: %d %d\n", i, a[i], b[i]);
+    }
+    if(result.n_errors > 0){
+        fprintf(stderr,"%d errors in total\n", result.n_errors);
     }
-    return n_errors == 0;
+    return result.n_errors == 0;
 }
 
 void print_comment(cl_device_id device, char** argv){
@@ -434,90 +446,77 @@ void print_comment(cl_device_id device, char** argv){
     printf("# %s\n", name);
     printf("\n");
 
-    printf("# IMAGE_HEIGHT %d\n", IMAGE_HEIGHT);
-    printf("# IMAGE_WIDTH %d\n", IMAGE_WIDTH);
-    printf("# IMAGE_DEPTH %d\n", IMAGE_DEPTH);
-    printf("# PADDING %d\n", PADDING);
-    printf("# FILTER_WIDTH %d\n", FILTER_WIDTH);
-    printf("# FILTER_HEIGHT %d\n", FILTER_HEIGHT);
-    printf("# FILTER_DEPTH %d\n", FILTER_DEPTH);
+    print_problem_parameters();
+    print_device_limits(device);
+    print_reference_time();
     printf("\n");
 }
 
-void run_on_configurations(int* configurations,
-                           int n_run_configurations,
-                           int n_total_configurations,
-                           unsigned char* padded_input,
-                           unsigned char* padded_correct_output,
-                           char** argv){
-    
-    unsigned char* padded_output = (unsigned char*)malloc(sizeof(unsigned char)*(IMAGE_WIDTH+(2*PADDING))*(IMAGE_HEIGHT+(2*PADDING))*(IMAGE_DEPTH+2*PADDING));
-    unsigned char* output = (unsigned char*)calloc(sizeof(unsigned char),IMAGE_WIDTH*IMAGE_HEIGHT*IMAGE_DEPTH);
-    unsigned char* correct_output = NULL;
-    if(padded_correct_output){
-        correct_output = (unsigned char*)calloc(sizeof(unsigned char),IMAGE_WIDTH*IMAGE_HEIGHT*IMAGE_DEPTH);
-        copy_from_padded(correct_output, padded_correct_output);
+typedef struct{
+    unsigned char* padded_input;
+    unsigned char* padded_correct_output;
+    
+    unsigned char* padded_output;
+    unsigned char* output;
+    unsigned char* correct_output;
+    device_checker* checker;
+    int output_checked;
+} bilateral_data;
+
+void* bilateral_setup(bench_session* session, void* data){
+    bilateral_data* state = (bilateral_data*)malloc(sizeof(bilateral_data));
+    *state = *(bilateral_data*)data;
+    
+    state->padded_output = (unsigned char*)malloc(sizeof(unsigned char)*(IMAGE_WIDTH+(2*PADDING))*(IMAGE_HEIGHT+(2*PADDING))*(IMAGE_DEPTH+2*PADDING));
+    state->output = (unsigned char*)calloc(sizeof(unsigned char),IMAGE_WIDTH*IMAGE_HEIGHT*IMAGE_DEPTH);
+    state->correct_output = NULL;
+    if(state->padded_correct_output){
+        state->correct_output = (unsigned char*)calloc(sizeof(unsigned char),IMAGE_WIDTH*IMAGE_HEIGHT*IMAGE_DEPTH);
+        copy_from_padded(state->correct_output, state->padded_correct_output);
     }
+    state->checker = NULL;
+    if(state->correct_output && get_check_on_device()){
+        state->checker = create_device_checker(session, CHECK_UCHAR, state->correct_output, IMAGE_WIDTH, IMAGE_HEIGHT, IMAGE_DEPTH, 3);
+    }
+    return state;
+}
 
-    cl_device_id device = get_selected_device();
-
-    print_comment(device, argv);
-
-    int i = get_start_iteration();
-    int j = 0;
-    while(i < n_total_configurations && j < n_run_configurations){
-        int* temp_config = get_config_for_number(configurations[i], param_limits, n_parameters);
-      
-
-        fprintf(stderr, "%d\t", i);
-        for(int p = 0; p < n_parameters; p++){
-            fprintf(stderr, "%d ", temp_config[p]);
-        }
-        fprintf(stderr, "%s\n", timestamp());
-        
-
-
-        double time = bilateral_ocl(padded_input, padded_output, device, temp_config);
-        copy_from_padded(output, padded_output);
-
-
-        if(time > 0 && correct_output){
-            if(!compare(output, correct_output,IMAGE_HEIGHT*IMAGE_WIDTH*IMAGE_DEPTH)){
-                time = -2.0;
-            }
-        }
-
-
-        for(int p = 0; p < n_parameters; p++){
-            printf("%d ", temp_config[p]);
-        }
-        printf("%f\n", time);
-        
-        if(ignore_crashes_when_counting()){
-            j++;
-        }
-        else{
-            if(time > 0){
-                j++;
-            }
-        }
-        
-        i++;
-        free(temp_config);
+double bilateral_run(bench_session* session, int* config, kernel_timing* timing, void* state){
+    bilateral_data* d = (bilateral_data*)state;
+    d->output_checked = 0;
+    double time = bilateral_ocl(d->padded_input, d->padded_output, session, config, timing, d->checker, &d->output_checked);
+    if(!d->output_checked){
+        copy_from_padded(d->output, d->padded_output);
+    }
+    return time;
+}
 
-        if(get_use_time_threshold() && time > get_time_threshold() && j >= get_min_second_stage()){
-            break;
-        }
-        if(get_use_time_threshold() && j >= get_max_second_stage()){
-            break;
-        }
+int bilateral_verify(void* state){
+    bilateral_data* d = (bilateral_data*)state;
+    if(d->output_checked){
+        return 1;
     }
+    return compare(d->output, d->correct_output, IMAGE_HEIGHT*IMAGE_WIDTH*IMAGE_DEPTH);
+}
+
+void bilateral_teardown(void* state){
+    bilateral_data* d = (bilateral_data*)state;
+    release_device_checker(d->checker);
+    free(d->padded_output);
+    free(d->output);
+    free(d->correct_output);
+    free(d);
 }
 
 
 int main(int argc, char** argv){
     
     parse_args(argc, argv);
+    set_problem_parameters(problem_parameters, n_problem_parameters);
+    if(PADDING < FILTER_WIDTH/2 || PADDING < FILTER_HEIGHT/2 || PADDING < FILTER_DEPTH/2){
+        fprintf(stderr, "PADDING must be at least half of FILTER_WIDTH, FILTER_HEIGHT and FILTER_DEPTH, exiting\n");
+        exit(-1);
+    }
     
     unsigned char* input = create_input();
     unsigned char* padded_input = copy_to_padded(input);
@@ -531,6 +530,27 @@ int main(int argc, char** argv){
     unsigned char* padded_output_gold= NULL;
     if(get_correct_file() != NULL){
         output_gold = load_raw_buffer(get_correct_file(), IMAGE_WIDTH*IMAGE_HEIGHT*IMAGE_DEPTH);
+        if(output_gold == NULL){
+            exit(-1);
+        }
+    }
+    if(get_cpu_reference()){
+        unsigned char* reference_output = (unsigned char*)malloc(sizeof(unsigned char)*IMAGE_WIDTH*IMAGE_HEIGHT*IMAGE_DEPTH);
+        bilateral_reference reference = {padded_input, reference_output};
+        double time = time_reference(bilateral_cpu, &reference);
+        if(output_gold == NULL){
+            output_gold = reference_output;
+        }
+        if(!perform_self_test() && get_output_file() != NULL){
+            printf("CPU reference time: %f\n", time);
+            printf("Writing output to %s\n", get_output_file());
+            if(write_raw_buffer(get_output_file(), reference_output, IMAGE_WIDTH*IMAGE_HEIGHT*IMAGE_DEPTH) != 0){
+                exit(-1);
+            }
+            return 0;
+        }
+    }
+    if(output_gold != NULL){
         padded_output_gold = copy_to_padded(output_gold);
     }
     else{
@@ -539,15 +559,17 @@ int main(int argc, char** argv){
     
     int n_run_configurations;
     int n_total_configurations;
-    int* configurations = create_configurations(param_limits, n_parameters, argc, argv, &n_run_configurations, &n_total_configurations);
+    configuration_order* configurations = create_configurations(param_limits, n_parameters, argc, argv, &n_run_configurations, &n_total_configurations);
     
     
     if(perform_self_test()){
         cl_device_id device = get_selected_device();
+        bench_session* session = create_session(device);
         
         print_comment(device, argv);
         
-        double time = bilateral_ocl(padded_input, padded_output, device, global_config);
+        kernel_timing timing = {0};
+        double time = bilateral_ocl(padded_input, padded_output, session, global_config, &timing, NULL, NULL);
         copy_from_padded(output, padded_output);
         //write_ppm_uchar(output, IMAGE_WIDTH, IMAGE_HEIGHT);
         
@@ -556,17 +578,22 @@ int main(int argc, char** argv){
             printf("Self test successfull, time: %f\n", time);
         if(get_output_file() != NULL){
             printf("Writing output to %s\n", get_output_file());
-            write_raw_buffer(get_output_file(), output, IMAGE_WIDTH*IMAGE_HEIGHT*IMAGE_DEPTH);
+            if(write_raw_buffer(get_output_file(), output, IMAGE_WIDTH*IMAGE_HEIGHT*IMAGE_DEPTH) != 0){
+                exit(-1);
+            }
         }
-        
+        release_session(session);
     }
     else{
         
-        run_on_configurations(configurations,
+        bilateral_data data = {padded_input, padded_output_gold};
+        benchmark bench = {"bilateral.cl", "bilateral", "bilateral.constraints", param_limits, param_names, n_parameters, bilateral_options, print_comment, &data,
+                           bilateral_setup, bilateral_run, bilateral_verify, bilateral_teardown};
+        
+        run_on_configurations(&bench,
+                              configurations,
                               n_run_configurations,
                               n_total_configurations,
-                              padded_input,
-                              padded_output_gold,
                               argv);
     }
 }
@@ -5,9 +5,19 @@
 // developed at the Norwegian University of Science and technology
 
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "clutil.h"
 #include <CL/cl.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+static char* binary_cache_dir = NULL;
 
 const char *clErrorStr(cl_int err) {
 	switch (err) {
@@ -182,6 +192,42 @@ void list_all_devices(){
     clError("list all devices", error);
 }
 
+// Stores the devices of all platforms, in the order list_all_devices prints them, in devices.
+// Returns the number of devices.
+int get_all_devices(cl_device_id** devices){
+    cl_int error;
+    cl_uint n_platforms;
+    
+    error = clGetPlatformIDs(0, NULL, &n_platforms);
+    
+    if(n_platforms == 0){
+        fprintf(stderr, "No OpenCL platforms found\n");
+        *devices = NULL;
+        return 0;
+    }
+    
+    cl_platform_id* all_platforms = (cl_platform_id*)malloc(sizeof(cl_platform_id)*n_platforms);
+    error = clGetPlatformIDs(n_platforms, all_platforms, NULL);
+    
+    int n_total = 0;
+    *devices = NULL;
+    for(int i = 0; i < n_platforms; i++){
+        // Platforms without devices report CL_DEVICE_NOT_FOUND, which is not an error here
+        cl_uint n_devices = 0;
+        clGetDeviceIDs(all_platforms[i], CL_DEVICE_TYPE_ALL, 0, NULL, &n_devices);
+        if(n_devices == 0){
+            continue;
+        }
+        *devices = (cl_device_id*)realloc(*devices, sizeof(cl_device_id)*(n_total+n_devices));
+        error = clGetDeviceIDs(all_platforms[i], CL_DEVICE_TYPE_ALL, n_devices, *devices+n_total, NULL);
+        n_total += n_devices;
+    }
+    
+    free(all_platforms);
+    clError("get all devices", error);
+    return n_total;
+}
+
 cl_device_id get_device_by_id(int platform_index, int device_index){
     cl_int error;
     cl_uint n_platforms;
@@ -329,31 +375,218 @@ char *load_program_source(const char *s) {
 	return t;
 }
 
-cl_kernel buildKernel(char* sourceFile, char* kernelName, char* options, cl_context context, cl_device_id device, cl_int* error){
-    cl_int err;
+void set_binary_cache_dir(char* dir){
+    binary_cache_dir = dir;
+    if(dir != NULL && mkdir(dir, 0755) != 0 && errno != EEXIST){
+        fprintf(stderr, "Could not create kernel cache directory %s\n", dir);
+        binary_cache_dir = NULL;
+    }
+}
+
+// 64 bit FNV-1a
+static unsigned long long hash_string(const char* s, unsigned long long hash){
+    while(*s){
+        hash ^= (unsigned char)*s++;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// The key identifies everything the compiled binary depends on. It is stored in the
+// cache file as well, so that a hash collision is detected rather than used.
+static char* create_cache_key(const char* source, const char* kernelName, const char* options, cl_device_id device){
+    char device_name[256];
+    char driver_version[256];
+    clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(device_name), device_name, NULL);
+    clGetDeviceInfo(device, CL_DRIVER_VERSION, sizeof(driver_version), driver_version, NULL);
+    device_name[sizeof(device_name)-1] = 0;
+    driver_version[sizeof(driver_version)-1] = 0;
+    
+    unsigned long long source_hash = hash_string(source, 0xcbf29ce484222325ULL);
+    
+    size_t length = strlen(device_name) + strlen(driver_version) + strlen(kernelName) + strlen(options) + 64;
+    char* key = (char*)malloc(length);
+    sprintf(key, "%s\n%s\n%016llx\n%s\n%s", device_name, driver_version, source_hash, kernelName, options);
+    return key;
+}
+
+static char* cache_file_name(const char* key){
+    char* filename = (char*)malloc(strlen(binary_cache_dir) + 32);
+    sprintf(filename, "%s/%016llx.bin", binary_cache_dir, hash_string(key, 0xcbf29ce484222325ULL));
+    return filename;
+}
+
+// Returns 1 if the key was found, in which case binary is NULL if building failed when the entry was written
+static int load_cached_binary(const char* key, unsigned char** binary, size_t* binary_size){
+    char* filename = cache_file_name(key);
+    FILE* file = fopen(filename, "rb");
+    free(filename);
+    if(file == NULL){
+        return 0;
+    }
     
-    char* source = load_program_source(sourceFile);
-    cl_program program = clCreateProgramWithSource(context, 1, (const char **)&source, NULL, &err);
-    clError("Error creating program",err);
-    
-    err = clBuildProgram(program, 1, &device, options, NULL, NULL);
-    if(CL_SUCCESS != err) {
-        static char s[1048576];
-        size_t len;
-        //clError("Error building program", err);
-        fprintf(stderr,"Error building program\n");
-        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, sizeof(s), s, &len);
-        fprintf(stderr,"Build log:\n%s\n", s);
-        free(source);
+    size_t key_length = strlen(key);
+    size_t stored_key_length;
+    int found = 0;
+    if(fread(&stored_key_length, sizeof(size_t), 1, file) == 1 && stored_key_length == key_length){
+        char* stored_key = (char*)malloc(key_length);
+        if(fread(stored_key, 1, key_length, file) == key_length && memcmp(stored_key, key, key_length) == 0
+           && fread(binary_size, sizeof(size_t), 1, file) == 1){
+            *binary = NULL;
+            if(*binary_size == 0){
+                found = 1;
+            }
+            else{
+                *binary = (unsigned char*)malloc(*binary_size);
+                if(fread(*binary, 1, *binary_size, file) == *binary_size){
+                    found = 1;
+                }
+                else{
+                    free(*binary);
+                    *binary = NULL;
+                }
+            }
+        }
+        free(stored_key);
+    }
+    fclose(file);
+    return found;
+}
+
+// A binary size of 0 records that the program failed to build
+static void store_cached_binary(const char* key, const unsigned char* binary, size_t binary_size){
+    char* filename = cache_file_name(key);
+    char* temp_filename = (char*)malloc(strlen(filename) + 8);
+    sprintf(temp_filename, "%s.XXXXXX", filename);
+    
+    int fd = mkstemp(temp_filename);
+    FILE* file = fd == -1 ? NULL : fdopen(fd, "wb");
+    if(file == NULL){
+        if(fd != -1){
+            close(fd);
+            remove(temp_filename);
+        }
+        free(filename);
+        free(temp_filename);
+        return;
+    }
+    
+    size_t key_length = strlen(key);
+    int ok = fwrite(&key_length, sizeof(size_t), 1, file) == 1;
+    ok = ok && fwrite(key, 1, key_length, file) == key_length;
+    ok = ok && fwrite(&binary_size, sizeof(size_t), 1, file) == 1;
+    ok = ok && (binary_size == 0 || fwrite(binary, 1, binary_size, file) == binary_size);
+    ok = (fclose(file) == 0) && ok;
+    
+    // Written under a temporary name and renamed, so that readers never see a partial entry
+    if(!ok || rename(temp_filename, filename) != 0){
+        remove(temp_filename);
+    }
+    free(filename);
+    free(temp_filename);
+}
+
+static void store_program_binary(const char* key, cl_program program){
+    size_t binary_size = 0;
+    cl_int err = clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &binary_size, NULL);
+    if(err != CL_SUCCESS || binary_size == 0){
+        return;
+    }
+    
+    unsigned char* binary = (unsigned char*)malloc(binary_size);
+    err = clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(unsigned char*), &binary, NULL);
+    if(err == CL_SUCCESS){
+        store_cached_binary(key, binary, binary_size);
+    }
+    free(binary);
+}
+
+static cl_program build_from_cache(const char* key, cl_context context, cl_device_id device, const char* options, cl_int* err){
+    unsigned char* binary;
+    size_t binary_size;
+    if(!load_cached_binary(key, &binary, &binary_size)){
+        return NULL;
+    }
+    if(binary == NULL){
+        *err = CL_BUILD_PROGRAM_FAILURE;
+        return NULL;
+    }
+    
+    cl_int binary_status;
+    cl_program program = clCreateProgramWithBinary(context, 1, &device, &binary_size, (const unsigned char**)&binary, &binary_status, err);
+    free(binary);
+    if(*err != CL_SUCCESS || binary_status != CL_SUCCESS){
+        if(program != NULL){
+            clReleaseProgram(program);
+        }
+        *err = CL_SUCCESS;
+        return NULL;
+    }
+    
+    *err = clBuildProgram(program, 1, &device, options, NULL, NULL);
+    if(*err != CL_SUCCESS){
+        // Stale or incompatible binary, fall back to building from source
         clReleaseProgram(program);
-        *error = err;
+        *err = CL_SUCCESS;
         return NULL;
     }
+    return program;
+}
+
+cl_kernel buildKernel(char* sourceFile, char* kernelName, char* options, cl_context context, cl_device_id device, cl_int* error){
+    cl_int err = CL_SUCCESS;
+    
+    char* source = load_program_source(sourceFile);
+    
+    char* key = NULL;
+    cl_program program = NULL;
+    if(binary_cache_dir != NULL){
+        key = create_cache_key(source, kernelName, options, device);
+        program = build_from_cache(key, context, device, options, &err);
+        if(err != CL_SUCCESS){
+            free(key);
+            free(source);
+            *error = err;
+            return NULL;
+        }
+    }
+    
+    if(program == NULL){
+        program = clCreateProgramWithSource(context, 1, (const char **)&source, NULL, &err);
+        clError("Error creating program",err);
+        
+        err = clBuildProgram(program, 1, &device, options, NULL, NULL);
+        if(CL_SUCCESS != err) {
+            // Kernels may be built by several threads at once, so the log gets its own buffer
+            size_t len = 0;
+            //clError("Error building program", err);
+            fprintf(stderr,"Error building program\n");
+            clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &len);
+            char* s = (char*)calloc(len + 1, sizeof(char));
+            clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, len, s, NULL);
+            fprintf(stderr,"Build log:\n%s\n", s);
+            free(s);
+            if(key != NULL && err == CL_BUILD_PROGRAM_FAILURE){
+                store_cached_binary(key, NULL, 0);
+            }
+            free(key);
+            free(source);
+            clReleaseProgram(program);
+            *error = err;
+            return NULL;
+        }
+        
+        if(key != NULL){
+            store_program_binary(key, program);
+        }
+    }
     
     cl_kernel kernel = clCreateKernel(program, kernelName, &err);
     clError("Error creating kernel",err);
+    free(key);
     free(source);
     clReleaseProgram(program);
+    *error = err;
 
     return kernel;
 }
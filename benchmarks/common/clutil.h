@@ -18,6 +18,8 @@ int invalid_work_group_size(cl_device_id id, cl_kernel kernel, int dim, const si
 int invalid_work_group_size_static(cl_device_id id, int dim, const size_t* local_work_size, const size_t* global_work_size);
 cl_device_id get_device(cl_device_type device_type);
 cl_device_id get_device_by_id(int platform_index, int device_index);
+int get_all_devices(cl_device_id** devices);
+void set_binary_cache_dir(char* dir);
 cl_kernel buildKernel(char* sourceFile, char* kernelName, char* options, cl_context context, cl_device_id device, cl_int* error);
 
 #endif
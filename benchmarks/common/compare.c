@@ -0,0 +1,294 @@
+// Copyright (c) 2015, Thomas L. Falch
+// For conditions of distribution and use, see the accompanying LICENSE and README files
+
+// This file is part of the benchmarks for the AUMA machine learning based auto tuning application
+// developed at the Norwegian University of Science and technology
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "compare.h"
+
+// The comparisons are vectorized with SSE2, AVX2 or AVX-512, chosen at runtime from what the CPU supports,
+// so the benchmarks can be built without -march and still use the widest instructions available.
+// Other architectures use the scalar versions.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COMPARE_X86
+#include <immintrin.h>
+#endif
+
+enum {SCALAR, SSE2, AVX2, AVX512};
+
+static int simd_level(){
+#ifdef COMPARE_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")){
+        return AVX512;
+    }
+    if(__builtin_cpu_supports("avx2")){
+        return AVX2;
+    }
+    if(__builtin_cpu_supports("sse2")){
+        return SSE2;
+    }
+#endif
+    return SCALAR;
+}
+
+// Adds the mismatches of a block starting at start, bit i of mask being set if element start+i differs
+static void add_mismatches(compare_result* result, int start, unsigned long long mask){
+    while(mask != 0){
+        result->n_errors++;
+        if(result->n_positions < COMPARE_MAX_POSITIONS){
+            result->positions[result->n_positions++] = start + __builtin_ctzll(mask);
+        }
+        mask &= mask - 1;
+    }
+}
+
+static void add_mismatch(compare_result* result, int position){
+    add_mismatches(result, position, 1);
+}
+
+
+// Scalar versions, also used for what remains after the last full vector
+
+static int float_differs(float a, float b, float tolerance){
+    float diff = fabsf(a - b);
+    return !(diff <= tolerance*fmaxf(fabsf(a), fabsf(b)));
+}
+
+static void compare_float_scalar(float* a, float* b, int start, int length, float tolerance, compare_result* result){
+    for(int i = start; i < length; i++){
+        if(float_differs(a[i], b[i], tolerance)){
+            add_mismatch(result, i);
+        }
+    }
+}
+
+static void compare_uchar_scalar(unsigned char* a, unsigned char* b, int start, int length, int tolerance, compare_result* result){
+    for(int i = start; i < length; i++){
+        if(abs((int)a[i] - (int)b[i]) > tolerance){
+            add_mismatch(result, i);
+        }
+    }
+}
+
+static void compare_rgba_scalar(int* a, int* b, int start, int length, int tolerance, compare_result* result){
+    for(int i = start; i < length; i++){
+        unsigned int pa = (unsigned int)a[i];
+        unsigned int pb = (unsigned int)b[i];
+        for(int c = 0; c < 32; c += 8){
+            if(abs((int)((pa >> c) & 0xFF) - (int)((pb >> c) & 0xFF)) > tolerance){
+                add_mismatch(result, i);
+                break;
+            }
+        }
+    }
+}
+
+
+#ifdef COMPARE_X86
+
+// Unsigned bytes are compared as max - min, which needs no widening. A byte differs
+// if that minus the tolerance, saturated at zero, is still above zero.
+
+__attribute__((target("sse2")))
+static void compare_float_sse2(float* a, float* b, int length, float tolerance, compare_result* result){
+    __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 tol = _mm_set1_ps(tolerance);
+    int i = 0;
+    for(; i + 4 <= length; i += 4){
+        __m128 va = _mm_loadu_ps(a + i);
+        __m128 vb = _mm_loadu_ps(b + i);
+        __m128 diff = _mm_andnot_ps(sign, _mm_sub_ps(va, vb));
+        __m128 bound = _mm_mul_ps(tol, _mm_max_ps(_mm_andnot_ps(sign, va), _mm_andnot_ps(sign, vb)));
+        int mask = _mm_movemask_ps(_mm_cmpnle_ps(diff, bound));
+        if(mask){
+            add_mismatches(result, i, mask);
+        }
+    }
+    compare_float_scalar(a, b, i, length, tolerance, result);
+}
+
+__attribute__((target("sse2")))
+static void compare_uchar_sse2(unsigned char* a, unsigned char* b, int length, int tolerance, compare_result* result){
+    __m128i tol = _mm_set1_epi8((char)tolerance);
+    __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for(; i + 16 <= length; i += 16){
+        __m128i va = _mm_loadu_si128((__m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((__m128i*)(b + i));
+        __m128i diff = _mm_subs_epu8(_mm_max_epu8(va, vb), _mm_min_epu8(va, vb));
+        int mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(diff, tol), zero)) & 0xFFFF;
+        if(mask){
+            add_mismatches(result, i, mask);
+        }
+    }
+    compare_uchar_scalar(a, b, i, length, tolerance, result);
+}
+
+__attribute__((target("sse2")))
+static void compare_rgba_sse2(int* a, int* b, int length, int tolerance, compare_result* result){
+    __m128i tol = _mm_set1_epi8((char)tolerance);
+    __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for(; i + 4 <= length; i += 4){
+        __m128i va = _mm_loadu_si128((__m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((__m128i*)(b + i));
+        __m128i diff = _mm_subs_epu8(_mm_max_epu8(va, vb), _mm_min_epu8(va, vb));
+        __m128i ok = _mm_cmpeq_epi32(_mm_subs_epu8(diff, tol), zero);
+        int mask = ~_mm_movemask_ps(_mm_castsi128_ps(ok)) & 0xF;
+        if(mask){
+            add_mismatches(result, i, mask);
+        }
+    }
+    compare_rgba_scalar(a, b, i, length, tolerance, result);
+}
+
+__attribute__((target("avx2")))
+static void compare_float_avx2(float* a, float* b, int length, float tolerance, compare_result* result){
+    __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 tol = _mm256_set1_ps(tolerance);
+    int i = 0;
+    for(; i + 8 <= length; i += 8){
+        __m256 va = _mm256_loadu_ps(a + i);
+        __m256 vb = _mm256_loadu_ps(b + i);
+        __m256 diff = _mm256_andnot_ps(sign, _mm256_sub_ps(va, vb));
+        __m256 bound = _mm256_mul_ps(tol, _mm256_max_ps(_mm256_andnot_ps(sign, va), _mm256_andnot_ps(sign, vb)));
+        int mask = _mm256_movemask_ps(_mm256_cmp_ps(diff, bound, _CMP_NLE_UQ));
+        if(mask){
+            add_mismatches(result, i, mask);
+        }
+    }
+    compare_float_scalar(a, b, i, length, tolerance, result);
+}
+
+__attribute__((target("avx2")))
+static void compare_uchar_avx2(unsigned char* a, unsigned char* b, int length, int tolerance, compare_result* result){
+    __m256i tol = _mm256_set1_epi8((char)tolerance);
+    __m256i zero = _mm256_setzero_si256();
+    int i = 0;
+    for(; i + 32 <= length; i += 32){
+        __m256i va = _mm256_loadu_si256((__m256i*)(a + i));
+        __m256i vb = _mm256_loadu_si256((__m256i*)(b + i));
+        __m256i diff = _mm256_subs_epu8(_mm256_max_epu8(va, vb), _mm256_min_epu8(va, vb));
+        unsigned int mask = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_subs_epu8(diff, tol), zero));
+        if(mask){
+            add_mismatches(result, i, mask);
+        }
+    }
+    compare_uchar_scalar(a, b, i, length, tolerance, result);
+}
+
+__attribute__((target("avx2")))
+static void compare_rgba_avx2(int* a, int* b, int length, int tolerance, compare_result* result){
+    __m256i tol = _mm256_set1_epi8((char)tolerance);
+    __m256i zero = _mm256_setzero_si256();
+    int i = 0;
+    for(; i + 8 <= length; i += 8){
+        __m256i va = _mm256_loadu_si256((__m256i*)(a + i));
+        __m256i vb = _mm256_loadu_si256((__m256i*)(b + i));
+        __m256i diff = _mm256_subs_epu8(_mm256_max_epu8(va, vb), _mm256_min_epu8(va, vb));
+        __m256i ok = _mm256_cmpeq_epi32(_mm256_subs_epu8(diff, tol), zero);
+        int mask = ~_mm256_movemask_ps(_mm256_castsi256_ps(ok)) & 0xFF;
+        if(mask){
+            add_mismatches(result, i, mask);
+        }
+    }
+    compare_rgba_scalar(a, b, i, length, tolerance, result);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void compare_float_avx512(float* a, float* b, int length, float tolerance, compare_result* result){
+    __m512i abs_mask = _mm512_set1_epi32(0x7FFFFFFF);
+    __m512 tol = _mm512_set1_ps(tolerance);
+    int i = 0;
+    for(; i + 16 <= length; i += 16){
+        __m512 va = _mm512_loadu_ps(a + i);
+        __m512 vb = _mm512_loadu_ps(b + i);
+        __m512 abs_a = _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(va), abs_mask));
+        __m512 abs_b = _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(vb), abs_mask));
+        __m512 diff = _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(_mm512_sub_ps(va, vb)), abs_mask));
+        __mmask16 mask = _mm512_cmp_ps_mask(diff, _mm512_mul_ps(tol, _mm512_max_ps(abs_a, abs_b)), _CMP_NLE_UQ);
+        if(mask){
+            add_mismatches(result, i, mask);
+        }
+    }
+    compare_float_scalar(a, b, i, length, tolerance, result);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void compare_uchar_avx512(unsigned char* a, unsigned char* b, int length, int tolerance, compare_result* result){
+    __m512i tol = _mm512_set1_epi8((char)tolerance);
+    int i = 0;
+    for(; i + 64 <= length; i += 64){
+        __m512i va = _mm512_loadu_si512((void*)(a + i));
+        __m512i vb = _mm512_loadu_si512((void*)(b + i));
+        __m512i diff = _mm512_subs_epu8(_mm512_max_epu8(va, vb), _mm512_min_epu8(va, vb));
+        __m512i over = _mm512_subs_epu8(diff, tol);
+        __mmask64 mask = _mm512_test_epi8_mask(over, over);
+        if(mask){
+            add_mismatches(result, i, mask);
+        }
+    }
+    compare_uchar_scalar(a, b, i, length, tolerance, result);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void compare_rgba_avx512(int* a, int* b, int length, int tolerance, compare_result* result){
+    __m512i tol = _mm512_set1_epi8((char)tolerance);
+    int i = 0;
+    for(; i + 16 <= length; i += 16){
+        __m512i va = _mm512_loadu_si512((void*)(a + i));
+        __m512i vb = _mm512_loadu_si512((void*)(b + i));
+        __m512i diff = _mm512_subs_epu8(_mm512_max_epu8(va, vb), _mm512_min_epu8(va, vb));
+        __m512i over = _mm512_subs_epu8(diff, tol);
+        __mmask16 mask = _mm512_test_epi32_mask(over, over);
+        if(mask){
+            add_mismatches(result, i, mask);
+        }
+    }
+    compare_rgba_scalar(a, b, i, length, tolerance, result);
+}
+
+#endif
+
+
+void compare_float(float* a, float* b, int length, float tolerance, compare_result* result){
+    memset(result, 0, sizeof(compare_result));
+    switch(simd_level()){
+#ifdef COMPARE_X86
+    case AVX512: compare_float_avx512(a, b, length, tolerance, result); return;
+    case AVX2: compare_float_avx2(a, b, length, tolerance, result); return;
+    case SSE2: compare_float_sse2(a, b, length, tolerance, result); return;
+#endif
+    default: compare_float_scalar(a, b, 0, length, tolerance, result);
+    }
+}
+
+void compare_uchar(unsigned char* a, unsigned char* b, int length, int tolerance, compare_result* result){
+    memset(result, 0, sizeof(compare_result));
+    switch(simd_level()){
+#ifdef COMPARE_X86
+    case AVX512: compare_uchar_avx512(a, b, length, tolerance, result); return;
+    case AVX2: compare_uchar_avx2(a, b, length, tolerance, result); return;
+    case SSE2: compare_uchar_sse2(a, b, length, tolerance, result); return;
+#endif
+    default: compare_uchar_scalar(a, b, 0, length, tolerance, result);
+    }
+}
+
+void compare_rgba(int* a, int* b, int length, int tolerance, compare_result* result){
+    memset(result, 0, sizeof(compare_result));
+    switch(simd_level()){
+#ifdef COMPARE_X86
+    case AVX512: compare_rgba_avx512(a, b, length, tolerance, result); return;
+    case AVX2: compare_rgba_avx2(a, b, length, tolerance, result); return;
+    case SSE2: compare_rgba_sse2(a, b, length, tolerance, result); return;
+#endif
+    default: compare_rgba_scalar(a, b, 0, length, tolerance, result);
+    }
+}
@@ -0,0 +1,32 @@
+// Copyright (c) 2015, Thomas L. Falch
+// For conditions of distribution and use, see the accompanying LICENSE and README files
+
+// This file is part of the benchmarks for the AUMA machine learning based auto tuning application
+// developed at the Norwegian University of Science and technology
+
+
+#ifndef COMPARE_H
+#define COMPARE_H
+
+// Number of mismatch positions kept for reporting
+#define COMPARE_MAX_POSITIONS 10
+
+// Result of comparing an output with the correct output. Every mismatch is counted,
+// the positions of the first ones are kept in increasing order.
+typedef struct{
+    int n_errors;
+    int n_positions;
+    int positions[COMPARE_MAX_POSITIONS];
+} compare_result;
+
+// Elements differ if |a - b| > tolerance * max(|a|, |b|), or if either is NaN
+void compare_float(float* a, float* b, int length, float tolerance, compare_result* result);
+
+// Elements differ if |a - b| > tolerance, which must be from 0 to 255
+void compare_uchar(unsigned char* a, unsigned char* b, int length, int tolerance, compare_result* result);
+
+// Packed 8 bit per channel pixels differ if any channel differs by more than tolerance, which must be from 0 to 255.
+// With a tolerance of 0 this is plain equality, and can be used for any 32 bit integers.
+void compare_rgba(int* a, int* b, int length, int tolerance, compare_result* result);
+
+#endif
@@ -7,52 +7,129 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <limits.h>
 #include <math.h>
 #include <sys/time.h>
 #include <time.h>
 #include "parser.h"
+#include "configurations.h"
 
-int* create_configurations(int* limits, int n_parameters, int argc, char** argv, int* n_run_configurations, int* n_total_configurations){
+// A Feistel network permutes the numbers below 4^half_bits, the smallest power of four not less than the
+// number of configurations. Numbers outside the configurations are permuted again until they fall inside
+// them (cycle walking), which takes less than four rounds on average. The keys come from rand(), so
+// the order is the same from run to run unless seeding is used.
+static uint32_t feistel_round(uint32_t right, uint32_t key, uint32_t mask){
+    uint32_t h = right*0x9e3779b1u + key;
+    h ^= h >> 15;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    return h & mask;
+}
+
+static uint32_t feistel_encrypt(configuration_order* order, uint32_t x){
+    uint32_t mask = (1u << order->half_bits) - 1;
+    uint32_t left = x >> order->half_bits;
+    uint32_t right = x & mask;
+    for(int r = 0; r < FEISTEL_ROUNDS; r++){
+        uint32_t temp = left ^ feistel_round(right, order->keys[r], mask);
+        left = right;
+        right = temp;
+    }
+    return (left << order->half_bits) | right;
+}
+
+static uint32_t feistel_decrypt(configuration_order* order, uint32_t x){
+    uint32_t mask = (1u << order->half_bits) - 1;
+    uint32_t left = x >> order->half_bits;
+    uint32_t right = x & mask;
+    for(int r = FEISTEL_ROUNDS-1; r >= 0; r--){
+        uint32_t temp = right ^ feistel_round(left, order->keys[r], mask);
+        right = left;
+        left = temp;
+    }
+    return (left << order->half_bits) | right;
+}
+
+configuration_order* create_configurations(int* limits, int n_parameters, int argc, char** argv, int* n_run_configurations, int* n_total_configurations){
+
+    // Configuration numbers are ints, which also keeps them inside the 32 bit domain of the Feistel network
+    int64_t n_combinations = 1;
+    for(int i = 0; i < n_parameters; i++){
+        n_combinations *= limits[i];
+        if(n_combinations > INT_MAX){
+            fprintf(stderr, "The parameter space has more than %d configurations, exiting\n", INT_MAX);
+            exit(-1);
+        }
+    }
+
+    configuration_order* order = (configuration_order*)calloc(1, sizeof(configuration_order));
 
 	if(read_from_file()){
 		int n, e;
-		int* configurations = parse_file(argc, argv,&n, &e, limits, n_parameters);
+		order->list = parse_file(argc, argv,&n, &e, limits, n_parameters);
+		order->n_total = n;
 		*n_run_configurations = n;
 		*n_total_configurations = n;
-		return configurations;
+		return order;
 	}
 
-    int n_combinations = 1;
-    for(int i = 0; i < n_parameters; i++){
-        n_combinations *= limits[i];
-    }
+    order->n_total = (int)n_combinations;
 
-    int* configurations = (int*)malloc(sizeof(int)*n_combinations);
-    for(int i = 0; i < n_combinations; i++){
-        configurations[i] = i;
+    order->half_bits = 1;
+    while(((int64_t)1 << (2*order->half_bits)) < n_combinations){
+        order->half_bits++;
     }
     
     if(get_use_seeding()){
     	srand(time(NULL));
     }
 
-    for(int i = n_combinations-1; i >= 1; i--){
-        int index = rand()%i;
-        int temp = configurations[i];
-        configurations[i] = configurations[index];
-        configurations[index] = temp;
+    for(int r = 0; r < FEISTEL_ROUNDS; r++){
+        order->keys[r] = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
     }
-    *n_total_configurations = n_combinations;
+    *n_total_configurations = (int)n_combinations;
 
     int n_run_configurations_arg = get_n_run_configurations_arg();
     if(n_run_configurations_arg == 0){
-    	*n_run_configurations = n_combinations;
+    	*n_run_configurations = (int)n_combinations;
     }
     else{
     	*n_run_configurations = n_run_configurations_arg;
     }
-    return configurations;
+    return order;
+
+}
 
+int get_configuration(configuration_order* order, int i){
+    if(order->list != NULL){
+        return order->list[i];
+    }
+
+    uint32_t x = feistel_encrypt(order, i);
+    while(x >= (uint32_t)order->n_total){
+        x = feistel_encrypt(order, x);
+    }
+    return x;
+}
+
+int get_configuration_position(configuration_order* order, int config_number){
+    if(order->list != NULL){
+        for(int i = 0; i < order->n_total; i++){
+            if(order->list[i] == config_number){
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    if(config_number < 0 || config_number >= order->n_total){
+        return -1;
+    }
+    uint32_t x = feistel_decrypt(order, config_number);
+    while(x >= (uint32_t)order->n_total){
+        x = feistel_decrypt(order, x);
+    }
+    return x;
 }
 
 int* get_config_for_number(int n, int* limits, int n_parameters){
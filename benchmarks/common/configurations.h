@@ -7,7 +7,27 @@
 
 #ifndef CONFIGURATIONS_HEADER 
 #define CONFIGURATIONS_HEADER 
+#include <stdint.h>
+
+#define FEISTEL_ROUNDS 4
+
+// The order in which the configurations of a sweep are run, as configuration numbers. Either the
+// configurations read from a file, or a pseudo-random permutation of all the configurations, which is
+// computed on demand rather than stored, so that it takes no memory however large the parameter space is.
+typedef struct{
+    int* list;
+    int n_total;
+    int half_bits;
+    uint32_t keys[FEISTEL_ROUNDS];
+} configuration_order;
+
 int* get_config_for_number(int n, int* limits, int n_parameters);
-int* create_configurations(int* limits, int n_parameters, int argc, char** argv, int* n_run_permutations, int* n_total_permutations);
+configuration_order* create_configurations(int* limits, int n_parameters, int argc, char** argv, int* n_run_permutations, int* n_total_permutations);
+
+// Returns the number of the configuration at position i of the order
+int get_configuration(configuration_order* order, int i);
+
+// Returns the position of the configuration number in the order, or -1 if it is not in it
+int get_configuration_position(configuration_order* order, int config_number);
 
 #endif
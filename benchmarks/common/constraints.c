@@ -0,0 +1,514 @@
+// Copyright (c) 2015, Thomas L. Falch
+// For conditions of distribution and use, see the accompanying LICENSE and README files
+
+// This file is part of the benchmarks for the AUMA machine learning based auto tuning application
+// developed at the Norwegian University of Science and technology
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <CL/cl.h>
+
+#include "problem.h"
+#include "constraints.h"
+
+// The constraints files are read line by line. Empty lines and everything after a # are ignored,
+// the other lines are one of:
+//
+//   parameters NAME ...        The tuning parameters of the benchmark, in order. Must be the first line.
+//   table NAME value ...       A list of values, NAME[i] is value number i, counting from 0
+//   let NAME = expression      A value computed from the configuration, usable by the lines that follow
+//   require expression         A configuration is only run if the expression is not 0
+//
+// Expressions are integer expressions with the operators of C: || && == != < <= > >= << >> + - * / % ! and
+// unary -, with the same precedence, and parentheses. Names are the tuning parameters, whose values are those
+// of the configuration, the problem parameters, the limits of the device below, and the tables and lets.
+// A configuration for which an expression divides by 0, indexes a table outside its values, or shifts a negative
+// number or by a negative number or more than 62, is not run. Division rounds towards 0.
+//
+// The same format is read by the auto tuner, in constraints.py, which must be kept in sync with this file.
+
+static char* limit_names[N_DEVICE_LIMITS] = {"MAX_WORK_GROUP_SIZE", "MAX_WORK_ITEM_SIZE_0", "MAX_WORK_ITEM_SIZE_1",
+                                             "MAX_WORK_ITEM_SIZE_2", "LOCAL_MEM_SIZE", "MAX_CONSTANT_BUFFER_SIZE"};
+
+// Nothing is limited until the limits of a device are added
+static long long limits[N_DEVICE_LIMITS] = {LLONG_MAX, LLONG_MAX, LLONG_MAX, LLONG_MAX, LLONG_MAX, LLONG_MAX};
+
+#define NODE_NUMBER 0
+#define NODE_PARAMETER 1
+#define NODE_PROBLEM 2
+#define NODE_LIMIT 3
+#define NODE_LET 4
+#define NODE_TABLE 5
+#define NODE_NOT 6
+#define NODE_NEGATE 7
+#define NODE_BINARY 8
+
+// Tokens other than the single character operators, which are their character
+#define TOKEN_END -1
+#define TOKEN_NUMBER -2
+#define TOKEN_NAME -3
+#define OP_OR 256
+#define OP_AND 257
+#define OP_EQ 258
+#define OP_NE 259
+#define OP_LE 260
+#define OP_GE 261
+#define OP_SHL 262
+#define OP_SHR 263
+
+// A node of an expression tree. The trees are stored in one array, and refer to their operands by index.
+typedef struct{
+    int type;
+    int op;
+    long long value;
+    int* problem_value;
+    int left;
+    int right;
+} node;
+
+typedef struct{
+    char* name;
+    long long* values;
+    int n_values;
+} table;
+
+typedef struct{
+    char* name;
+    int root;
+} definition;
+
+static node* nodes = NULL;
+static int n_nodes = 0;
+static table* tables = NULL;
+static int n_tables = 0;
+static definition* lets = NULL;
+static int n_lets = 0;
+static int* requirements = NULL;
+static int n_requirements = 0;
+
+static char** parameter_names;
+static int n_parameter_names;
+
+// State of the parser
+static char* current_file;
+static int line_number;
+static char* cursor;
+static int token;
+static long long token_number;
+static char token_name[64];
+
+static void parse_error(char* message, char* name){
+    fprintf(stderr, "Error on line %d of %s: %s%s, exiting\n", line_number, current_file, message, name);
+    exit(-1);
+}
+
+static void next_token(){
+    static const struct{
+        char* text;
+        int op;
+    } two_character_operators[] = {{"||", OP_OR}, {"&&", OP_AND}, {"==", OP_EQ}, {"!=", OP_NE},
+                                   {"<=", OP_LE}, {">=", OP_GE}, {"<<", OP_SHL}, {">>", OP_SHR}};
+
+    while(isspace((unsigned char)*cursor)){
+        cursor++;
+    }
+    if(*cursor == '\0' || *cursor == '#'){
+        token = TOKEN_END;
+        return;
+    }
+    if(isdigit((unsigned char)*cursor)){
+        token_number = strtoll(cursor, &cursor, 10);
+        token = TOKEN_NUMBER;
+        return;
+    }
+    if(isalpha((unsigned char)*cursor) || *cursor == '_'){
+        int n = 0;
+        while(isalnum((unsigned char)*cursor) || *cursor == '_'){
+            if(n < (int)sizeof(token_name) - 1){
+                token_name[n++] = *cursor;
+            }
+            cursor++;
+        }
+        token_name[n] = '\0';
+        token = TOKEN_NAME;
+        return;
+    }
+    for(int i = 0; i < (int)(sizeof(two_character_operators)/sizeof(two_character_operators[0])); i++){
+        if(strncmp(cursor, two_character_operators[i].text, 2) == 0){
+            token = two_character_operators[i].op;
+            cursor += 2;
+            return;
+        }
+    }
+    if(strchr("+-*/%<>!()[]=", *cursor) != NULL){
+        token = *cursor++;
+        return;
+    }
+    char character[2] = {*cursor, '\0'};
+    parse_error("unexpected character ", character);
+}
+
+static void expect(int expected, char* message){
+    if(token != expected){
+        parse_error(message, "");
+    }
+    next_token();
+}
+
+static int add_node(int type, int op, long long value, int left, int right){
+    nodes = (node*)realloc(nodes, sizeof(node)*(n_nodes + 1));
+    node* n = &nodes[n_nodes];
+    n->type = type;
+    n->op = op;
+    n->value = value;
+    n->problem_value = NULL;
+    n->left = left;
+    n->right = right;
+    return n_nodes++;
+}
+
+// Returns the node for a name, or -1 if it is not defined
+static int resolve_name(char* name){
+    for(int i = 0; i < n_lets; i++){
+        if(strcmp(lets[i].name, name) == 0){
+            return add_node(NODE_LET, 0, i, -1, -1);
+        }
+    }
+    for(int i = 0; i < n_tables; i++){
+        if(strcmp(tables[i].name, name) == 0){
+            return add_node(NODE_TABLE, 0, i, -1, -1);
+        }
+    }
+    for(int i = 0; i < n_parameter_names; i++){
+        if(strcmp(parameter_names[i], name) == 0){
+            return add_node(NODE_PARAMETER, 0, i, -1, -1);
+        }
+    }
+    problem_parameter* problem;
+    int n_problem = get_problem_parameters(&problem);
+    for(int i = 0; i < n_problem; i++){
+        if(strcmp(problem[i].name, name) == 0){
+            int n = add_node(NODE_PROBLEM, 0, 0, -1, -1);
+            nodes[n].problem_value = problem[i].value;
+            return n;
+        }
+    }
+    for(int i = 0; i < N_DEVICE_LIMITS; i++){
+        if(strcmp(limit_names[i], name) == 0){
+            return add_node(NODE_LIMIT, 0, i, -1, -1);
+        }
+    }
+    return -1;
+}
+
+static int parse_expression(int level);
+
+static int parse_primary(){
+    if(token == TOKEN_NUMBER){
+        int n = add_node(NODE_NUMBER, 0, token_number, -1, -1);
+        next_token();
+        return n;
+    }
+    if(token == '('){
+        next_token();
+        int n = parse_expression(0);
+        expect(')', "expected )");
+        return n;
+    }
+    if(token == TOKEN_NAME){
+        int n = resolve_name(token_name);
+        if(n < 0){
+            parse_error("unknown name ", token_name);
+        }
+        next_token();
+        if(nodes[n].type == NODE_TABLE){
+            expect('[', "expected [ after table");
+            int index = parse_expression(0);
+            nodes[n].left = index;
+            expect(']', "expected ]");
+        }
+        return n;
+    }
+    parse_error("expected a number, a name or (", "");
+    return -1;
+}
+
+static int parse_unary(){
+    if(token == '!' || token == '-'){
+        int type = token == '!' ? NODE_NOT : NODE_NEGATE;
+        next_token();
+        int operand = parse_unary();
+        return add_node(type, 0, 0, operand, -1);
+    }
+    return parse_primary();
+}
+
+// The binary operators by precedence, from lowest to highest
+#define N_LEVELS 7
+static const int operator_levels[N_LEVELS][4] = {{OP_OR}, {OP_AND}, {OP_EQ, OP_NE}, {'<', OP_LE, '>', OP_GE},
+                                                 {OP_SHL, OP_SHR}, {'+', '-'}, {'*', '/', '%'}};
+
+static int is_operator_of_level(int level){
+    for(int i = 0; i < 4; i++){
+        if(operator_levels[level][i] != 0 && operator_levels[level][i] == token){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int parse_expression(int level){
+    if(level == N_LEVELS){
+        return parse_unary();
+    }
+    int left = parse_expression(level + 1);
+    while(is_operator_of_level(level)){
+        int op = token;
+        next_token();
+        int right = parse_expression(level + 1);
+        left = add_node(NODE_BINARY, op, 0, left, right);
+    }
+    return left;
+}
+
+static char* parse_new_name(){
+    if(token != TOKEN_NAME){
+        parse_error("expected a name", "");
+    }
+    if(resolve_name(token_name) >= 0){
+        parse_error("already defined: ", token_name);
+    }
+    char* name = strdup(token_name);
+    next_token();
+    return name;
+}
+
+static void parse_parameters(){
+    int n = 0;
+    while(token == TOKEN_NAME){
+        if(n >= n_parameter_names || strcmp(token_name, parameter_names[n]) != 0){
+            parse_error("the parameters do not match those of the benchmark at ", token_name);
+        }
+        n++;
+        next_token();
+    }
+    if(n != n_parameter_names){
+        parse_error("the parameters do not match those of the benchmark, missing ", parameter_names[n]);
+    }
+}
+
+static void parse_table(){
+    tables = (table*)realloc(tables, sizeof(table)*(n_tables + 1));
+    table* t = &tables[n_tables];
+    t->name = parse_new_name();
+    t->values = NULL;
+    t->n_values = 0;
+    while(token != TOKEN_END){
+        int sign = 1;
+        if(token == '-'){
+            sign = -1;
+            next_token();
+        }
+        if(token != TOKEN_NUMBER){
+            parse_error("expected a number", "");
+        }
+        t->values = (long long*)realloc(t->values, sizeof(long long)*(t->n_values + 1));
+        t->values[t->n_values++] = sign*token_number;
+        next_token();
+    }
+    n_tables++;
+}
+
+static void parse_let(){
+    char* name = parse_new_name();
+    expect('=', "expected =");
+    int root = parse_expression(0);
+
+    lets = (definition*)realloc(lets, sizeof(definition)*(n_lets + 1));
+    lets[n_lets].name = name;
+    lets[n_lets].root = root;
+    n_lets++;
+}
+
+static void parse_require(){
+    int root = parse_expression(0);
+    requirements = (int*)realloc(requirements, sizeof(int)*(n_requirements + 1));
+    requirements[n_requirements++] = root;
+}
+
+int load_constraints(char* filename, char** param_names, int n_parameters){
+    FILE* file = fopen(filename, "r");
+    if(file == NULL){
+        return 0;
+    }
+    parameter_names = param_names;
+    n_parameter_names = n_parameters;
+    current_file = filename;
+    line_number = 0;
+
+    int has_parameters = 0;
+    char line[1024];
+    while(fgets(line, sizeof(line), file) != NULL){
+        line_number++;
+        cursor = line;
+        next_token();
+        if(token == TOKEN_END){
+            continue;
+        }
+        if(token != TOKEN_NAME){
+            parse_error("expected parameters, table, let or require", "");
+        }
+
+        char keyword[sizeof(token_name)];
+        strcpy(keyword, token_name);
+        next_token();
+        if(!has_parameters && strcmp(keyword, "parameters") != 0){
+            parse_error("the first line must be the parameters line", "");
+        }
+        if(strcmp(keyword, "parameters") == 0){
+            parse_parameters();
+            has_parameters = 1;
+        }
+        else if(strcmp(keyword, "table") == 0){
+            parse_table();
+        }
+        else if(strcmp(keyword, "let") == 0){
+            parse_let();
+        }
+        else if(strcmp(keyword, "require") == 0){
+            parse_require();
+        }
+        else{
+            parse_error("expected parameters, table, let or require, not ", keyword);
+        }
+        expect(TOKEN_END, "unexpected text at the end of the line");
+    }
+    fclose(file);
+
+    return 1;
+}
+
+// Sets invalid if the expression divides by 0, indexes a table outside its values, or shifts a negative number or by more than 62 bits
+static long long evaluate(int index, int* config, long long* let_values, int* invalid){
+    node* n = &nodes[index];
+    switch(n->type){
+        case NODE_NUMBER:
+            return n->value;
+        case NODE_PARAMETER:
+            return config[n->value];
+        case NODE_PROBLEM:
+            return *n->problem_value;
+        case NODE_LIMIT:
+            return limits[n->value];
+        case NODE_LET:
+            return let_values[n->value];
+        case NODE_TABLE:{
+            long long i = evaluate(n->left, config, let_values, invalid);
+            if(i < 0 || i >= tables[n->value].n_values){
+                *invalid = 1;
+                return 0;
+            }
+            return tables[n->value].values[i];
+        }
+        case NODE_NOT:
+            return !evaluate(n->left, config, let_values, invalid);
+        case NODE_NEGATE:
+            return -evaluate(n->left, config, let_values, invalid);
+    }
+
+    long long a = evaluate(n->left, config, let_values, invalid);
+    // As in C, the right operand of || and && is only evaluated if it decides the result
+    if(n->op == OP_OR){
+        return a || evaluate(n->right, config, let_values, invalid);
+    }
+    if(n->op == OP_AND){
+        return a && evaluate(n->right, config, let_values, invalid);
+    }
+
+    long long b = evaluate(n->right, config, let_values, invalid);
+    switch(n->op){
+        case OP_EQ: return a == b;
+        case OP_NE: return a != b;
+        case '<': return a < b;
+        case OP_LE: return a <= b;
+        case '>': return a > b;
+        case OP_GE: return a >= b;
+        case '+': return a + b;
+        case '-': return a - b;
+        case '*': return a * b;
+    }
+    if((n->op == '/' || n->op == '%') && b == 0){
+        *invalid = 1;
+        return 0;
+    }
+    if((n->op == OP_SHL || n->op == OP_SHR) && (a < 0 || b < 0 || b > 62)){
+        *invalid = 1;
+        return 0;
+    }
+    switch(n->op){
+        case '/': return a / b;
+        case '%': return a % b;
+        case OP_SHL: return (long long)((unsigned long long)a << b);
+        case OP_SHR: return a >> b;
+    }
+    return 0;
+}
+
+int satisfies_constraints(int* config){
+    if(n_requirements == 0){
+        return 1;
+    }
+
+    // All the lets are computed first, so a let which can not be computed makes the configuration invalid even if it is not used
+    long long let_values[n_lets + 1];
+    int invalid = 0;
+    for(int i = 0; i < n_lets; i++){
+        let_values[i] = evaluate(lets[i].root, config, let_values, &invalid);
+    }
+    for(int i = 0; i < n_requirements && !invalid; i++){
+        if(!evaluate(requirements[i], config, let_values, &invalid)){
+            return 0;
+        }
+    }
+    return !invalid;
+}
+
+void query_device_limits(cl_device_id device, device_limits* device_limits){
+    size_t max_work_group_size = 0;
+    size_t max_work_item_sizes[3] = {0, 0, 0};
+    cl_ulong local_mem_size = 0;
+    cl_ulong max_constant_buffer_size = 0;
+    clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &max_work_group_size, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(max_work_item_sizes), max_work_item_sizes, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &local_mem_size, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_MAX_CONSTANT_BUFFER_SIZE, sizeof(cl_ulong), &max_constant_buffer_size, NULL);
+
+    device_limits->values[0] = max_work_group_size;
+    device_limits->values[1] = max_work_item_sizes[0];
+    device_limits->values[2] = max_work_item_sizes[1];
+    device_limits->values[3] = max_work_item_sizes[2];
+    device_limits->values[4] = local_mem_size;
+    device_limits->values[5] = max_constant_buffer_size;
+}
+
+void add_device_limits(device_limits* device_limits){
+    for(int i = 0; i < N_DEVICE_LIMITS; i++){
+        if(device_limits->values[i] < limits[i]){
+            limits[i] = device_limits->values[i];
+        }
+    }
+}
+
+void print_device_limits(cl_device_id device){
+    device_limits device_limits;
+    query_device_limits(device, &device_limits);
+    for(int i = 0; i < N_DEVICE_LIMITS; i++){
+        printf("# %s %lld\n", limit_names[i], device_limits.values[i]);
+    }
+}
@@ -0,0 +1,36 @@
+// Copyright (c) 2015, Thomas L. Falch
+// For conditions of distribution and use, see the accompanying LICENSE and README files
+
+// This file is part of the benchmarks for the AUMA machine learning based auto tuning application
+// developed at the Norwegian University of Science and technology
+
+
+#ifndef CONSTRAINTS_H
+#define CONSTRAINTS_H
+#include <CL/cl.h>
+
+// Limits of a device that constraints can refer to, in the order of the names in constraints.c
+#define N_DEVICE_LIMITS 6
+
+typedef struct{
+    long long values[N_DEVICE_LIMITS];
+} device_limits;
+
+void query_device_limits(cl_device_id device, device_limits* limits);
+
+// Makes the constraints use these limits. If called for several devices, the smallest value of each
+// limit is kept, so that the configurations which are run are valid on all of them.
+void add_device_limits(device_limits* limits);
+
+// Prints a "# NAME value" comment line for each limit of the device
+void print_device_limits(cl_device_id device);
+
+// Reads the constraints a configuration must satisfy to be run from filename, see the constraints
+// files of the benchmarks for the format. The parameters it declares must be param_names, and the
+// problem parameters must already be set. Returns 0 if the file does not exist, and exits if it is invalid.
+int load_constraints(char* filename, char** param_names, int n_parameters);
+
+// Returns 1 if the configuration satisfies all the constraints, or if none are loaded
+int satisfies_constraints(int* config);
+
+#endif
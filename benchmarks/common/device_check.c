@@ -0,0 +1,136 @@
+// Copyright (c) 2015, Thomas L. Falch
+// For conditions of distribution and use, see the accompanying LICENSE and README files
+
+// This file is part of the benchmarks for the AUMA machine learning based auto tuning application
+// developed at the Norwegian University of Science and technology
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <CL/cl.h>
+
+#include "clutil.h"
+#include "session.h"
+#include "device_check.h"
+
+// Kept here rather than in a .cl file, so that it does not have to be copied next to every benchmark.
+// The conditions are those of compare_float and compare_uchar in compare.c, a NaN counts as wrong.
+static const char* check_source =
+"__kernel void count_float(__global const float* output, int offset, int row_pitch, int slice_pitch,\n"
+"                          __global const float* correct, int width, int height, float tolerance, __global int* count){\n"
+"    int x = get_global_id(0);\n"
+"    int y = get_global_id(1);\n"
+"    int z = get_global_id(2);\n"
+"    if(x >= width || y >= height){\n"
+"        return;\n"
+"    }\n"
+"    float a = output[offset + z*slice_pitch + y*row_pitch + x];\n"
+"    float b = correct[(z*height + y)*width + x];\n"
+"    if(!(fabs(a - b) <= tolerance*fmax(fabs(a), fabs(b)))){\n"
+"        atomic_inc(count);\n"
+"    }\n"
+"}\n"
+"\n"
+"__kernel void count_uchar(__global const uchar* output, int offset, int row_pitch, int slice_pitch,\n"
+"                          __global const uchar* correct, int width, int height, float tolerance, __global int* count){\n"
+"    int x = get_global_id(0);\n"
+"    int y = get_global_id(1);\n"
+"    int z = get_global_id(2);\n"
+"    if(x >= width || y >= height){\n"
+"        return;\n"
+"    }\n"
+"    int a = output[offset + z*slice_pitch + y*row_pitch + x];\n"
+"    int b = correct[(z*height + y)*width + x];\n"
+"    if(abs(a - b) > tolerance){\n"
+"        atomic_inc(count);\n"
+"    }\n"
+"}\n";
+
+static cl_kernel build_check_kernel(bench_session* session, char* kernel_name){
+    cl_int error;
+    cl_program program = clCreateProgramWithSource(session->context, 1, &check_source, NULL, &error);
+    if(error != CL_SUCCESS){
+        return NULL;
+    }
+
+    error = clBuildProgram(program, 1, &session->device, "", NULL, NULL);
+    cl_kernel kernel = NULL;
+    if(error == CL_SUCCESS){
+        kernel = clCreateKernel(program, kernel_name, &error);
+    }
+    clReleaseProgram(program);
+
+    return error == CL_SUCCESS ? kernel : NULL;
+}
+
+device_checker* create_device_checker(bench_session* session, int type, void* correct, int width, int height, int depth, float tolerance){
+    size_t element_size = type == CHECK_FLOAT ? sizeof(float) : sizeof(unsigned char);
+
+    cl_kernel kernel = build_check_kernel(session, type == CHECK_FLOAT ? "count_float" : "count_uchar");
+    if(kernel == NULL){
+        fprintf(stderr, "Could not build the output check kernel, outputs will be checked on the host\n");
+        return NULL;
+    }
+
+    cl_int error;
+    device_checker* checker = (device_checker*)calloc(1, sizeof(device_checker));
+    checker->type = type;
+    checker->width = width;
+    checker->height = height;
+    checker->depth = depth;
+    checker->tolerance = tolerance;
+    checker->kernel = kernel;
+    checker->correct = get_input_buffer(session, CL_MEM_READ_ONLY, element_size*width*height*depth, correct, &error);
+    clError("Error uploading correct output", error);
+    checker->count = clCreateBuffer(session->context, CL_MEM_READ_WRITE, sizeof(cl_int), NULL, &error);
+    clError("Error allocating memory", error);
+
+    return checker;
+}
+
+void release_device_checker(device_checker* checker){
+    if(checker == NULL){
+        return;
+    }
+    clReleaseMemObject(checker->count);
+    clReleaseKernel(checker->kernel);
+    free(checker);
+}
+
+int count_wrong_elements(device_checker* checker, bench_session* session, cl_mem output, int offset, int row_pitch, int slice_pitch){
+    cl_int count = 0;
+    cl_int error = clEnqueueWriteBuffer(session->queue, checker->count, CL_FALSE, 0, sizeof(cl_int), &count, 0, NULL, NULL);
+    if(error != CL_SUCCESS){
+        fprintf(stderr, "Error resetting the output check count: %s\n", clErrorStr(error));
+        return -1;
+    }
+
+    // In the order of the arguments of count_float and count_uchar
+    size_t sizes[9] = {sizeof(cl_mem), sizeof(cl_int), sizeof(cl_int), sizeof(cl_int), sizeof(cl_mem),
+                       sizeof(cl_int), sizeof(cl_int), sizeof(cl_float), sizeof(cl_mem)};
+    void* values[9] = {&output, &offset, &row_pitch, &slice_pitch, &checker->correct,
+                       &checker->width, &checker->height, &checker->tolerance, &checker->count};
+    cl_kernel kernel = checker->kernel;
+    for(int i = 0; i < 9; i++){
+        error = clSetKernelArg(kernel, i, sizes[i], values[i]);
+        if(error != CL_SUCCESS){
+            fprintf(stderr, "Error setting argument %d of the output check kernel: %s\n", i, clErrorStr(error));
+            return -1;
+        }
+    }
+
+    // Rounded up, so the local size can be left to the implementation
+    size_t global_work_size[3] = {(checker->width + 15)/16*16, (checker->height + 15)/16*16, checker->depth};
+    error = clEnqueueNDRangeKernel(session->queue, kernel, 3, NULL, global_work_size, NULL, 0, NULL, NULL);
+    if(error != CL_SUCCESS){
+        fprintf(stderr, "Error running the output check kernel: %s\n", clErrorStr(error));
+        return -1;
+    }
+
+    error = clEnqueueReadBuffer(session->queue, checker->count, CL_TRUE, 0, sizeof(cl_int), &count, 0, NULL, NULL);
+    if(error != CL_SUCCESS){
+        fprintf(stderr, "Error reading the output check count: %s\n", clErrorStr(error));
+        return -1;
+    }
+    return count;
+}
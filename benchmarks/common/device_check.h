@@ -0,0 +1,39 @@
+// Copyright (c) 2015, Thomas L. Falch
+// For conditions of distribution and use, see the accompanying LICENSE and README files
+
+// This file is part of the benchmarks for the AUMA machine learning based auto tuning application
+// developed at the Norwegian University of Science and technology
+
+
+#ifndef DEVICE_CHECK_H
+#define DEVICE_CHECK_H
+#include <CL/cl.h>
+
+#include "session.h"
+
+// Element types of the outputs that can be checked, with the same tolerances as compare_float and compare_uchar
+#define CHECK_FLOAT 0
+#define CHECK_UCHAR 1
+
+// Counts the wrong elements of an output on the device, against a correct output uploaded once,
+// so that only the count has to be read back for configurations with correct output.
+typedef struct{
+    int type;
+    int width;
+    int height;
+    int depth;
+    float tolerance;
+    cl_mem correct;
+    cl_mem count;
+    cl_kernel kernel;
+} device_checker;
+
+// The correct output is width*height*depth elements without padding. Returns NULL if the check kernel can not be built.
+device_checker* create_device_checker(bench_session* session, int type, void* correct, int width, int height, int depth, float tolerance);
+void release_device_checker(device_checker* checker);
+
+// Returns the number of wrong elements in output, whose first element is at offset, with the given row and slice
+// pitches, all in elements. Returns -1 if they could not be counted.
+int count_wrong_elements(device_checker* checker, bench_session* session, cl_mem output, int offset, int row_pitch, int slice_pitch);
+
+#endif
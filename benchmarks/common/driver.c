@@ -0,0 +1,621 @@
+// Copyright (c) 2015, Thomas L. Falch
+// For conditions of distribution and use, see the accompanying LICENSE and README files
+
+// This file is part of the benchmarks for the AUMA machine learning based auto tuning application
+// developed at the Norwegian University of Science and technology
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <CL/cl.h>
+
+#include "configurations.h"
+#include "constraints.h"
+#include "parser.h"
+#include "journal.h"
+#include "results.h"
+#include "driver.h"
+
+// Largest number of consecutive configurations a device claims at a time when sweeping on several
+// devices. Its compile pipeline builds ahead within them.
+#define MAX_CHUNK_SIZE 16
+
+// State of a sweep shared by the workers of all devices, guarded by lock
+typedef struct{
+    benchmark* bench;
+    configuration_order* configurations;
+    int n_run_configurations;
+    int n_total_configurations;
+    int n_devices;
+    journal* journal;
+    results_file* results;
+    int n_combinations;
+    double* replayed_best_times;
+
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+    int next;
+    int n_counted;
+    int n_running;
+    int stop;
+} sweep;
+
+typedef struct{
+    sweep* sweep;
+    cl_device_id device;
+    int index;
+} device_worker;
+
+static void print_progress(int i, int* config, int n_parameters){
+    fprintf(stderr, "%d\t", i);
+    for(int p = 0; p < n_parameters; p++){
+        fprintf(stderr, "%d ", config[p]);
+    }
+
+    time_t ltime = time(NULL);
+    fprintf(stderr, "%s\n", asctime(localtime(&ltime)));
+}
+
+// Prints the line for a configuration, counts it and applies the stopping rules
+static void record_result(sweep* s, int* config, double time, kernel_timing* timing, int device_index, double* best_time){
+    for(int p = 0; p < s->bench->n_parameters; p++){
+        printf("%d ", config[p]);
+    }
+    if(s->n_devices > 1){
+        // The device goes last, so that readers of the single device format can ignore it
+        printf("%f %f %f %f %d %d\n", time, timing->min, timing->mean, timing->stddev, timing->n_launches, device_index);
+    }
+    else{
+        print_time(time, timing);
+    }
+    results_append(s->results, config, time, timing, device_index);
+
+    if(ignore_crashes_when_counting()){
+        s->n_counted++;
+    }
+    else{
+        if(time > 0 || time == CENSORED){
+            s->n_counted++;
+        }
+    }
+
+    if(time > 0 && (*best_time == 0.0 || time < *best_time)){
+        *best_time = time;
+    }
+
+    if(get_use_time_threshold() && comparable_time(time, timing) > get_time_threshold() && s->n_counted >= get_min_second_stage()){
+        s->stop = 1;
+    }
+    if(get_use_time_threshold() && s->n_counted >= get_max_second_stage()){
+        s->stop = 1;
+    }
+}
+
+// Prints the configurations of the sweep which are already in the journal, counting them as if they
+// had just been run, and finds the best time of each device among them
+static void replay_journal(sweep* s){
+    s->replayed_best_times = (double*)calloc(s->n_devices, sizeof(double));
+    if(s->journal == NULL){
+        return;
+    }
+
+    // The configurations which are still to be run, found in one pass over the order, as looking up the
+    // position of each entry is a linear search when the order is read from a file. Cleared once replayed.
+    char* remaining = (char*)calloc(s->n_combinations, sizeof(char));
+    for(int i = s->next; i < s->n_total_configurations; i++){
+        remaining[get_configuration(s->configurations, i)] = 1;
+    }
+
+    for(int e = 0; e < s->journal->n_entries && !s->stop && s->n_counted < s->n_run_configurations; e++){
+        journal_entry* entry = &s->journal->entries[e];
+        if(!remaining[entry->config_number]){
+            continue;
+        }
+        remaining[entry->config_number] = 0;
+
+        int device = entry->device < s->n_devices ? entry->device : 0;
+        int* config = get_config_for_number(entry->config_number, s->bench->param_limits, s->bench->n_parameters);
+        record_result(s, config, entry->time, &entry->timing, device, &s->replayed_best_times[device]);
+        free(config);
+    }
+    fflush(stdout);
+    free(remaining);
+}
+
+// Whether the configuration at position i is not to be run, as it is already in the journal or does not satisfy
+// the constraints. Also used by the compile pipeline, so that it does not build kernels for these.
+static int skip_configuration(void* data, int i){
+    sweep* s = (sweep*)data;
+    int number = get_configuration(s->configurations, i);
+    if(journal_contains(s->journal, number)){
+        return 1;
+    }
+    int* config = get_config_for_number(number, s->bench->param_limits, s->bench->n_parameters);
+    int valid = satisfies_constraints(config);
+    free(config);
+    return !valid;
+}
+
+// Moves i to the next configuration to run, claiming a new chunk of configurations when the current
+// one is used up. Configurations which are skipped are not printed. Returns 0 if there are no more.
+static int claim_configuration(sweep* s, int* i, int* chunk_end){
+    while(1){
+        if(*i == *chunk_end){
+            if(s->next >= s->n_total_configurations){
+                return 0;
+            }
+            // Short lists are split evenly, so that every device gets a share
+            int chunk_size = (s->n_total_configurations - s->next)/s->n_devices;
+            if(s->n_devices > 1 && chunk_size > MAX_CHUNK_SIZE){
+                chunk_size = MAX_CHUNK_SIZE;
+            }
+            if(chunk_size < 1){
+                chunk_size = 1;
+            }
+            *i = s->next;
+            *chunk_end = *i + chunk_size;
+            s->next = *chunk_end;
+        }
+        if(!skip_configuration(s, *i)){
+            return 1;
+        }
+        (*i)++;
+    }
+}
+
+// Whether another configuration may be started. Configurations still running may not be counted,
+// so a worker waits for them rather than running more configurations than were asked for.
+static int may_start(sweep* s){
+    while(!s->stop && s->n_running > 0 && s->n_counted + s->n_running >= s->n_run_configurations){
+        pthread_cond_wait(&s->finished, &s->lock);
+    }
+    return !s->stop && s->n_counted < s->n_run_configurations;
+}
+
+// Runs configurations on one device until the sweep is done. Each device has its own session,
+// compile pipeline and benchmark state, and its own best time for the cutoff, as devices differ in speed.
+static void* run_device(void* arg){
+    device_worker* worker = (device_worker*)arg;
+    sweep* s = worker->sweep;
+    benchmark* bench = s->bench;
+
+    bench_session* session = create_session(worker->device);
+    compile_pipeline* pipeline = NULL;
+    if(get_n_compile_threads() > 0){
+        pipeline = create_pipeline(session, bench->kernel_file, bench->kernel_name, get_n_compile_threads());
+    }
+    void* state = bench->setup(session, bench->data);
+
+    double best_time = s->replayed_best_times[worker->index];
+    int i = 0;
+    int chunk_end = 0;
+
+    pthread_mutex_lock(&s->lock);
+    while(may_start(s)){
+        if(!claim_configuration(s, &i, &chunk_end)){
+            break;
+        }
+
+        int* temp_config = get_config_for_number(get_configuration(s->configurations, i), bench->param_limits, bench->n_parameters);
+        print_progress(i, temp_config, bench->n_parameters);
+        s->n_running++;
+        pthread_mutex_unlock(&s->lock);
+
+        prefetch_configurations(pipeline, bench->get_options, skip_configuration, s, s->configurations, i, chunk_end, bench->param_limits, bench->n_parameters);
+
+        kernel_timing timing = {0};
+        timing.cutoff = get_cutoff_time(best_time);
+        double time = bench->run(session, temp_config, &timing, state);
+
+        if(time > 0 && !bench->verify(state)){
+            time = -2.0;
+        }
+
+        pthread_mutex_lock(&s->lock);
+        s->n_running--;
+        record_result(s, temp_config, time, &timing, worker->index, &best_time);
+        journal_append(s->journal, get_configuration(s->configurations, i), time, &timing, worker->index);
+
+        i++;
+        free(temp_config);
+        pthread_cond_broadcast(&s->finished);
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    bench->teardown(state);
+    release_pipeline(pipeline);
+    release_session(session);
+
+    return NULL;
+}
+
+// A configuration sent to a supervised worker process, and the result sent back
+typedef struct{
+    int index;
+    double cutoff;
+} supervised_request;
+
+typedef struct{
+    double time;
+    kernel_timing timing;
+} supervised_result;
+
+typedef struct{
+    pid_t pid;
+    int to_worker;
+    int from_worker;
+} supervised_worker;
+
+static int write_all(int fd, const void* buffer, size_t size){
+    const char* p = (const char*)buffer;
+    while(size > 0){
+        ssize_t n = write(fd, p, size);
+        if(n < 0 && errno == EINTR){
+            continue;
+        }
+        if(n <= 0){
+            return 0;
+        }
+        p += n;
+        size -= n;
+    }
+    return 1;
+}
+
+// Reads size bytes, waiting at most timeout_ms in total if it is positive. Returns 1 if they were
+// read, 0 if the other end was closed and -1 if the time ran out.
+static int read_all(int fd, void* buffer, size_t size, double timeout_ms){
+    char* p = (char*)buffer;
+    struct timeval start;
+    gettimeofday(&start, NULL);
+    while(size > 0){
+        int wait = -1;
+        if(timeout_ms > 0){
+            struct timeval now;
+            gettimeofday(&now, NULL);
+            double remaining = timeout_ms - ((now.tv_sec - start.tv_sec)*1000.0 + (now.tv_usec - start.tv_usec)/1000.0);
+            if(remaining <= 0){
+                return -1;
+            }
+            wait = (int)remaining + 1;
+        }
+
+        struct pollfd pfd = {fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, wait);
+        if(ready < 0 && errno == EINTR){
+            continue;
+        }
+        if(ready == 0){
+            continue;
+        }
+        if(ready < 0){
+            return 0;
+        }
+
+        ssize_t n = read(fd, p, size);
+        if(n < 0 && errno == EINTR){
+            continue;
+        }
+        if(n <= 0){
+            return 0;
+        }
+        p += n;
+        size -= n;
+    }
+    return 1;
+}
+
+// Body of a worker process, which runs the configurations it is sent until its input is closed.
+// OpenCL is only set up here, so that a crash or hang of the driver does not affect the supervisor.
+static void serve_configurations(sweep* s, int from_supervisor, int to_supervisor, char** argv){
+    benchmark* bench = s->bench;
+
+    cl_device_id device = get_selected_device();
+    bench_session* session = create_session(device);
+    compile_pipeline* pipeline = NULL;
+    if(get_n_compile_threads() > 0){
+        pipeline = create_pipeline(session, bench->kernel_file, bench->kernel_name, get_n_compile_threads());
+    }
+    void* state = bench->setup(session, bench->data);
+
+    if(argv != NULL){
+        bench->print_comment(device, argv);
+    }
+    fflush(stdout);
+
+    // Tells the supervisor that the worker is ready, and the limits to check the constraints with
+    device_limits limits;
+    query_device_limits(device, &limits);
+    add_device_limits(&limits);
+    write_all(to_supervisor, &limits, sizeof(limits));
+
+    supervised_request request;
+    while(read_all(from_supervisor, &request, sizeof(request), 0) == 1){
+        int* config = get_config_for_number(get_configuration(s->configurations, request.index), bench->param_limits, bench->n_parameters);
+
+        prefetch_configurations(pipeline, bench->get_options, skip_configuration, s, s->configurations, request.index, s->n_total_configurations, bench->param_limits, bench->n_parameters);
+
+        supervised_result result;
+        memset(&result, 0, sizeof(result));
+        result.timing.cutoff = request.cutoff;
+        result.time = bench->run(session, config, &result.timing, state);
+
+        if(result.time > 0 && !bench->verify(state)){
+            result.time = -2.0;
+        }
+        free(config);
+
+        fflush(stdout);
+        fflush(stderr);
+        if(!write_all(to_supervisor, &result, sizeof(result))){
+            break;
+        }
+    }
+
+    bench->teardown(state);
+    release_pipeline(pipeline);
+    release_session(session);
+}
+
+// Forks a worker process and waits until it is ready. The first worker prints the comment, and the
+// limits of its device are used for the constraints.
+static int start_worker(supervised_worker* worker, sweep* s, char** argv){
+    int requests[2];
+    int results[2];
+    if(pipe(requests) != 0){
+        return 0;
+    }
+    if(pipe(results) != 0){
+        close(requests[0]);
+        close(requests[1]);
+        return 0;
+    }
+
+    // Anything still buffered would otherwise be printed by the worker as well
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+    if(pid < 0){
+        close(requests[0]);
+        close(requests[1]);
+        close(results[0]);
+        close(results[1]);
+        return 0;
+    }
+    if(pid == 0){
+        close(requests[1]);
+        close(results[0]);
+        serve_configurations(s, requests[0], results[1], argv);
+        fflush(stdout);
+        fflush(stderr);
+        _exit(0);
+    }
+
+    close(requests[0]);
+    close(results[1]);
+    worker->pid = pid;
+    worker->to_worker = requests[1];
+    worker->from_worker = results[0];
+
+    device_limits limits;
+    if(read_all(worker->from_worker, &limits, sizeof(limits), 0) != 1){
+        close(worker->to_worker);
+        close(worker->from_worker);
+        waitpid(pid, NULL, 0);
+        worker->pid = 0;
+        return 0;
+    }
+    add_device_limits(&limits);
+    return 1;
+}
+
+static void stop_worker(supervised_worker* worker, int kill_worker){
+    if(kill_worker){
+        kill(worker->pid, SIGKILL);
+    }
+    close(worker->to_worker);
+    close(worker->from_worker);
+    waitpid(worker->pid, NULL, 0);
+    worker->pid = 0;
+}
+
+// Runs the configurations one at a time in a worker process, which is killed if a configuration
+// takes longer than the timeout. Configurations whose worker crashed or was killed are reported
+// as CRASHED or TIMED_OUT, and a new worker is started for the next configuration.
+static void run_supervised(sweep* s, char** argv){
+    benchmark* bench = s->bench;
+    double timeout_ms = get_supervisor_timeout()*1000.0;
+
+    // A worker that dies while being sent a configuration is detected when reading its result
+    signal(SIGPIPE, SIG_IGN);
+
+    // The first worker prints the comment, which must come before the lines from the journal
+    supervised_worker worker = {0, -1, -1};
+    if(!start_worker(&worker, s, argv)){
+        fprintf(stderr, "Could not start worker process, exiting\n");
+        return;
+    }
+    replay_journal(s);
+
+    double best_time = s->replayed_best_times[0];
+    int i = s->next;
+    while(i < s->n_total_configurations && s->n_counted < s->n_run_configurations && !s->stop){
+        if(skip_configuration(s, i)){
+            i++;
+            continue;
+        }
+        if(worker.pid == 0){
+            if(!start_worker(&worker, s, NULL)){
+                fprintf(stderr, "Could not start worker process, exiting\n");
+                break;
+            }
+        }
+
+        int* temp_config = get_config_for_number(get_configuration(s->configurations, i), bench->param_limits, bench->n_parameters);
+        print_progress(i, temp_config, bench->n_parameters);
+
+        supervised_request request = {i, get_cutoff_time(best_time)};
+        supervised_result result;
+        int status = 0;
+        if(write_all(worker.to_worker, &request, sizeof(request))){
+            status = read_all(worker.from_worker, &result, sizeof(result), timeout_ms);
+        }
+
+        double time;
+        kernel_timing timing = {0};
+        if(status == 1){
+            time = result.time;
+            timing = result.timing;
+        }
+        else{
+            time = status == -1 ? TIMED_OUT : CRASHED;
+            stop_worker(&worker, 1);
+        }
+
+        record_result(s, temp_config, time, &timing, 0, &best_time);
+        journal_append(s->journal, get_configuration(s->configurations, i), time, &timing, 0);
+        fflush(stdout);
+
+        i++;
+        free(temp_config);
+    }
+
+    if(worker.pid != 0){
+        stop_worker(&worker, 0);
+    }
+}
+
+// Runs the sweep with a worker thread for each selected device, or in this thread if there is one
+static void run_on_devices(sweep* s, char** argv){
+    cl_device_id* devices;
+    int n_devices = get_selected_devices(&devices);
+    if(n_devices <= 0){
+        fprintf(stderr, "No OpenCL devices selected\n");
+        return;
+    }
+
+    for(int d = 0; d < n_devices; d++){
+        device_limits limits;
+        query_device_limits(devices[d], &limits);
+        add_device_limits(&limits);
+    }
+
+    s->bench->print_comment(devices[0], argv);
+
+    s->n_devices = n_devices;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->finished, NULL);
+
+    device_worker* workers = (device_worker*)malloc(sizeof(device_worker)*n_devices);
+    for(int d = 0; d < n_devices; d++){
+        workers[d].sweep = s;
+        workers[d].device = devices[d];
+        workers[d].index = d;
+    }
+
+    if(n_devices == 1){
+        replay_journal(s);
+        run_device(&workers[0]);
+    }
+    else{
+        for(int d = 0; d < n_devices; d++){
+            char name[100];
+            clGetDeviceInfo(devices[d], CL_DEVICE_NAME, 100, name, NULL);
+            printf("# DEVICE %d %s\n", d, name);
+        }
+        printf("\n");
+        replay_journal(s);
+
+        pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t)*n_devices);
+        for(int d = 0; d < n_devices; d++){
+            pthread_create(&threads[d], NULL, run_device, &workers[d]);
+        }
+        for(int d = 0; d < n_devices; d++){
+            pthread_join(threads[d], NULL);
+        }
+        free(threads);
+    }
+
+    pthread_cond_destroy(&s->finished);
+    pthread_mutex_destroy(&s->lock);
+    free(workers);
+    free(devices);
+}
+
+// Runs the benchmark on the configurations from get_start_iteration(), printing a line with the
+// parameters and time of each, until n_run_configurations have been counted or the second stage
+// time threshold is exceeded.
+//
+// If several devices are selected, each gets a worker thread, and the workers take consecutive
+// chunks of the configurations in turn. The lines are then printed in the order the configurations
+// finish, with the index of the device as an extra last column.
+//
+// With a supervisor timeout (-x), the configurations are instead run in a separate process, see run_supervised.
+//
+// With a journal (-j), each finished configuration is also appended to the journal. The configurations
+// already in it are printed and counted first, without running them again.
+//
+// Configurations which do not satisfy the constraints of the benchmark are skipped without being printed.
+void run_on_configurations(benchmark* bench,
+                           configuration_order* configurations,
+                           int n_run_configurations,
+                           int n_total_configurations,
+                           char** argv){
+
+    sweep s;
+    s.bench = bench;
+    s.configurations = configurations;
+    s.n_run_configurations = n_run_configurations;
+    s.n_total_configurations = n_total_configurations;
+    s.next = get_start_iteration();
+    s.n_counted = 0;
+    s.n_running = 0;
+    s.stop = 0;
+    s.replayed_best_times = NULL;
+
+    s.n_combinations = 1;
+    for(int p = 0; p < bench->n_parameters; p++){
+        s.n_combinations *= bench->param_limits[p];
+    }
+    s.journal = NULL;
+    if(get_journal_file() != NULL){
+        s.journal = open_journal(get_journal_file(), s.n_combinations);
+    }
+    if(!load_constraints(bench->constraints_file, bench->param_names, bench->n_parameters)){
+        printf("#Warning: No constraints file %s found, configurations will not be checked before they are run\n", bench->constraints_file);
+    }
+    s.results = NULL;
+    if(get_results_file() != NULL){
+        s.results = create_results(get_results_file(), bench->n_parameters, bench->param_limits, bench->param_names);
+        if(s.results == NULL){
+            exit(-1);
+        }
+    }
+
+    // The supervisor must not set up OpenCL itself, that is left to the worker processes
+    if(get_supervisor_timeout() > 0){
+        s.n_devices = 1;
+        run_supervised(&s, argv);
+    }
+    else{
+        run_on_devices(&s, argv);
+    }
+
+    write_results(s.results);
+    release_results(s.results);
+    close_journal(s.journal);
+    free(s.replayed_best_times);
+}
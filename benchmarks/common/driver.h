@@ -0,0 +1,55 @@
+// Copyright (c) 2015, Thomas L. Falch
+// For conditions of distribution and use, see the accompanying LICENSE and README files
+
+// This file is part of the benchmarks for the AUMA machine learning based auto tuning application
+// developed at the Norwegian University of Science and technology
+
+
+#ifndef DRIVER_H
+#define DRIVER_H
+#include <CL/cl.h>
+
+#include "configurations.h"
+#include "session.h"
+#include "pipeline.h"
+#include "timing.h"
+
+// Returned instead of the time for configurations whose worker process crashed or was killed after the timeout
+#define CRASHED -6.0
+#define TIMED_OUT -7.0
+
+// Describes a benchmark to the driver, which runs it on a list of configurations
+typedef struct{
+    char* kernel_file;
+    char* kernel_name;
+    // Configurations which do not satisfy the constraints in this file are skipped, see constraints.c
+    char* constraints_file;
+    int* param_limits;
+    char** param_names;
+    int n_parameters;
+    kernel_options_function get_options;
+
+    void (*print_comment)(cl_device_id device, char** argv);
+
+    // Host data shared by all configurations, passed to setup
+    void* data;
+
+    // Returns the state passed to the other callbacks, typically the data and buffers for the output
+    void* (*setup)(bench_session* session, void* data);
+
+    // Builds and times a configuration, returning the time or an error code like the *_ocl functions
+    double (*run)(bench_session* session, int* config, kernel_timing* timing, void* state);
+
+    // Returns 0 if the output of the last run is wrong, 1 if it is correct or there is nothing to compare with
+    int (*verify)(void* state);
+
+    void (*teardown)(void* state);
+} benchmark;
+
+void run_on_configurations(benchmark* bench,
+                           configuration_order* configurations,
+                           int n_run_configurations,
+                           int n_total_configurations,
+                           char** argv);
+
+#endif
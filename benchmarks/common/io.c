@@ -5,82 +5,82 @@
 // developed at the Norwegian University of Science and technology
 
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
-
-int* load_correct(char* filename, int width, int height){
-    int* correct = (int*)malloc(sizeof(int)*width*height);
-    
-    FILE* file;
-    file = fopen(filename, "rb");
-    if(!file){
-        fprintf(stderr,"did not find file\n");
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "io.h"
+
+// Maps the first size bytes of the file into memory, read only. The pages are read from the file
+// (or the page cache) when first used, nothing is copied. Returns NULL if the file could not be
+// opened or is too short.
+static void* map_file(char* filename, size_t size){
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0){
+        fprintf(stderr, "Could not open %s\n", filename);
+        return NULL;
     }
-    for(int i = 0; i < width*height; i++){
-        fread(&correct[i], sizeof(int), 1, file);
+    
+    struct stat info;
+    if(fstat(fd, &info) != 0 || (size_t)info.st_size < size){
+        fprintf(stderr, "%s is too short, expected %zu bytes\n", filename, size);
+        close(fd);
+        return NULL;
     }
-    fclose(file);
     
-    return correct;
+    void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED){
+        fprintf(stderr, "Could not map %s\n", filename);
+        return NULL;
+    }
+    return data;
 }
 
-void write_image_raw(char* filename, int* image, int width, int height){
-    FILE* file;
-    file = fopen(filename, "wb");
-    for(int i = 0; i < width*height; i++){
-        fwrite(&image[i], sizeof(int), 1, file);
+// Writes size bytes in one call. Returns 0, or -1 if the file could not be written.
+static int write_file(char* filename, const void* data, size_t size){
+    FILE* file = fopen(filename, "wb");
+    if(file == NULL){
+        fprintf(stderr, "Could not open %s\n", filename);
+        return -1;
     }
-    fclose(file);
+    
+    size_t written = fwrite(data, 1, size, file);
+    if(fclose(file) != 0 || written != size){
+        fprintf(stderr, "Could not write %s\n", filename);
+        return -1;
+    }
+    return 0;
 }
 
-float* load_correct_float(char* filename, int width, int height){
-    float* correct = (float*)malloc(sizeof(float)*width*height);
+int* load_correct(char* filename, int width, int height){
+    return (int*)map_file(filename, sizeof(int)*width*height);
+}
 
-    FILE* file;
-    file = fopen(filename, "rb");
-    if(!file){
-        fprintf(stderr,"did not find file\n");
-    }
-    for(int i = 0; i < width*height; i++){
-        fread(&correct[i], sizeof(float), 1, file);
-    }
-    fclose(file);
+int write_image_raw(char* filename, int* image, int width, int height){
+    return write_file(filename, image, sizeof(int)*width*height);
+}
 
-    return correct;
+float* load_correct_float(char* filename, int width, int height){
+    return (float*)map_file(filename, sizeof(float)*width*height);
 }
 
-void write_image_raw_float(char* filename, float* image, int width, int height){
-    FILE* file;
-    file = fopen(filename, "wb");
-    for(int i = 0; i < width*height; i++){
-        fwrite(&image[i], sizeof(float), 1, file);
-    }
-    fclose(file);
+int write_image_raw_float(char* filename, float* image, int width, int height){
+    return write_file(filename, image, sizeof(float)*width*height);
 }
 
-void write_raw_buffer(char* filename, unsigned char* buffer, int length){
-    FILE* file;
-    file = fopen(filename, "wb");
-    for(int i = 0; i < length; i++){
-        fwrite(&buffer[i], sizeof(unsigned char), 1, file);
-    }
-    fclose(file);
+int write_raw_buffer(char* filename, unsigned char* buffer, int length){
+    return write_file(filename, buffer, sizeof(unsigned char)*length);
 }
 
 unsigned char* load_raw_buffer(char* filename, int size){
-    unsigned char* correct = (unsigned char*)malloc(sizeof(unsigned char)*size);
-    
-    FILE* file;
-    file = fopen(filename, "rb");
-    if(!file){
-        fprintf(stderr,"did not find file\n");
-    }
-    for(int i = 0; i < size; i++){
-        fread(&correct[i], sizeof(unsigned char), 1, file);
-    }
-    fclose(file);
-    
-    return correct;
+    return (unsigned char*)map_file(filename, sizeof(unsigned char)*size);
 }
 
 void write_ppm(int* image, int width, int height){
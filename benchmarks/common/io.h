@@ -8,9 +8,11 @@
 #ifndef IO
 #define IO
 
-void write_image_raw_float(char* filename, float* image, int width, int height);
+// The load functions return a read only view of the file, which must not be written to or freed.
+// They return NULL if the file could not be read, and the write functions return -1.
+int write_image_raw_float(char* filename, float* image, int width, int height);
 float* load_correct_float(char* filename, int width, int height);
-void write_image_raw(char* filename, int* image, int width, int height);
+int write_image_raw(char* filename, int* image, int width, int height);
 int* load_correct(char* filename, int width, int height);
 void write_ppm(int* image, int width, int height);
 void write_ppm_bw(int* image, int width, int height);
@@ -18,6 +20,6 @@ void write_ppm_uchar(unsigned char* image, int width, int height);
 void write_ppm_crossection_uchar(unsigned char* volume, int width, int height, int depth);
 int* load_ppm(const char* filename, int* width, int* height);
 unsigned char* load_raw_buffer(char* filename, int size);
-void write_raw_buffer(char* filename, unsigned char* buffer, int length);
+int write_raw_buffer(char* filename, unsigned char* buffer, int length);
 
 #endif
@@ -0,0 +1,138 @@
+// Copyright (c) 2015, Thomas L. Falch
+// For conditions of distribution and use, see the accompanying LICENSE and README files
+
+// This file is part of the benchmarks for the AUMA machine learning based auto tuning application
+// developed at the Norwegian University of Science and technology
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#include "journal.h"
+
+// The journal is synced to disk after this many entries or seconds, whichever comes first,
+// so at most this much is lost if the node goes down
+#define SYNC_ENTRIES 64
+#define SYNC_SECONDS 5
+
+// Each entry is a line with the configuration number, the time and its statistics, and the device
+static int parse_entry(char* line, journal_entry* entry){
+    int length = strlen(line);
+    if(length == 0 || line[length-1] != '\n'){
+        return 0;
+    }
+    memset(entry, 0, sizeof(journal_entry));
+    return sscanf(line, "%d %lf %lf %lf %lf %d %d",
+                  &entry->config_number,
+                  &entry->time,
+                  &entry->timing.min,
+                  &entry->timing.mean,
+                  &entry->timing.stddev,
+                  &entry->timing.n_launches,
+                  &entry->device) == 7;
+}
+
+// Reads the entries of an existing journal. A last line cut short by a crash is truncated away,
+// so that new entries are not appended to it.
+static void read_entries(journal* j, char* filename){
+    FILE* file = fopen(filename, "r");
+    if(file == NULL){
+        return;
+    }
+
+    int max_entries = 0;
+    long valid_length = 0;
+    char line[256];
+    journal_entry entry;
+    while(fgets(line, sizeof(line), file) != NULL){
+        if(!parse_entry(line, &entry)){
+            if(line[strlen(line)-1] == '\n' || fgetc(file) != EOF){
+                fprintf(stderr, "%s is not a journal, exiting\n", filename);
+                exit(-1);
+            }
+            break;
+        }
+        valid_length = ftell(file);
+        if(entry.config_number < 0 || entry.config_number >= j->n_combinations){
+            continue;
+        }
+
+        if(j->n_entries == max_entries){
+            max_entries = max_entries == 0 ? 1024 : 2*max_entries;
+            j->entries = (journal_entry*)realloc(j->entries, sizeof(journal_entry)*max_entries);
+        }
+        j->entries[j->n_entries++] = entry;
+        j->recorded[entry.config_number] = 1;
+    }
+    long length = ftell(file);
+    fclose(file);
+
+    if(length > valid_length && truncate(filename, valid_length) != 0){
+        fprintf(stderr, "Could not truncate journal %s\n", filename);
+    }
+}
+
+// Opens the journal, reading the configurations already recorded in it if it exists.
+// Configuration numbers must be less than n_combinations.
+journal* open_journal(char* filename, int n_combinations){
+    journal* j = (journal*)calloc(1, sizeof(journal));
+    j->n_combinations = n_combinations;
+    j->recorded = (char*)calloc(n_combinations, sizeof(char));
+
+    read_entries(j, filename);
+
+    j->file = fopen(filename, "a");
+    if(j->file == NULL){
+        fprintf(stderr, "Could not open journal %s, exiting\n", filename);
+        exit(-1);
+    }
+    gettimeofday(&j->last_sync, NULL);
+
+    return j;
+}
+
+static void sync_journal(journal* j){
+    fflush(j->file);
+    fsync(fileno(j->file));
+    j->n_unsynced = 0;
+    gettimeofday(&j->last_sync, NULL);
+}
+
+void close_journal(journal* j){
+    if(j == NULL){
+        return;
+    }
+    sync_journal(j);
+    fclose(j->file);
+    free(j->entries);
+    free(j->recorded);
+    free(j);
+}
+
+// The compile pipeline checks recorded without the sweep lock while other device threads append,
+// so it is read and written atomically
+int journal_contains(journal* j, int config_number){
+    return j != NULL && __atomic_load_n(&j->recorded[config_number], __ATOMIC_RELAXED);
+}
+
+void journal_append(journal* j, int config_number, double time, kernel_timing* timing, int device){
+    if(j == NULL){
+        return;
+    }
+
+    fprintf(j->file, "%d %f %f %f %f %d %d\n", config_number, time, timing->min, timing->mean, timing->stddev, timing->n_launches, device);
+    __atomic_store_n(&j->recorded[config_number], 1, __ATOMIC_RELAXED);
+    j->n_unsynced++;
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    if(j->n_unsynced >= SYNC_ENTRIES || now.tv_sec - j->last_sync.tv_sec >= SYNC_SECONDS){
+        sync_journal(j);
+    }
+}
@@ -0,0 +1,39 @@
+// Copyright (c) 2015, Thomas L. Falch
+// For conditions of distribution and use, see the accompanying LICENSE and README files
+
+// This file is part of the benchmarks for the AUMA machine learning based auto tuning application
+// developed at the Norwegian University of Science and technology
+
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+#include <stdio.h>
+#include <sys/time.h>
+
+#include "timing.h"
+
+// A finished configuration, identified by its number rather than its position in the sweep
+typedef struct{
+    int config_number;
+    double time;
+    kernel_timing timing;
+    int device;
+} journal_entry;
+
+// Append only record of the finished configurations of a sweep, so that it can be resumed
+typedef struct{
+    FILE* file;
+    journal_entry* entries;
+    int n_entries;
+    char* recorded;
+    int n_combinations;
+    int n_unsynced;
+    struct timeval last_sync;
+} journal;
+
+journal* open_journal(char* filename, int n_combinations);
+void close_journal(journal* j);
+int journal_contains(journal* j, int config_number);
+void journal_append(journal* j, int config_number, double time, kernel_timing* timing, int device);
+
+#endif
@@ -7,11 +7,16 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <ctype.h>
 #include <getopt.h>
 
 #include "clutil.h"
+#include "timing.h"
+#include "problem.h"
+
+#define MAX_DEVICES 16
 
 static int permutation_start = 0;
 static char* filename = NULL;
@@ -20,9 +25,16 @@ static int use_seeding = 0;
 static int ignore_crashes = 0;
 static int self_test = 0;
 static char* correct_file = NULL;
+static int check_on_device = 0;
+static int cpu_reference = 0;
 static char* output_file = NULL;
-static char* device = NULL;
+static char* devices[MAX_DEVICES];
+static int n_devices = 0;
 static int use_time_threshold = 0;
+static int n_compile_threads = 0;
+static double supervisor_timeout = 0.0;
+static char* journal_file = NULL;
+static char* results_file = NULL;
 
 //These could be moved
 static float time_threshold = 0.0;
@@ -40,9 +52,22 @@ static const char* help =
 -m              Ignore crashes when counting \n \
 -t              Self test \n \
 -c <file>       Correct file \n \
+-v              Check the output against the correct file on the device, and only read it back if it is wrong \n \
 -w <file>       Output file \n \
+-q              Compute the correct output on the CPU, unless given with -c, and report the CPU time. With -w and without -t, write it to the output file \n \
 -l              List all available OpenCL devices and exit \n \
--d <arg>        Select OpenCL device \n \
+-d <arg>        Select OpenCL device, repeat or use all to sweep on several devices at once \n \
+-b <dir>        Cache compiled kernels in this directory \n \
+-p <arg>        Compile upcoming kernels with this many threads \n \
+-u <arg>        Untimed warmup launches of each kernel \n \
+-k <arg>        Timed launches of each kernel \n \
+-e <arg>        Add launches until the 95% confidence interval is within this fraction of the mean \n \
+-g <arg>        Time budget in ms for adding launches \n \
+-a <arg>        Abort configurations slower than arg times the best so far \n \
+-x <arg>        Run configurations in a worker process, killed after arg seconds \n \
+-j <file>       Record finished configurations in a journal, and skip those already in it \n \
+-o <file>       Also write the results to a binary file \n \
+-D <arg>        Set a problem parameter, given as NAME=VALUE, or read them from a file \n \
 \n";
 
 void print_help(int argc, char** argv){
@@ -53,7 +78,7 @@ void print_help(int argc, char** argv){
 void parse_args(int argc, char** argv){
     
     int c;
-    while( (c = getopt(argc, argv, "htc:i:f:n:w:smld:r")) != -1){
+    while( (c = getopt(argc, argv, "htc:vqi:f:n:w:smld:rb:p:u:k:e:g:a:x:j:o:D:")) != -1){
         switch (c) {
             case 'h':
                 print_help(argc, argv);
@@ -79,6 +104,12 @@ void parse_args(int argc, char** argv){
             case 'c':
                 correct_file = optarg;
                 break;
+            case 'v':
+                check_on_device = 1;
+                break;
+            case 'q':
+                cpu_reference = 1;
+                break;
             case 'w':
                 output_file = optarg;
                 break;
@@ -87,18 +118,60 @@ void parse_args(int argc, char** argv){
                 exit(1);
                 break;
             case 'd':
-                device = optarg;
+                if(n_devices == MAX_DEVICES){
+                    printf("At most %d devices can be given with -d.\nExiting\n", MAX_DEVICES);
+                    exit(-1);
+                }
+                devices[n_devices++] = optarg;
                 break;
             case 'r':
                 use_time_threshold = 1;
                 break;
+            case 'b':
+                set_binary_cache_dir(optarg);
+                break;
+            case 'p':
+                n_compile_threads = atoi(optarg);
+                break;
+            case 'u':
+                set_warmup_launches(atoi(optarg));
+                break;
+            case 'k':
+                set_timed_launches(atoi(optarg));
+                break;
+            case 'e':
+                set_target_ci_width(atof(optarg));
+                break;
+            case 'g':
+                set_time_budget(atof(optarg));
+                break;
+            case 'a':
+                set_abort_factor(atof(optarg));
+                break;
+            case 'x':
+                supervisor_timeout = atof(optarg);
+                break;
+            case 'j':
+                journal_file = optarg;
+                break;
+            case 'o':
+                results_file = optarg;
+                break;
+            case 'D':
+                add_problem_settings(optarg);
+                break;
             default:
                 break;
         }
     }
     
+    if(supervisor_timeout > 0 && (n_devices > 1 || (n_devices == 1 && strcmp(devices[0], "all") == 0))){
+        printf("-x can not be used with several devices.\nExiting\n");
+        exit(-1);
+    }
+    
     //TODO remove this
-    if(filename == NULL && n_iterations == 0 && self_test == 0){
+    if(filename == NULL && n_iterations == 0 && self_test == 0 && !(cpu_reference && output_file != NULL)){
         printf("No iterations or inputfile specified.\nExiting\n");
         exit(-1);
     }
@@ -121,6 +194,22 @@ int get_use_time_threshold(){
     return use_time_threshold;
 }
 
+int get_n_compile_threads(){
+    return n_compile_threads;
+}
+
+double get_supervisor_timeout(){
+    return supervisor_timeout;
+}
+
+char* get_journal_file(){
+    return journal_file;
+}
+
+char* get_results_file(){
+    return results_file;
+}
+
 char* get_output_file(){
     return output_file;
 }
@@ -129,6 +218,14 @@ char* get_correct_file(){
     return correct_file;
 }
 
+int get_check_on_device(){
+    return check_on_device;
+}
+
+int get_cpu_reference(){
+    return cpu_reference;
+}
+
 int perform_self_test(){
     return self_test;
 }
@@ -157,10 +254,7 @@ int parse_num(int argc, char** argv){
     return atoi(argv[2]);
 }
 
-cl_device_id get_selected_device(){
-    if(device == NULL){
-        return get_device_by_id(0,0);
-    }
+static cl_device_id parse_device(char* device){
     if(device[0] == 'g' || device[0] == 'G'){
         return get_device(CL_DEVICE_TYPE_GPU);
     }
@@ -171,6 +265,35 @@ cl_device_id get_selected_device(){
     return get_device_by_id(device[0]-48, device[2]-48);
 }
 
+cl_device_id get_selected_device(){
+    if(n_devices == 0){
+        return get_device_by_id(0,0);
+    }
+    return parse_device(devices[0]);
+}
+
+// Stores the devices given with -d in selected, where "all" selects every device of every platform.
+// Returns the number of devices, which is 1 unless several were selected.
+int get_selected_devices(cl_device_id** selected){
+    for(int i = 0; i < n_devices; i++){
+        if(strcmp(devices[i], "all") == 0){
+            return get_all_devices(selected);
+        }
+    }
+    
+    if(n_devices <= 1){
+        *selected = (cl_device_id*)malloc(sizeof(cl_device_id));
+        (*selected)[0] = get_selected_device();
+        return 1;
+    }
+    
+    *selected = (cl_device_id*)malloc(sizeof(cl_device_id)*n_devices);
+    for(int i = 0; i < n_devices; i++){
+        (*selected)[i] = parse_device(devices[i]);
+    }
+    return n_devices;
+}
+
 int* parse_file(int argc, char** argv, int* n, int* e, int* limits, int n_parameters){
 
 	int* cumulutative = (int*)malloc(sizeof(int)* n_parameters);
@@ -19,12 +19,19 @@ int get_use_seeding();
 int ignore_crashes_when_counting();
 int parse_num(int argc, char** argv);
 char* get_correct_file();
+int get_check_on_device();
+int get_cpu_reference();
 char* get_output_file();
 int* parse_file(int argc, char** argv, int* n, int* e, int* limits, int n_parameters);
 cl_device_id get_selected_device();
+int get_selected_devices(cl_device_id** selected);
 float get_time_threshold();
 int get_min_second_stage();
 int get_max_second_stage();
 int get_use_time_threshold();
+int get_n_compile_threads();
+double get_supervisor_timeout();
+char* get_journal_file();
+char* get_results_file();
         
 #endif
@@ -0,0 +1,244 @@
+// Copyright (c) 2015, Thomas L. Falch
+// For conditions of distribution and use, see the accompanying LICENSE and README files
+
+// This file is part of the benchmarks for the AUMA machine learning based auto tuning application
+// developed at the Norwegian University of Science and technology
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <CL/cl.h>
+
+#include "clutil.h"
+#include "configurations.h"
+#include "pipeline.h"
+
+#define JOB_FREE        0
+#define JOB_QUEUED      1
+#define JOB_BUILDING    2
+#define JOB_DONE        3
+
+typedef struct{
+    char options[MAX_OPTIONS_LENGTH];
+    int state;
+    int index;
+    cl_kernel kernel;
+    cl_int error;
+} compile_job;
+
+// Kernels for upcoming configurations are built by a pool of worker threads.
+// The number of jobs which are queued, being built or built but not yet used
+// is bounded by the number of job slots.
+struct compile_pipeline{
+    bench_session* session;
+    char* source_file;
+    char* kernel_name;
+    
+    compile_job* jobs;
+    int n_jobs;
+    int next_prefetch;
+    
+    pthread_t* threads;
+    int n_threads;
+    int shutdown;
+    pthread_mutex_t lock;
+    pthread_cond_t job_queued;
+    pthread_cond_t job_done;
+};
+
+// Finds the job for the earliest configuration with the given state, or in any state if JOB_FREE is given
+static compile_job* oldest_job(compile_pipeline* pipeline, int state, char* options){
+    compile_job* oldest = NULL;
+    for(int i = 0; i < pipeline->n_jobs; i++){
+        compile_job* job = &pipeline->jobs[i];
+        if(job->state == JOB_FREE || (state != JOB_FREE && job->state != state)){
+            continue;
+        }
+        if(options != NULL && strcmp(job->options, options) != 0){
+            continue;
+        }
+        if(oldest == NULL || job->index < oldest->index){
+            oldest = job;
+        }
+    }
+    return oldest;
+}
+
+static void* compile_worker(void* arg){
+    compile_pipeline* pipeline = (compile_pipeline*)arg;
+    
+    pthread_mutex_lock(&pipeline->lock);
+    while(1){
+        compile_job* job = oldest_job(pipeline, JOB_QUEUED, NULL);
+        while(job == NULL && !pipeline->shutdown){
+            pthread_cond_wait(&pipeline->job_queued, &pipeline->lock);
+            job = oldest_job(pipeline, JOB_QUEUED, NULL);
+        }
+        if(pipeline->shutdown){
+            break;
+        }
+        
+        job->state = JOB_BUILDING;
+        pthread_mutex_unlock(&pipeline->lock);
+        
+        cl_int error;
+        cl_kernel kernel = buildKernel(pipeline->source_file,
+                                       pipeline->kernel_name,
+                                       job->options,
+                                       pipeline->session->context,
+                                       pipeline->session->device,
+                                       &error);
+        
+        pthread_mutex_lock(&pipeline->lock);
+        job->kernel = kernel;
+        job->error = error;
+        job->state = JOB_DONE;
+        pthread_cond_broadcast(&pipeline->job_done);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+    
+    return NULL;
+}
+
+compile_pipeline* create_pipeline(bench_session* session, char* source_file, char* kernel_name, int n_threads){
+    compile_pipeline* pipeline = (compile_pipeline*)calloc(1, sizeof(compile_pipeline));
+    pipeline->session = session;
+    pipeline->source_file = source_file;
+    pipeline->kernel_name = kernel_name;
+    
+    // Enough slots to keep every thread busy while the next few kernels wait to be used
+    pipeline->n_jobs = 2*n_threads;
+    pipeline->jobs = (compile_job*)calloc(pipeline->n_jobs, sizeof(compile_job));
+    
+    pthread_mutex_init(&pipeline->lock, NULL);
+    pthread_cond_init(&pipeline->job_queued, NULL);
+    pthread_cond_init(&pipeline->job_done, NULL);
+    
+    pipeline->threads = (pthread_t*)malloc(sizeof(pthread_t)*n_threads);
+    pipeline->n_threads = n_threads;
+    for(int i = 0; i < n_threads; i++){
+        pthread_create(&pipeline->threads[i], NULL, compile_worker, pipeline);
+    }
+    
+    session->pipeline = pipeline;
+    return pipeline;
+}
+
+void release_pipeline(compile_pipeline* pipeline){
+    if(pipeline == NULL){
+        return;
+    }
+    
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->shutdown = 1;
+    pthread_cond_broadcast(&pipeline->job_queued);
+    pthread_mutex_unlock(&pipeline->lock);
+    
+    for(int i = 0; i < pipeline->n_threads; i++){
+        pthread_join(pipeline->threads[i], NULL);
+    }
+    
+    for(int i = 0; i < pipeline->n_jobs; i++){
+        if(pipeline->jobs[i].state == JOB_DONE && pipeline->jobs[i].kernel != NULL){
+            clReleaseKernel(pipeline->jobs[i].kernel);
+        }
+    }
+    
+    pthread_mutex_destroy(&pipeline->lock);
+    pthread_cond_destroy(&pipeline->job_queued);
+    pthread_cond_destroy(&pipeline->job_done);
+    
+    pipeline->session->pipeline = NULL;
+    free(pipeline->threads);
+    free(pipeline->jobs);
+    free(pipeline);
+}
+
+// Queues the configurations following next, as long as there are free job slots. Never blocks.
+void prefetch_configurations(compile_pipeline* pipeline,
+                             kernel_options_function get_options,
+                             skip_function skip,
+                             void* skip_data,
+                             configuration_order* configurations,
+                             int next,
+                             int n_total_configurations,
+                             int* limits,
+                             int n_parameters){
+    if(pipeline == NULL){
+        return;
+    }
+    
+    if(pipeline->next_prefetch < next){
+        pipeline->next_prefetch = next;
+    }
+    
+    char options[MAX_OPTIONS_LENGTH];
+    pthread_mutex_lock(&pipeline->lock);
+    
+    // Configurations before next were skipped without asking for their kernel, free their slots
+    for(int i = 0; i < pipeline->n_jobs; i++){
+        compile_job* job = &pipeline->jobs[i];
+        if(job->index >= next || job->state == JOB_FREE || job->state == JOB_BUILDING){
+            continue;
+        }
+        if(job->state == JOB_DONE && job->kernel != NULL){
+            clReleaseKernel(job->kernel);
+        }
+        job->state = JOB_FREE;
+    }
+    
+    while(pipeline->next_prefetch < n_total_configurations){
+        compile_job* job = NULL;
+        for(int i = 0; i < pipeline->n_jobs; i++){
+            if(pipeline->jobs[i].state == JOB_FREE){
+                job = &pipeline->jobs[i];
+                break;
+            }
+        }
+        if(job == NULL){
+            break;
+        }
+        
+        int index = pipeline->next_prefetch++;
+        if(skip(skip_data, index)){
+            continue;
+        }
+        int* config = get_config_for_number(get_configuration(configurations, index), limits, n_parameters);
+        int valid = get_options(pipeline->session, config, options);
+        free(config);
+        if(!valid){
+            continue;
+        }
+        
+        strncpy(job->options, options, MAX_OPTIONS_LENGTH-1);
+        job->options[MAX_OPTIONS_LENGTH-1] = 0;
+        job->index = index;
+        job->kernel = NULL;
+        job->state = JOB_QUEUED;
+        pthread_cond_signal(&pipeline->job_queued);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+// Returns the kernel built ahead for these options, or builds it now if it was not prefetched
+cl_kernel pipeline_get_kernel(compile_pipeline* pipeline, char* options, cl_int* error){
+    pthread_mutex_lock(&pipeline->lock);
+    compile_job* job = oldest_job(pipeline, JOB_FREE, options);
+    if(job == NULL){
+        pthread_mutex_unlock(&pipeline->lock);
+        return buildKernel(pipeline->source_file, pipeline->kernel_name, options, pipeline->session->context, pipeline->session->device, error);
+    }
+    
+    while(job->state != JOB_DONE){
+        pthread_cond_wait(&pipeline->job_done, &pipeline->lock);
+    }
+    
+    cl_kernel kernel = job->kernel;
+    *error = job->error;
+    job->state = JOB_FREE;
+    pthread_mutex_unlock(&pipeline->lock);
+    
+    return kernel;
+}
@@ -0,0 +1,39 @@
+// Copyright (c) 2015, Thomas L. Falch
+// For conditions of distribution and use, see the accompanying LICENSE and README files
+
+// This file is part of the benchmarks for the AUMA machine learning based auto tuning application
+// developed at the Norwegian University of Science and technology
+
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+#include <CL/cl.h>
+
+#include "configurations.h"
+#include "session.h"
+
+#define MAX_OPTIONS_LENGTH 1024
+
+// Writes the compiler options for a configuration into options, returns 0 if the
+// configuration is known to be invalid without building it
+typedef int (*kernel_options_function)(bench_session* session, int* config, char* options);
+
+// Returns 1 if the configuration at position index of the order will not be run, so its kernel is not built
+typedef int (*skip_function)(void* data, int index);
+
+typedef struct compile_pipeline compile_pipeline;
+
+compile_pipeline* create_pipeline(bench_session* session, char* source_file, char* kernel_name, int n_threads);
+void release_pipeline(compile_pipeline* pipeline);
+void prefetch_configurations(compile_pipeline* pipeline,
+                             kernel_options_function get_options,
+                             skip_function skip,
+                             void* skip_data,
+                             configuration_order* configurations,
+                             int next,
+                             int n_total_configurations,
+                             int* limits,
+                             int n_parameters);
+cl_kernel pipeline_get_kernel(compile_pipeline* pipeline, char* options, cl_int* error);
+
+#endif
@@ -0,0 +1,126 @@
+// Copyright (c) 2015, Thomas L. Falch
+// For conditions of distribution and use, see the accompanying LICENSE and README files
+
+// This file is part of the benchmarks for the AUMA machine learning based auto tuning application
+// developed at the Norwegian University of Science and technology
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "problem.h"
+
+#define MAX_SETTINGS 64
+
+static char* setting_names[MAX_SETTINGS];
+static int setting_values[MAX_SETTINGS];
+static int n_settings = 0;
+
+static problem_parameter* problem = NULL;
+static int n_problem = 0;
+
+// Parses NAME=VALUE or NAME VALUE, where VALUE is a (possibly negative) integer. Later settings override earlier ones.
+static int add_setting(char* setting){
+    char name[64];
+    char rest[2];
+    int value;
+    if(sscanf(setting, " %63[A-Za-z0-9_] = %d %1s", name, &value, rest) != 2 &&
+       sscanf(setting, " %63[A-Za-z0-9_] %d %1s", name, &value, rest) != 2){
+        return 0;
+    }
+
+    for(int i = 0; i < n_settings; i++){
+        if(strcmp(setting_names[i], name) == 0){
+            setting_values[i] = value;
+            return 1;
+        }
+    }
+    if(n_settings == MAX_SETTINGS){
+        return 0;
+    }
+    setting_names[n_settings] = strdup(name);
+    setting_values[n_settings] = value;
+    n_settings++;
+    return 1;
+}
+
+static void read_settings(char* filename){
+    FILE* file = fopen(filename, "r");
+    if(file == NULL){
+        fprintf(stderr, "Unable to open problem file %s, exiting\n", filename);
+        exit(-1);
+    }
+
+    char line[256];
+    int line_number = 0;
+    while(fgets(line, sizeof(line), file) != NULL){
+        line_number++;
+        char* start = line;
+        while(isspace((unsigned char)*start)){
+            start++;
+        }
+        if(*start == '\0' || *start == '#'){
+            continue;
+        }
+        if(!add_setting(start)){
+            fprintf(stderr, "Invalid problem parameter on line %d of %s, exiting\n", line_number, filename);
+            exit(-1);
+        }
+    }
+    fclose(file);
+}
+
+void add_problem_settings(char* arg){
+    if(strchr(arg, '=') == NULL){
+        read_settings(arg);
+        return;
+    }
+    if(!add_setting(arg)){
+        fprintf(stderr, "Invalid problem parameter %s, exiting\n", arg);
+        exit(-1);
+    }
+}
+
+void set_problem_parameters(problem_parameter* parameters, int n_parameters){
+    problem = parameters;
+    n_problem = n_parameters;
+
+    for(int i = 0; i < n_settings; i++){
+        int found = 0;
+        for(int j = 0; j < n_parameters; j++){
+            if(strcmp(setting_names[i], parameters[j].name) == 0){
+                *parameters[j].value = setting_values[i];
+                found = 1;
+            }
+        }
+        if(!found){
+            fprintf(stderr, "Unknown problem parameter %s, the parameters are:", setting_names[i]);
+            for(int j = 0; j < n_parameters; j++){
+                fprintf(stderr, " %s", parameters[j].name);
+            }
+            fprintf(stderr, "\nExiting\n");
+            exit(-1);
+        }
+    }
+}
+
+int get_problem_parameters(problem_parameter** parameters){
+    *parameters = problem;
+    return n_problem;
+}
+
+void print_problem_parameters(){
+    for(int i = 0; i < n_problem; i++){
+        printf("# %s %d\n", problem[i].name, *problem[i].value);
+    }
+}
+
+void append_problem_options(char* options_buffer){
+    for(int i = 0; i < n_problem; i++){
+        sprintf(options_buffer + strlen(options_buffer), " -D %s=%d", problem[i].name, *problem[i].value);
+    }
+}
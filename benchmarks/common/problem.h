@@ -0,0 +1,35 @@
+// Copyright (c) 2015, Thomas L. Falch
+// For conditions of distribution and use, see the accompanying LICENSE and README files
+
+// This file is part of the benchmarks for the AUMA machine learning based auto tuning application
+// developed at the Norwegian University of Science and technology
+
+
+#ifndef PROBLEM_H
+#define PROBLEM_H
+
+// A problem parameter of a benchmark, such as the image size. The variable holds the default value,
+// and can be changed with -D at run time, without recompiling.
+typedef struct{
+    char* name;
+    int* value;
+} problem_parameter;
+
+// Stores a NAME=VALUE setting given with -D. If arg has no '=', it is a file with one NAME=VALUE
+// or NAME VALUE setting per line, where empty lines and lines starting with # are ignored.
+void add_problem_settings(char* arg);
+
+// Applies the stored settings to the parameters of the benchmark, which are then used by the functions below.
+// Exits if a setting names a parameter the benchmark does not have.
+void set_problem_parameters(problem_parameter* parameters, int n_parameters);
+
+// Stores the parameters given to set_problem_parameters in parameters, and returns their number
+int get_problem_parameters(problem_parameter** parameters);
+
+// Prints a "# NAME value" comment line for each parameter
+void print_problem_parameters();
+
+// Appends " -D NAME=value" for each parameter to the kernel options
+void append_problem_options(char* options_buffer);
+
+#endif
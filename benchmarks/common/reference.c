@@ -0,0 +1,92 @@
+// Copyright (c) 2015, Thomas L. Falch
+// For conditions of distribution and use, see the accompanying LICENSE and README files
+
+// This file is part of the benchmarks for the AUMA machine learning based auto tuning application
+// developed at the Norwegian University of Science and technology
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "reference.h"
+
+// Each thread claims this many ranges on average, so that threads that get cheap rows take more of them
+#define RANGES_PER_THREAD 8
+
+typedef struct{
+    int n;
+    int range_size;
+    int next;
+    pthread_mutex_t lock;
+    void (*body)(int start, int end, void* arg);
+    void* arg;
+} parallel_loop;
+
+static double reference_time = -1.0;
+
+static void* run_ranges(void* arg){
+    parallel_loop* loop = (parallel_loop*)arg;
+    while(1){
+        pthread_mutex_lock(&loop->lock);
+        int start = loop->next;
+        loop->next += loop->range_size;
+        pthread_mutex_unlock(&loop->lock);
+
+        if(start >= loop->n){
+            return NULL;
+        }
+        int end = start + loop->range_size < loop->n ? start + loop->range_size : loop->n;
+        loop->body(start, end, loop->arg);
+    }
+}
+
+void parallel_for(int n, void (*body)(int start, int end, void* arg), void* arg){
+    int n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if(n_threads < 1){
+        n_threads = 1;
+    }
+    if(n_threads > n){
+        n_threads = n > 0 ? n : 1;
+    }
+
+    parallel_loop loop;
+    loop.n = n;
+    loop.range_size = n/(n_threads*RANGES_PER_THREAD) > 0 ? n/(n_threads*RANGES_PER_THREAD) : 1;
+    loop.next = 0;
+    loop.body = body;
+    loop.arg = arg;
+    pthread_mutex_init(&loop.lock, NULL);
+
+    pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t)*n_threads);
+    for(int t = 1; t < n_threads; t++){
+        pthread_create(&threads[t], NULL, run_ranges, &loop);
+    }
+    run_ranges(&loop);
+    for(int t = 1; t < n_threads; t++){
+        pthread_join(threads[t], NULL);
+    }
+
+    free(threads);
+    pthread_mutex_destroy(&loop.lock);
+}
+
+double time_reference(void (*reference)(void* arg), void* arg){
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    reference(arg);
+    gettimeofday(&end, NULL);
+
+    reference_time = (end.tv_sec - start.tv_sec)*1e6 + (end.tv_usec - start.tv_usec);
+    return reference_time;
+}
+
+void print_reference_time(){
+    if(reference_time >= 0){
+        printf("# CPU_REFERENCE_TIME %f\n", reference_time);
+    }
+}
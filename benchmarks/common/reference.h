@@ -0,0 +1,24 @@
+// Copyright (c) 2015, Thomas L. Falch
+// For conditions of distribution and use, see the accompanying LICENSE and README files
+
+// This file is part of the benchmarks for the AUMA machine learning based auto tuning application
+// developed at the Norwegian University of Science and technology
+
+
+#ifndef REFERENCE_H
+#define REFERENCE_H
+
+// Support for the host reference implementations of the benchmarks, which compute the
+// correct output without a device, and whose time is reported as a CPU baseline.
+
+// Calls body on consecutive ranges covering [0, n), on one thread per core
+void parallel_for(int n, void (*body)(int start, int end, void* arg), void* arg);
+
+// Runs the reference and returns its time in microseconds, like the kernel times.
+// The time is remembered for print_reference_time.
+double time_reference(void (*reference)(void* arg), void* arg);
+
+// Prints the time of the reference as a comment, if it has been run
+void print_reference_time();
+
+#endif
@@ -0,0 +1,180 @@
+// Copyright (c) 2015, Thomas L. Falch
+// For conditions of distribution and use, see the accompanying LICENSE and README files
+
+// This file is part of the benchmarks for the AUMA machine learning based auto tuning application
+// developed at the Norwegian University of Science and technology
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "results.h"
+#include "problem.h"
+
+#define N_TIME_COLUMNS 4
+
+// The block being filled is written again after this many seconds, so that at most this much is lost if the
+// sweep is killed. Full blocks are written once, so the file is written in time proportional to its size.
+#define RESULTS_WRITE_SECONDS 5
+
+static long padded_length(long length){
+    return (length + 7)/8*8;
+}
+
+static void write_name(FILE* file, char* name){
+    char padded_name[RESULTS_NAME_LENGTH] = {0};
+    strncpy(padded_name, name, RESULTS_NAME_LENGTH-1);
+    fwrite(padded_name, 1, RESULTS_NAME_LENGTH, file);
+}
+
+// Only the rows of the block being filled are kept in memory, column by column. Parameters are stored in
+// one byte, so their limits can be at most 128.
+results_file* create_results(char* filename, int n_parameters, int* limits, char** names){
+    for(int p = 0; p < n_parameters; p++){
+        if(limits[p] > 128){
+            fprintf(stderr, "Parameter %s has too many values for the results file\n", names[p]);
+            return NULL;
+        }
+    }
+
+    FILE* file = fopen(filename, "wb");
+    if(file == NULL){
+        fprintf(stderr, "Could not open results file %s\n", filename);
+        return NULL;
+    }
+
+    problem_parameter* problem;
+    int32_t n_problem = get_problem_parameters(&problem);
+    int32_t header[4] = {n_parameters, 0, RESULTS_BLOCK_ROWS, n_problem};
+    fwrite(RESULTS_MAGIC, 1, 8, file);
+    fwrite(header, sizeof(int32_t), 4, file);
+    for(int p = 0; p < n_parameters; p++){
+        int32_t limit = limits[p];
+        fwrite(&limit, sizeof(int32_t), 1, file);
+    }
+    for(int p = 0; p < n_parameters; p++){
+        write_name(file, names[p]);
+    }
+    for(int p = 0; p < n_problem; p++){
+        write_name(file, problem[p].name);
+    }
+    for(int p = 0; p < n_problem; p++){
+        int32_t value = *problem[p].value;
+        fwrite(&value, sizeof(int32_t), 1, file);
+    }
+
+    results_file* results = (results_file*)calloc(1, sizeof(results_file));
+    results->file = file;
+    results->filename = filename;
+    results->n_parameters = n_parameters;
+    results->header_length = padded_length(8 + 4*sizeof(int32_t) + n_parameters*(sizeof(int32_t) + RESULTS_NAME_LENGTH)
+                                           + n_problem*(RESULTS_NAME_LENGTH + sizeof(int32_t)));
+    results->block_length = padded_length((long)n_parameters*RESULTS_BLOCK_ROWS)
+                            + RESULTS_BLOCK_ROWS*(N_TIME_COLUMNS*sizeof(double) + 2*sizeof(int32_t));
+    results->parameters = (signed char*)calloc((size_t)n_parameters*RESULTS_BLOCK_ROWS, sizeof(signed char));
+    results->times = (double*)calloc(N_TIME_COLUMNS*RESULTS_BLOCK_ROWS, sizeof(double));
+    results->n_launches = (int32_t*)calloc(RESULTS_BLOCK_ROWS, sizeof(int32_t));
+    results->devices = (int32_t*)calloc(RESULTS_BLOCK_ROWS, sizeof(int32_t));
+    results->last_write = time(NULL);
+
+    if(ferror(file)){
+        fprintf(stderr, "Could not write results file %s\n", filename);
+        release_results(results);
+        return NULL;
+    }
+    return results;
+}
+
+// Writes the columns of the block being filled in place, unused rows included
+static void write_block(results_file* results){
+    FILE* file = results->file;
+    int block = (results->n_rows - 1)/RESULTS_BLOCK_ROWS;
+    long parameter_length = (long)results->n_parameters*RESULTS_BLOCK_ROWS;
+    char padding[8] = {0};
+
+    fseek(file, results->header_length + block*results->block_length, SEEK_SET);
+    fwrite(results->parameters, 1, parameter_length, file);
+    fwrite(padding, 1, padded_length(parameter_length) - parameter_length, file);
+    fwrite(results->times, sizeof(double), N_TIME_COLUMNS*RESULTS_BLOCK_ROWS, file);
+    fwrite(results->n_launches, sizeof(int32_t), RESULTS_BLOCK_ROWS, file);
+    fwrite(results->devices, sizeof(int32_t), RESULTS_BLOCK_ROWS, file);
+}
+
+// Updates the number of rows in the header, after the rows are written
+static int write_n_rows(results_file* results){
+    int32_t n_rows = results->n_rows;
+    fflush(results->file);
+    fseek(results->file, 8 + sizeof(int32_t), SEEK_SET);
+    fwrite(&n_rows, sizeof(int32_t), 1, results->file);
+    fflush(results->file);
+    results->last_write = time(NULL);
+
+    if(ferror(results->file)){
+        fprintf(stderr, "Could not write results file %s\n", results->filename);
+        return 0;
+    }
+    return 1;
+}
+
+static void write_if_due(results_file* results){
+    if(time(NULL) - results->last_write >= RESULTS_WRITE_SECONDS){
+        write_results(results);
+    }
+}
+
+void results_append(results_file* results, int* config, double time, kernel_timing* timing, int device){
+    if(results == NULL){
+        return;
+    }
+
+    int row = results->n_rows % RESULTS_BLOCK_ROWS;
+    for(int p = 0; p < results->n_parameters; p++){
+        results->parameters[p*RESULTS_BLOCK_ROWS + row] = (signed char)config[p];
+    }
+    results->times[0*RESULTS_BLOCK_ROWS + row] = time;
+    results->times[1*RESULTS_BLOCK_ROWS + row] = timing->min;
+    results->times[2*RESULTS_BLOCK_ROWS + row] = timing->mean;
+    results->times[3*RESULTS_BLOCK_ROWS + row] = timing->stddev;
+    results->n_launches[row] = timing->n_launches;
+    results->devices[row] = device;
+    results->n_rows++;
+
+    // A full block is written once, and cleared for the rows of the next
+    if(row == RESULTS_BLOCK_ROWS-1){
+        write_block(results);
+        write_n_rows(results);
+        memset(results->parameters, 0, (size_t)results->n_parameters*RESULTS_BLOCK_ROWS);
+        memset(results->times, 0, sizeof(double)*N_TIME_COLUMNS*RESULTS_BLOCK_ROWS);
+        memset(results->n_launches, 0, sizeof(int32_t)*RESULTS_BLOCK_ROWS);
+        memset(results->devices, 0, sizeof(int32_t)*RESULTS_BLOCK_ROWS);
+    }
+    else{
+        write_if_due(results);
+    }
+}
+
+int write_results(results_file* results){
+    if(results == NULL){
+        return 1;
+    }
+    if(results->n_rows % RESULTS_BLOCK_ROWS != 0){
+        write_block(results);
+    }
+    return write_n_rows(results);
+}
+
+void release_results(results_file* results){
+    if(results == NULL){
+        return;
+    }
+    fclose(results->file);
+    free(results->parameters);
+    free(results->times);
+    free(results->n_launches);
+    free(results->devices);
+    free(results);
+}
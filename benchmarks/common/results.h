@@ -0,0 +1,70 @@
+// Copyright (c) 2015, Thomas L. Falch
+// For conditions of distribution and use, see the accompanying LICENSE and README files
+
+// This file is part of the benchmarks for the AUMA machine learning based auto tuning application
+// developed at the Norwegian University of Science and technology
+
+
+#ifndef RESULTS_H
+#define RESULTS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "timing.h"
+
+// Binary columnar results file. All values are in the byte order of the host.
+//
+//  char    magic[8]                            RESULTS_MAGIC
+//  int32   n_parameters
+//  int32   n_rows                              updated as the rows are written
+//  int32   block_rows                          RESULTS_BLOCK_ROWS
+//  int32   n_problem_parameters                problem parameters of the benchmark, see problem.h
+//  int32   limits[n_parameters]
+//  char    names[n_parameters][RESULTS_NAME_LENGTH]
+//  char    problem_names[n_problem_parameters][RESULTS_NAME_LENGTH]
+//  int32   problem_values[n_problem_parameters]
+//  char    padding[]                           to a multiple of 8 bytes
+//  blocks of block_rows rows, each with the columns of its rows:
+//      int8    parameters[n_parameters][block_rows]    one column per parameter
+//      char    padding[]                               to a multiple of 8 bytes
+//      float64 time[block_rows], min[block_rows], mean[block_rows], stddev[block_rows]
+//      int32   n_launches[block_rows], device[block_rows]
+//
+// Only the first n_rows rows are valid, the rest of the last block is unused.
+//
+// Files written before the blocks were added start with "AUMARES1", and have no block_rows. The columns
+// of all the rows follow the names, with n_problem_parameters and the problem parameters at the end.
+#define RESULTS_MAGIC "AUMARES2"
+#define RESULTS_NAME_LENGTH 32
+#define RESULTS_BLOCK_ROWS 1024
+
+typedef struct{
+    FILE* file;
+    char* filename;
+    int n_parameters;
+    long header_length;
+    long block_length;
+
+    int n_rows;
+    // The columns of the block being filled, the earlier blocks are already written
+    signed char* parameters;
+    double* times;
+    int32_t* n_launches;
+    int32_t* devices;
+
+    time_t last_write;
+} results_file;
+
+// Creates the file and writes its header
+results_file* create_results(char* filename, int n_parameters, int* limits, char** names);
+// Adds a row. The block is written when it is full, or if it has not been written for RESULTS_WRITE_SECONDS.
+void results_append(results_file* results, int* config, double time, kernel_timing* timing, int device);
+
+// Writes the rows of the block being filled and then the number of rows, so that a reader never sees rows
+// which are not written yet. Returns 0 if they could not be written.
+int write_results(results_file* results);
+void release_results(results_file* results);
+
+#endif
@@ -0,0 +1,178 @@
+// Copyright (c) 2015, Thomas L. Falch
+// For conditions of distribution and use, see the accompanying LICENSE and README files
+
+// This file is part of the benchmarks for the AUMA machine learning based auto tuning application
+// developed at the Norwegian University of Science and technology
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <CL/cl.h>
+
+#include "clutil.h"
+#include "session.h"
+#include "pipeline.h"
+
+bench_session* create_session(cl_device_id device){
+    cl_int error;
+    
+    bench_session* session = (bench_session*)calloc(1, sizeof(bench_session));
+    session->device = device;
+    
+    session->context = clCreateContext(NULL, 1, &device, NULL, NULL, &error);
+    clError("Couldn't get context", error);
+    
+    session->queue = clCreateCommandQueue(session->context, device, CL_QUEUE_PROFILING_ENABLE, &error);
+    clError("Couldn't create command queue", error);
+    
+    return session;
+}
+
+void release_session(bench_session* session){
+    if(session == NULL){
+        return;
+    }
+    
+    release_pipeline(session->pipeline);
+    
+    for(int i = 0; i < session->n_inputs; i++){
+        clReleaseMemObject(session->inputs[i].mem);
+    }
+    free(session->inputs);
+    
+    clReleaseCommandQueue(session->queue);
+    clReleaseContext(session->context);
+    free(session);
+}
+
+cl_kernel build_session_kernel(bench_session* session, char* source_file, char* kernel_name, char* options, cl_int* error){
+    if(session->pipeline != NULL){
+        return pipeline_get_kernel(session->pipeline, options, error);
+    }
+    return buildKernel(source_file, kernel_name, options, session->context, session->device, error);
+}
+
+static cl_mem find_input(bench_session* session, void* host, int layout, cl_mem_flags flags){
+    for(int i = 0; i < session->n_inputs; i++){
+        cached_input* input = &session->inputs[i];
+        if(input->host == host && input->layout == layout && input->flags == flags){
+            return input->mem;
+        }
+    }
+    return NULL;
+}
+
+static void add_input(bench_session* session, void* host, int layout, cl_mem_flags flags, cl_mem mem){
+    if(session->n_inputs == session->max_inputs){
+        session->max_inputs = session->max_inputs == 0 ? 8 : 2*session->max_inputs;
+        session->inputs = (cached_input*)realloc(session->inputs, sizeof(cached_input)*session->max_inputs);
+    }
+    
+    cached_input* input = &session->inputs[session->n_inputs++];
+    input->host = host;
+    input->layout = layout;
+    input->flags = flags;
+    input->mem = mem;
+}
+
+cl_mem get_input_buffer(bench_session* session, cl_mem_flags flags, size_t size, void* host, cl_int* error){
+    *error = CL_SUCCESS;
+    cl_mem mem = find_input(session, host, INPUT_BUFFER, flags);
+    if(mem != NULL){
+        return mem;
+    }
+    
+    mem = clCreateBuffer(session->context, flags|CL_MEM_COPY_HOST_PTR, size, host, error);
+    if(*error != CL_SUCCESS){
+        return NULL;
+    }
+    
+    add_input(session, host, INPUT_BUFFER, flags, mem);
+    return mem;
+}
+
+cl_mem get_input_pitched_buffer(bench_session* session, size_t row_size, size_t rows, size_t pitch, void* host, cl_int* error){
+    *error = CL_SUCCESS;
+    cl_mem mem = find_input(session, host, INPUT_PITCHED_BUFFER, CL_MEM_READ_WRITE);
+    if(mem != NULL){
+        return mem;
+    }
+    
+    mem = clCreateBuffer(session->context, CL_MEM_READ_WRITE, pitch*rows, NULL, error);
+    if(*error != CL_SUCCESS){
+        return NULL;
+    }
+    
+    size_t buffer_origin[3] = {0,0,0};
+    size_t host_origin[3] = {0,0,0};
+    size_t region[3] = {row_size, rows, 1};
+    *error = clEnqueueWriteBufferRect(session->queue,
+                                      mem,
+                                      CL_TRUE,
+                                      buffer_origin,
+                                      host_origin,
+                                      region,
+                                      pitch,
+                                      0,
+                                      0,
+                                      0,
+                                      host,
+                                      0,
+                                      NULL,
+                                      NULL);
+    if(*error != CL_SUCCESS){
+        clReleaseMemObject(mem);
+        return NULL;
+    }
+    
+    add_input(session, host, INPUT_PITCHED_BUFFER, CL_MEM_READ_WRITE, mem);
+    return mem;
+}
+
+cl_mem get_input_image2d(bench_session* session, const cl_image_format* format, size_t width, size_t height, size_t row_pitch, void* host, cl_int* error){
+    *error = CL_SUCCESS;
+    cl_mem mem = find_input(session, host, INPUT_IMAGE2D, CL_MEM_READ_ONLY);
+    if(mem != NULL){
+        return mem;
+    }
+    
+    mem = clCreateImage2D(session->context,
+                          CL_MEM_READ_ONLY|CL_MEM_COPY_HOST_PTR,
+                          format,
+                          width,
+                          height,
+                          row_pitch,
+                          host,
+                          error);
+    if(*error != CL_SUCCESS){
+        return NULL;
+    }
+    
+    add_input(session, host, INPUT_IMAGE2D, CL_MEM_READ_ONLY, mem);
+    return mem;
+}
+
+cl_mem get_input_image3d(bench_session* session, const cl_image_format* format, size_t width, size_t height, size_t depth, size_t row_pitch, size_t slice_pitch, void* host, cl_int* error){
+    *error = CL_SUCCESS;
+    cl_mem mem = find_input(session, host, INPUT_IMAGE3D, CL_MEM_READ_ONLY);
+    if(mem != NULL){
+        return mem;
+    }
+    
+    mem = clCreateImage3D(session->context,
+                          CL_MEM_READ_ONLY|CL_MEM_COPY_HOST_PTR,
+                          format,
+                          width,
+                          height,
+                          depth,
+                          row_pitch,
+                          slice_pitch,
+                          host,
+                          error);
+    if(*error != CL_SUCCESS){
+        return NULL;
+    }
+    
+    add_input(session, host, INPUT_IMAGE3D, CL_MEM_READ_ONLY, mem);
+    return mem;
+}
@@ -0,0 +1,55 @@
+// Copyright (c) 2015, Thomas L. Falch
+// For conditions of distribution and use, see the accompanying LICENSE and README files
+
+// This file is part of the benchmarks for the AUMA machine learning based auto tuning application
+// developed at the Norwegian University of Science and technology
+
+
+#ifndef SESSION_H
+#define SESSION_H
+#include <CL/cl.h>
+
+// Memory layouts an input can be uploaded in
+#define INPUT_BUFFER            0
+#define INPUT_PITCHED_BUFFER    1
+#define INPUT_IMAGE2D           2
+#define INPUT_IMAGE3D           3
+
+// A device copy of a host input, identified by the host pointer, layout and flags
+typedef struct{
+    void* host;
+    int layout;
+    cl_mem_flags flags;
+    cl_mem mem;
+} cached_input;
+
+struct compile_pipeline;
+
+// OpenCL state shared by all configurations of a sweep, so that each
+// configuration only pays for building and launching its kernel.
+typedef struct{
+    cl_device_id device;
+    cl_context context;
+    cl_command_queue queue;
+    
+    cached_input* inputs;
+    int n_inputs;
+    int max_inputs;
+    
+    // Set while kernels are compiled ahead of time, see pipeline.h
+    struct compile_pipeline* pipeline;
+} bench_session;
+
+bench_session* create_session(cl_device_id device);
+void release_session(bench_session* session);
+
+// Returns the kernel from the compile pipeline if there is one, otherwise builds it
+cl_kernel build_session_kernel(bench_session* session, char* source_file, char* kernel_name, char* options, cl_int* error);
+
+// The returned memory objects are uploaded once and owned by the session, they must not be released by the caller
+cl_mem get_input_buffer(bench_session* session, cl_mem_flags flags, size_t size, void* host, cl_int* error);
+cl_mem get_input_pitched_buffer(bench_session* session, size_t row_size, size_t rows, size_t pitch, void* host, cl_int* error);
+cl_mem get_input_image2d(bench_session* session, const cl_image_format* format, size_t width, size_t height, size_t row_pitch, void* host, cl_int* error);
+cl_mem get_input_image3d(bench_session* session, const cl_image_format* format, size_t width, size_t height, size_t depth, size_t row_pitch, size_t slice_pitch, void* host, cl_int* error);
+
+#endif
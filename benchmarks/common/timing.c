@@ -0,0 +1,268 @@
+// Copyright (c) 2015, Thomas L. Falch
+// For conditions of distribution and use, see the accompanying LICENSE and README files
+
+// This file is part of the benchmarks for the AUMA machine learning based auto tuning application
+// developed at the Norwegian University of Science and technology
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+#include <CL/cl.h>
+
+#include "clutil.h"
+#include "parser.h"
+#include "timing.h"
+
+static int n_warmup_launches = 0;
+static int n_timed_launches = 1;
+
+// Adaptive mode is off while the target width is 0
+static double target_ci_width = 0.0;
+static double time_budget = 1000.0;
+
+// Early abort is off while the factor is 0
+static double abort_factor = 0.0;
+
+void set_warmup_launches(int n){
+    n_warmup_launches = n < 0 ? 0 : n;
+}
+
+void set_timed_launches(int n){
+    n_timed_launches = n < 1 ? 1 : n;
+}
+
+void set_target_ci_width(double width){
+    target_ci_width = width < 0.0 ? 0.0 : width;
+}
+
+void set_time_budget(double milliseconds){
+    time_budget = milliseconds;
+}
+
+void set_abort_factor(double factor){
+    abort_factor = factor < 0.0 ? 0.0 : factor;
+}
+
+// Configurations in the second stage slower than the time threshold, or slower than abort_factor times
+// the best time so far, are not worth measuring precisely. Returns 0 if there is no cutoff.
+double get_cutoff_time(double best_time){
+    double cutoff = abort_factor > 0.0 && best_time > 0.0 ? abort_factor*best_time : 0.0;
+    if(get_use_time_threshold() && (cutoff == 0.0 || get_time_threshold() < cutoff)){
+        cutoff = get_time_threshold();
+    }
+    return cutoff;
+}
+
+static int compare_doubles(const void* a, const void* b){
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double elapsed_ms(struct timeval start){
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start.tv_sec)*1000.0 + (now.tv_usec - start.tv_usec)/1000.0;
+}
+
+// Two sided 97.5% quantile of Student's t distribution
+static double t_quantile(int degrees_of_freedom){
+    static const double table[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                   2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                   2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    if(degrees_of_freedom <= 30){
+        return table[degrees_of_freedom-1];
+    }
+    return 1.96 + 2.4/degrees_of_freedom;
+}
+
+static void compute_statistics(double* times, int n, kernel_timing* timing){
+    double sum = 0.0;
+    for(int i = 0; i < n; i++){
+        sum += times[i];
+    }
+    timing->mean = sum/n;
+    
+    double squares = 0.0;
+    for(int i = 0; i < n; i++){
+        squares += (times[i] - timing->mean)*(times[i] - timing->mean);
+    }
+    timing->stddev = n > 1 ? sqrt(squares/(n-1)) : 0.0;
+    timing->n_launches = n;
+}
+
+// Whether the half width of the 95% confidence interval of the mean is within target_ci_width of the mean
+static int confidence_reached(kernel_timing* timing){
+    if(timing->n_launches < 2 || timing->mean <= 0.0){
+        return 0;
+    }
+    double half_width = t_quantile(timing->n_launches-1)*timing->stddev/sqrt(timing->n_launches);
+    return half_width <= target_ci_width*timing->mean;
+}
+
+// Launches the kernel n times, storing the time of each launch. Returns 0, or -4.0 if the
+// kernel could not be launched and -1.0 if it failed while running, like the *_ocl functions.
+static double timed_launches(cl_command_queue queue,
+                             cl_kernel kernel,
+                             cl_uint dim,
+                             const size_t* global_work_size,
+                             const size_t* local_work_size,
+                             int n,
+                             double* times){
+    
+    cl_int error = CL_SUCCESS;
+    cl_event* events = (cl_event*)malloc(sizeof(cl_event)*n);
+    int n_launched = 0;
+    for(; n_launched < n; n_launched++){
+        error = clEnqueueNDRangeKernel(queue, kernel, dim, NULL, global_work_size, local_work_size, 0, NULL, &events[n_launched]);
+        clError("enqueue kernel", error);
+        if(error != CL_SUCCESS){
+            break;
+        }
+    }
+    
+    double status = -4.0;
+    if(error == CL_SUCCESS){
+        error = clFinish(queue);
+        clError("Error waiting for kernel",error);
+        status = error == CL_SUCCESS ? 0.0 : -1.0;
+    }
+    
+    if(status == 0.0){
+        for(int i = 0; i < n; i++){
+            cl_ulong start_time, end_time;
+            error = clGetEventProfilingInfo(events[i], CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start_time, NULL);
+            error = clGetEventProfilingInfo(events[i], CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end_time, NULL);
+            clError("Error timing",error);
+            times[i] = (double)(end_time-start_time)/1000.0;
+        }
+    }
+    
+    for(int i = 0; i < n_launched; i++){
+        clWaitForEvents(1, &events[i]);
+        clReleaseEvent(events[i]);
+    }
+    free(events);
+    
+    return status;
+}
+
+// Launches the kernel n_warmup_launches times without timing it, then n_timed_launches times,
+// timing each launch with its own profiling event. In adaptive mode, more launches are added,
+// doubling their number each round, until the confidence interval of the mean is narrow enough
+// or the time budget is spent. Returns the median time, or the error code of timed_launches.
+//
+// If timing->cutoff is set, the first launch is timed on its own, and if it is slower than the
+// cutoff, the kernel is not launched again and CENSORED is returned.
+double time_kernel(cl_command_queue queue,
+                   cl_kernel kernel,
+                   cl_uint dim,
+                   const size_t* global_work_size,
+                   const size_t* local_work_size,
+                   kernel_timing* timing){
+    
+    double cutoff = timing->cutoff;
+    memset(timing, 0, sizeof(kernel_timing));
+    timing->cutoff = cutoff;
+    
+    int n = n_timed_launches;
+    int max_n = n;
+    double* times = (double*)malloc(sizeof(double)*max_n);
+    double status;
+    
+    int n_warmup = n_warmup_launches;
+    int n_first = 0;
+    if(cutoff > 0.0){
+        double first;
+        status = timed_launches(queue, kernel, dim, global_work_size, local_work_size, 1, &first);
+        if(status < 0){
+            free(times);
+            return status;
+        }
+        if(first > cutoff){
+            timing->median = timing->min = timing->mean = first;
+            timing->n_launches = 1;
+            free(times);
+            return CENSORED;
+        }
+        
+        // The first launch counts as a warmup launch if there are any
+        if(n_warmup > 0){
+            n_warmup--;
+        }
+        else{
+            times[0] = first;
+            n_first = 1;
+        }
+    }
+    
+    cl_int error;
+    for(int i = 0; i < n_warmup; i++){
+        error = clEnqueueNDRangeKernel(queue, kernel, dim, NULL, global_work_size, local_work_size, 0, NULL, NULL);
+        clError("enqueue kernel", error);
+        if(error != CL_SUCCESS){
+            free(times);
+            return -4.0;
+        }
+    }
+    
+    struct timeval start;
+    gettimeofday(&start, NULL);
+    
+    status = timed_launches(queue, kernel, dim, global_work_size, local_work_size, n - n_first, times + n_first);
+    if(status < 0){
+        free(times);
+        return status;
+    }
+    compute_statistics(times, n, timing);
+    
+    while(target_ci_width > 0.0 && !confidence_reached(timing)){
+        double remaining = time_budget - elapsed_ms(start);
+        if(remaining <= 0.0){
+            break;
+        }
+        
+        // Do not start more launches than the remaining budget is expected to allow
+        int batch = n;
+        if(timing->mean > 0.0 && batch > remaining*1000.0/timing->mean){
+            batch = (int)(remaining*1000.0/timing->mean);
+        }
+        if(batch < 1){
+            batch = 1;
+        }
+        
+        if(n + batch > max_n){
+            max_n = n + batch;
+            times = (double*)realloc(times, sizeof(double)*max_n);
+        }
+        status = timed_launches(queue, kernel, dim, global_work_size, local_work_size, batch, times+n);
+        if(status < 0){
+            free(times);
+            memset(timing, 0, sizeof(kernel_timing));
+            return status;
+        }
+        n += batch;
+        compute_statistics(times, n, timing);
+    }
+    
+    qsort(times, n, sizeof(double), compare_doubles);
+    timing->median = n % 2 == 1 ? times[n/2] : (times[n/2-1] + times[n/2])/2.0;
+    timing->min = times[0];
+    free(times);
+    
+    return timing->median;
+}
+
+// The time to compare against time thresholds, which for censored kernels is the time of the first launch
+double comparable_time(double time, kernel_timing* timing){
+    return time == CENSORED ? timing->min : time;
+}
+
+// Prints the time reported for a configuration, followed by the minimum, mean and standard deviation
+// of the timed launches and the number of launches, which are 0 if the kernel was never timed
+void print_time(double time, kernel_timing* timing){
+    printf("%f %f %f %f %d\n", time, timing->min, timing->mean, timing->stddev, timing->n_launches);
+}
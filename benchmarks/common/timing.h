@@ -0,0 +1,43 @@
+// Copyright (c) 2015, Thomas L. Falch
+// For conditions of distribution and use, see the accompanying LICENSE and README files
+
+// This file is part of the benchmarks for the AUMA machine learning based auto tuning application
+// developed at the Norwegian University of Science and technology
+
+
+#ifndef TIMING_H
+#define TIMING_H
+#include <CL/cl.h>
+
+// Returned instead of the time for kernels aborted after their first launch
+#define CENSORED -5.0
+
+// Statistics over the timed launches of a kernel, in microseconds
+typedef struct{
+    double median;
+    double min;
+    double mean;
+    double stddev;
+    int n_launches;
+    
+    // Set by the caller, kernels whose first launch is slower than this are aborted, 0 to disable
+    double cutoff;
+} kernel_timing;
+
+void set_warmup_launches(int n);
+void set_timed_launches(int n);
+void set_target_ci_width(double width);
+void set_time_budget(double milliseconds);
+void set_abort_factor(double factor);
+double get_cutoff_time(double best_time);
+
+double time_kernel(cl_command_queue queue,
+                   cl_kernel kernel,
+                   cl_uint dim,
+                   const size_t* global_work_size,
+                   const size_t* local_work_size,
+                   kernel_timing* timing);
+double comparable_time(double time, kernel_timing* timing);
+void print_time(double time, kernel_timing* timing);
+
+#endif
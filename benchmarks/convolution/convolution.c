@@ -17,6 +17,15 @@
 #include "../common/configurations.h"
 #include "../common/io.h"
 #include "../common/parser.h"
+#include "../common/session.h"
+#include "../common/pipeline.h"
+#include "../common/timing.h"
+#include "../common/driver.h"
+#include "../common/compare.h"
+#include "../common/device_check.h"
+#include "../common/reference.h"
+#include "../common/problem.h"
+#include "../common/constraints.h"
 
 // Tuning parameters
 int LOCAL_SIZE_X =              0;
@@ -31,14 +40,19 @@ int UNROLL =			8;
 
 int global_config[] = {3,3,1,1,0,0,0,0,0};
 int param_limits[] =  {8,8,8,8,2,2,2,2,2}; //Or, rather, the limit + 1
+char* param_names[] = {"LOCAL_SIZE_X", "LOCAL_SIZE_Y", "ELEMENTS_PER_THREAD_X", "ELEMENTS_PER_THREAD_Y", "USE_TEXTURE", "USE_LOCAL", "FAKE_PADDING", "INTERLEAVED", "UNROLL"};
 int n_parameters = 9;
 
-//Problem parameters
-const int IMAGE_WIDTH = 2048;
-const int IMAGE_HEIGHT = 2048;
-const int PADDING = 4;
-const int FILTER_WIDTH = 5;
-const int FILTER_HEIGHT = 5;
+//Problem parameters, can be set with -D
+int IMAGE_WIDTH = 2048;
+int IMAGE_HEIGHT = 2048;
+int PADDING = 4;
+int FILTER_WIDTH = 5;
+int FILTER_HEIGHT = 5;
+
+problem_parameter problem_parameters[] = {{"IMAGE_HEIGHT", &IMAGE_HEIGHT}, {"IMAGE_WIDTH", &IMAGE_WIDTH}, {"PADDING", &PADDING},
+                                          {"FILTER_WIDTH", &FILTER_WIDTH}, {"FILTER_HEIGHT", &FILTER_HEIGHT}};
+int n_problem_parameters = 5;
 
 float* padded_input_g;
 float* filter_g;
@@ -89,23 +103,41 @@ int index(int x, int y, int width, int padding){
     return padding*(width+2*padding) + y*(width+2*padding) + x + padding;
 }
 
-void convolve_cpu(float* input, float* output, float* filter, int width, int height, int padding){
-
-  for(int w = 0; w < width; w++){
-      for(int h = 0; h < height; h++){
-
-          int k = 0;
-          float sum = 0.0;
-          int fw = floor(FILTER_WIDTH/2);
-          int fh = floor(FILTER_HEIGHT/2);
-          for(int i = -fw; i <= fw; i++){
-              for(int j = -fh; j <= fh; j++){
-                  sum += input[index(w+i,h+j,width,padding)] * filter[k++];
-              }
-          }
-          output[index(w,h,width,PADDING)] = sum;
-      }
-  }
+typedef struct{
+    float* padded_input;
+    float* filter;
+    float* output;
+} convolution_reference;
+
+// Computes rows [start, end) of the output. A row is accumulated one filter element at a time, so
+// that the inner loop is over consecutive pixels, and each pixel gets its terms in the kernel's order.
+void convolve_rows(int start, int end, void* arg){
+    convolution_reference* r = (convolution_reference*)arg;
+    int fw = FILTER_WIDTH/2;
+    int fh = FILTER_HEIGHT/2;
+
+    for(int h = start; h < end; h++){
+        float* output = r->output + h*IMAGE_WIDTH;
+        for(int w = 0; w < IMAGE_WIDTH; w++){
+            output[w] = 0.0;
+        }
+
+        int k = 0;
+        for(int i = -fw; i <= fw; i++){
+            for(int j = -fh; j <= fh; j++){
+                float f = r->filter[k++];
+                float* input = r->padded_input + index(i, h+j, IMAGE_WIDTH, PADDING);
+                for(int w = 0; w < IMAGE_WIDTH; w++){
+                    output[w] += input[w] * f;
+                }
+            }
+        }
+    }
+}
+
+// Computes the unpadded output on the CPU, in the format of the correct file
+void convolve_cpu(void* arg){
+    parallel_for(IMAGE_HEIGHT, convolve_rows, arg);
 }
 
 void print2d(float* buffer, int width, int height){
@@ -118,7 +150,7 @@ void print2d(float* buffer, int width, int height){
     printf("\n");
 }
 
-double convolve_ocl(float* input, float* output, float* filter, int width, int height, int padding, cl_device_id device, int* config){
+int convolution_options(bench_session* session, int* config, char* options_buffer){
     
     int lwsx = pow(2, config[LOCAL_SIZE_X]);
     int lwsy = pow(2, config[LOCAL_SIZE_Y]);
@@ -127,56 +159,64 @@ double convolve_ocl(float* input, float* output, float* filter, int width, int h
     const size_t local_work_size[2] = {lwsx,lwsy};
     const size_t global_work_size[2] = {(IMAGE_WIDTH/eptx),IMAGE_HEIGHT/epty};
     
-    if(invalid_work_group_size_static(device, 2, local_work_size, global_work_size)){
-        return -1;
+    if(invalid_work_group_size_static(session->device, 2, local_work_size, global_work_size)){
+        return 0;
     }
     
-    cl_int error;
-    cl_context context;
-    cl_command_queue queue;
-    cl_kernel kernel;
-    
-    
-    context = clCreateContext(NULL, 1, &device, NULL, NULL, &error);
-    clError("Couldn't get context", error);
-    
-    queue = clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &error);
-    clError("Couldn't create command queue", error);
-    
-    char* kernelName = "convolution.cl";
-    char options_buffer [300];
     sprintf(options_buffer, "-D ELEMENTS_PER_THREAD_X=%d -D ELEMENTS_PER_THREAD_Y=%d"
-    " -D LOCAL_SIZE_X=%d -D LOCAL_SIZE_Y=%d -D FILTER_WIDTH=%d -D FILTER_HEIGHT=%d"
-    " -D USE_TEXTURE=%d -D USE_LOCAL=%d -D PADDING=%d -D FAKE_PADDING=%d"
+    " -D LOCAL_SIZE_X=%d -D LOCAL_SIZE_Y=%d"
+    " -D USE_TEXTURE=%d -D USE_LOCAL=%d -D FAKE_PADDING=%d"
     " -D INTERLEAVED=%d -D UNROLL=%d",
     (int)pow(2,config[ELEMENTS_PER_THREAD_X]),
             (int)pow(2,config[ELEMENTS_PER_THREAD_Y]),
             (int)pow(2,config[LOCAL_SIZE_X]),
             (int)pow(2,config[LOCAL_SIZE_Y]),
-            FILTER_WIDTH,
-            FILTER_HEIGHT,
             config[USE_TEXTURE],
             config[USE_LOCAL],
-            PADDING,
             config[FAKE_PADDING],
             config[INTERLEAVED],
             config[UNROLL]
     );
+    append_problem_options(options_buffer);
     
-    kernel = buildKernel(kernelName, "convolve", options_buffer, context, device, &error);
+    return 1;
+}
+
+// If checker is given, the output is only read back if it is wrong, otherwise output_checked is set
+double convolve_ocl(float* input, float* output, float* filter, int width, int height, int padding, bench_session* session, int* config, kernel_timing* timing, device_checker* checker, int* output_checked){
+    
+    cl_device_id device = session->device;
+    cl_context context = session->context;
+    cl_command_queue queue = session->queue;
+    
+    int lwsx = pow(2, config[LOCAL_SIZE_X]);
+    int lwsy = pow(2, config[LOCAL_SIZE_Y]);
+    int eptx = pow(2, config[ELEMENTS_PER_THREAD_X]);
+    int epty = pow(2, config[ELEMENTS_PER_THREAD_Y]);
+    const size_t local_work_size[2] = {lwsx,lwsy};
+    const size_t global_work_size[2] = {(IMAGE_WIDTH/eptx),IMAGE_HEIGHT/epty};
+    
+    cl_int error;
+    cl_kernel kernel;
+    
+    char* kernelName = "convolution.cl";
+    char options_buffer [MAX_OPTIONS_LENGTH];
+    if(!convolution_options(session, config, options_buffer)){
+        return -1;
+    }
+    
+    kernel = build_session_kernel(session, kernelName, "convolve", options_buffer, &error);
     if(error != CL_SUCCESS){
         clReleaseKernel(kernel);
-        clReleaseCommandQueue(queue);
-        clReleaseContext(context);
         return -3.0;
     }
     
     
-    cl_mem filter_device = clCreateBuffer(context,
-                                          CL_MEM_READ_ONLY|CL_MEM_COPY_HOST_PTR,
-                                          FILTER_HEIGHT*FILTER_WIDTH*sizeof(float),
-                                          filter,
-                                          &error);
+    cl_mem filter_device = get_input_buffer(session,
+                                            CL_MEM_READ_ONLY,
+                                            FILTER_HEIGHT*FILTER_WIDTH*sizeof(float),
+                                            filter,
+                                            &error);
     
     int align = 4096/8;
     int pitch = ((width+2*PADDING)*sizeof(float)/align);
@@ -192,37 +232,20 @@ double convolve_ocl(float* input, float* output, float* filter, int width, int h
         cl_image_format image_format;
         image_format.image_channel_order = CL_R;
         image_format.image_channel_data_type = CL_FLOAT;
-        input_device = clCreateImage2D(context,
-                                       CL_MEM_READ_ONLY|CL_MEM_COPY_HOST_PTR,
-                                       &image_format,
-                                       width+2*PADDING,
-                                       height+2*PADDING,
-                                       (width+2*PADDING)*sizeof(float),
-                                       input,
-                                       &error);
-    }else{
-        input_device = clCreateBuffer(context,
-                                      CL_MEM_READ_WRITE,
-                                      pitched_size*sizeof(float),
-                                      NULL,
-                                      &error);
-        
-        error = clEnqueueWriteBufferRect(queue,
-                                         input_device,
-                                         CL_TRUE,
-                                         buffer_origin,
-                                         host_origin,
-                                         region,
-                                         pitch,
-                                         0,
-                                         0,
-                                         0,
+        input_device = get_input_image2d(session,
+                                         &image_format,
+                                         width+2*PADDING,
+                                         height+2*PADDING,
+                                         (width+2*PADDING)*sizeof(float),
                                          input,
-                                         0,
-                                         NULL,
-                                         NULL);
-        
-        
+                                         &error);
+    }else{
+        input_device = get_input_pitched_buffer(session,
+                                                region[0],
+                                                region[1],
+                                                pitch,
+                                                input,
+                                                &error);
     }
     cl_mem output_device = clCreateBuffer(context, CL_MEM_READ_WRITE, pitched_size*sizeof(float), NULL, &error);
     clError("Error allocating memory",error);
@@ -252,40 +275,16 @@ double convolve_ocl(float* input, float* output, float* filter, int width, int h
     
     
     
-    cl_event event;
     double time;
     if(invalid_work_group_size(device, kernel, 2, local_work_size, global_work_size)){
         time = -1.0;
     }
     else{
-        error = clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global_work_size, local_work_size, 0, NULL, &event);
-        clError("enqueue kernel", error);
-        if(error != CL_SUCCESS){
-            clReleaseKernel(kernel);
-            clReleaseCommandQueue(queue);
-            clReleaseContext(context);
-            clReleaseMemObject(filter_device);
-            clReleaseMemObject(input_device);
-            clReleaseMemObject(output_device);
-            //clWaitForEvents(1, &event);
-            //clReleaseEvent(event);
-            return -4.0;
+        time = time_kernel(queue, kernel, 2, global_work_size, local_work_size, timing);
+        if(time >= 0 && checker != NULL && count_wrong_elements(checker, session, output_device, padding*pitch_in_floats + padding, pitch_in_floats, 0) == 0){
+            *output_checked = 1;
         }
-        
-        error = clFinish(queue);
-        clError("Error waiting for kernel",error);
-        if(error != CL_SUCCESS){
-            return -1.0;
-        }
-        else{
-            cl_ulong start_time, end_time;
-            error = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start_time, NULL);
-            error = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end_time, NULL);
-            time = (double)(end_time-start_time)/1000.0;
-            clError("Error timing",error);
-            
-            
-            
+        else if(time >= 0){
             error = clEnqueueReadBufferRect(queue,
                                             output_device,
                                             CL_TRUE,
@@ -302,49 +301,33 @@ double convolve_ocl(float* input, float* output, float* filter, int width, int h
                                             NULL);
             clError("Error reading stuff", error);
         }
-        clWaitForEvents(1, &event);
-        clReleaseEvent(event);
     }
     
-    clReleaseMemObject(filter_device);
-    clReleaseMemObject(input_device);
     clReleaseMemObject(output_device);
     clReleaseKernel(kernel);
-    clReleaseCommandQueue(queue);
-    clReleaseContext(context);
     
     return time;
 }
 
 
 
-char* timestamp(){
-    time_t ltime; /* calendar time */
-    ltime=time(NULL); /* get current cal time */
-    char* ts = malloc(50);
-    sprintf(ts, "%s",asctime( localtime(&ltime) ) );
-    return ts;
-}
-
 int compare(float* a, float* b, int length){
     
     if(a == NULL || b == NULL){
         return 1;
     }
     
-    int n_errors = 0;
-    for(int i = 0; i < length; i++){
+    compare_result result;
+    compare_float(a, b, length, 1e-5, &result);
+    for(int k = 0; k < result.n_positions; k++){
+        int i = result.positions[k];
         float diff = fabs(a[i] - b[i]);
-        float rel_diff = diff/fmax(fabs(a[i]), fabs(b[i]));
-        if(rel_diff > 1e-5){
-            fprintf(stderr,"Error at: %d: %f %.12f, %f, %f\n", i, diff, rel_diff, a[i], b[i]);
-            n_errors++;
-        }
-        if(n_errors > 10){
-            break;
-        }
+        fprintf(stderr,"Error at: %d: %f %.12f, %f, %f\n", i, diff, diff/fmax(fabs(a[i]), fabs(b[i])), a[i], b[i]);
     }
-    return n_errors == 0;
+    if(result.n_errors > 0){
+        fprintf(stderr,"%d errors in total\n", result.n_errors);
+    }
+    return result.n_errors == 0;
 }
 
 
@@ -360,89 +343,78 @@ void print_comment(cl_device_id device, char** argv){
     printf("# %s\n", name);
     printf("\n");
 
-    printf("# IMAGE_HEIGHT %d\n", IMAGE_HEIGHT);
-    printf("# IMAGE_WIDTH %d\n", IMAGE_WIDTH);
-    printf("# PADDING %d\n", PADDING);
-    printf("# FILTER_WIDTH %d\n", FILTER_WIDTH);
-    printf("# FILTER_HEIGHT %d\n", FILTER_HEIGHT);
+    print_problem_parameters();
+    print_device_limits(device);
+    print_reference_time();
     printf("\n");
 }
 
-void run_on_configurations(int* configurations,
-                           int n_run_configurations,
-                           int n_total_configurations,
-                           float* padded_input,
-                           float* filter,
-                           float* padded_correct_output,
-                           char** argv){
-    
-    float* padded_output = (float*)malloc(sizeof(float)*(IMAGE_WIDTH+(2*PADDING))*(IMAGE_HEIGHT+(2*PADDING)));
-    float* output = (float*)calloc(sizeof(float),IMAGE_WIDTH*IMAGE_HEIGHT);
-    float* correct_output = NULL;
-    if(padded_correct_output){
-        correct_output = (float*)calloc(sizeof(float),IMAGE_WIDTH*IMAGE_HEIGHT);
-        copy_from_padded(correct_output, padded_correct_output, IMAGE_WIDTH, IMAGE_HEIGHT, PADDING);
+typedef struct{
+    float* padded_input;
+    float* filter;
+    float* padded_correct_output;
+    
+    float* padded_output;
+    float* output;
+    float* correct_output;
+    device_checker* checker;
+    int output_checked;
+} convolution_data;
+
+void* convolution_setup(bench_session* session, void* data){
+    convolution_data* state = (convolution_data*)malloc(sizeof(convolution_data));
+    *state = *(convolution_data*)data;
+    
+    state->padded_output = (float*)malloc(sizeof(float)*(IMAGE_WIDTH+(2*PADDING))*(IMAGE_HEIGHT+(2*PADDING)));
+    state->output = (float*)calloc(sizeof(float),IMAGE_WIDTH*IMAGE_HEIGHT);
+    state->correct_output = NULL;
+    if(state->padded_correct_output){
+        state->correct_output = (float*)calloc(sizeof(float),IMAGE_WIDTH*IMAGE_HEIGHT);
+        copy_from_padded(state->correct_output, state->padded_correct_output, IMAGE_WIDTH, IMAGE_HEIGHT, PADDING);
     }
+    state->checker = NULL;
+    if(state->correct_output && get_check_on_device()){
+        state->checker = create_device_checker(session, CHECK_FLOAT, state->correct_output, IMAGE_WIDTH, IMAGE_HEIGHT, 1, 1e-5);
+    }
+    return state;
+}
 
-    cl_device_id device = get_selected_device();
-
-    print_comment(device, argv);
-
-    int i = get_start_iteration();
-    int j = 0;
-    while(i < n_total_configurations && j < n_run_configurations){
-        int* temp_config = get_config_for_number(configurations[i], param_limits, n_parameters);
-      
-
-        fprintf(stderr, "%d\t", i);
-        for(int p = 0; p < n_parameters; p++){
-            fprintf(stderr, "%d ", temp_config[p]);
-        }
-        fprintf(stderr, "%s\n", timestamp());
-        
-
-
-        double time = convolve_ocl(padded_input, padded_output, filter,IMAGE_WIDTH, IMAGE_HEIGHT, PADDING, device, temp_config);
-        copy_from_padded(output, padded_output, IMAGE_WIDTH, IMAGE_HEIGHT, PADDING);
-
-
-        if(time > 0 && correct_output){
-            if(!compare(output, correct_output,IMAGE_HEIGHT*IMAGE_WIDTH)){
-                time = -2.0;
-            }
-        }
-
-
-        for(int p = 0; p < n_parameters; p++){
-            printf("%d ", temp_config[p]);
-        }
-        printf("%f\n", time);
-        
-        if(ignore_crashes_when_counting()){
-            j++;
-        }
-        else{
-            if(time > 0){
-                j++;
-            }
-        }
-        
-        i++;
-        free(temp_config);
+double convolution_run(bench_session* session, int* config, kernel_timing* timing, void* state){
+    convolution_data* d = (convolution_data*)state;
+    d->output_checked = 0;
+    double time = convolve_ocl(d->padded_input, d->padded_output, d->filter, IMAGE_WIDTH, IMAGE_HEIGHT, PADDING, session, config, timing, d->checker, &d->output_checked);
+    if(!d->output_checked){
+        copy_from_padded(d->output, d->padded_output, IMAGE_WIDTH, IMAGE_HEIGHT, PADDING);
+    }
+    return time;
+}
 
-        if(get_use_time_threshold() && time > get_time_threshold() && j >= get_min_second_stage()){
-            break;
-        }
-        if(get_use_time_threshold() && j >= get_max_second_stage()){
-            break;
-        }
+int convolution_verify(void* state){
+    convolution_data* d = (convolution_data*)state;
+    if(d->output_checked){
+        return 1;
     }
+    return compare(d->output, d->correct_output, IMAGE_HEIGHT*IMAGE_WIDTH);
+}
+
+void convolution_teardown(void* state){
+    convolution_data* d = (convolution_data*)state;
+    release_device_checker(d->checker);
+    free(d->padded_output);
+    free(d->output);
+    free(d->correct_output);
+    free(d);
 }
 
 
 int main(int argc, char** argv){
     
     parse_args(argc, argv);
+    set_problem_parameters(problem_parameters, n_problem_parameters);
+    if(PADDING < FILTER_WIDTH/2 || PADDING < FILTER_HEIGHT/2){
+        fprintf(stderr, "PADDING must be at least half of FILTER_WIDTH and FILTER_HEIGHT, exiting\n");
+        exit(-1);
+    }
 
     float* filter = create_filter(FILTER_WIDTH, FILTER_HEIGHT);
     
@@ -452,15 +424,31 @@ int main(int argc, char** argv){
     float* output = (float*)malloc(sizeof(float)*IMAGE_WIDTH*IMAGE_HEIGHT);
     float* padded_output = (float*)malloc(sizeof(float)*(IMAGE_WIDTH+2*PADDING)*(IMAGE_HEIGHT+2*PADDING));
     
-    /*
-    float* output_gold = (float*)malloc(sizeof(float)*IMAGE_WIDTH*IMAGE_HEIGHT);
-    float* padded_output_gold = (float*)malloc(sizeof(float)*(IMAGE_WIDTH+2*PADDING)*(IMAGE_HEIGHT+2*PADDING));
-    convolve_cpu(padded_input, padded_output_gold, filter, IMAGE_WIDTH, IMAGE_HEIGHT, PADDING);
-    */
     float* output_gold = NULL;
     float* padded_output_gold= NULL;
     if(get_correct_file() != NULL){
         output_gold = load_correct_float(get_correct_file(), IMAGE_WIDTH, IMAGE_HEIGHT);
+        if(output_gold == NULL){
+            exit(-1);
+        }
+    }
+    if(get_cpu_reference()){
+        float* reference_output = (float*)malloc(sizeof(float)*IMAGE_WIDTH*IMAGE_HEIGHT);
+        convolution_reference reference = {padded_input, filter, reference_output};
+        double time = time_reference(convolve_cpu, &reference);
+        if(output_gold == NULL){
+            output_gold = reference_output;
+        }
+        if(!perform_self_test() && get_output_file() != NULL){
+            printf("CPU reference time: %f\n", time);
+            printf("Writing output to %s\n", get_output_file());
+            if(write_image_raw_float(get_output_file(), reference_output, IMAGE_WIDTH, IMAGE_HEIGHT) != 0){
+                exit(-1);
+            }
+            return 0;
+        }
+    }
+    if(output_gold != NULL){
         padded_output_gold = copy_to_padded(output_gold, IMAGE_WIDTH, IMAGE_HEIGHT, PADDING);
     }
     else{
@@ -473,31 +461,38 @@ int main(int argc, char** argv){
     
     int n_run_configurations;
     int n_total_configurations;
-    int* configurations = create_configurations(param_limits, n_parameters, argc, argv, &n_run_configurations, &n_total_configurations);
+    configuration_order* configurations = create_configurations(param_limits, n_parameters, argc, argv, &n_run_configurations, &n_total_configurations);
     
     
     if(perform_self_test()){
         cl_device_id device = get_selected_device();
+        bench_session* session = create_session(device);
         
         print_comment(device, argv);
         
-        double time = convolve_ocl(padded_input, padded_output, filter, IMAGE_WIDTH, IMAGE_HEIGHT, PADDING, device, global_config);
+        kernel_timing timing = {0};
+        double time = convolve_ocl(padded_input, padded_output, filter, IMAGE_WIDTH, IMAGE_HEIGHT, PADDING, session, global_config, &timing, NULL, NULL);
         copy_from_padded(output, padded_output, IMAGE_WIDTH, IMAGE_HEIGHT, PADDING);
         if(compare(output, output_gold, (IMAGE_WIDTH)*(IMAGE_HEIGHT)))
             printf("Self test successfull, time: %f\n", time);
         if(get_output_file() != NULL){
             printf("Writing output to %s\n", get_output_file());
-            write_image_raw_float(get_output_file(), output, IMAGE_WIDTH, IMAGE_HEIGHT);
+            if(write_image_raw_float(get_output_file(), output, IMAGE_WIDTH, IMAGE_HEIGHT) != 0){
+                exit(-1);
+            }
         }
+        release_session(session);
     }
     else{
         
-        run_on_configurations(configurations,
+        convolution_data data = {padded_input, filter, padded_output_gold};
+        benchmark bench = {"convolution.cl", "convolve", "convolution.constraints", param_limits, param_names, n_parameters, convolution_options, print_comment, &data,
+                           convolution_setup, convolution_run, convolution_verify, convolution_teardown};
+        
+        run_on_configurations(&bench,
+                              configurations,
                               n_run_configurations,
                               n_total_configurations,
-                              padded_input,
-                              filter,
-                              padded_output_gold,
                               argv);
     }
     
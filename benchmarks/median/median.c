@@ -16,6 +16,15 @@
 #include "../common/configurations.h"
 #include "../common/io.h"
 #include "../common/parser.h"
+#include "../common/session.h"
+#include "../common/pipeline.h"
+#include "../common/timing.h"
+#include "../common/driver.h"
+#include "../common/compare.h"
+#include "../common/device_check.h"
+#include "../common/reference.h"
+#include "../common/problem.h"
+#include "../common/constraints.h"
 
 // Tuning parameters
 int LOCAL_SIZE_X =              0;
@@ -29,22 +38,21 @@ int LOCAL_FOR_SORT =    7;
 
 int global_config[] = {4,4,1,1,0,0,0,0};
 int param_limits[] =  {12,12,12,12,2,2,2,2}; //Or, rather, the limit + 1
+char* param_names[] = {"LOCAL_SIZE_X", "LOCAL_SIZE_Y", "ELEMENTS_PER_THREAD_X", "ELEMENTS_PER_THREAD_Y", "USE_TEXTURE", "USE_LOCAL", "ALGORITHM", "LOCAL_FOR_SORT"};
 int n_parameters = 8;
 
 int size_map[] = {1,2,4,6,8,12,16,24,32,48,64,128};
 
-//Problem parameters
-//const int IMAGE_WIDTH = 2048;
-//const int IMAGE_HEIGHT = 2048;
-//const int PADDING = 4;
-//const int FILTER_WIDTH = 5;
-//const int FILTER_HEIGHT = 5;
+//Problem parameters, can be set with -D
+int IMAGE_WIDTH = 3072;
+int IMAGE_HEIGHT = 3072;
+int PADDING = 2;
+int FILTER_WIDTH = 5;
+int FILTER_HEIGHT = 5;
 
-//#define IMAGE_WIDTH
-//#define IMAGE_HEIGHT
-//#define FILTER_WIDTH
-//#define FILTER_HEIGHT
-//#define PADDING
+problem_parameter problem_parameters[] = {{"IMAGE_HEIGHT", &IMAGE_HEIGHT}, {"IMAGE_WIDTH", &IMAGE_WIDTH}, {"PADDING", &PADDING},
+                                          {"FILTER_WIDTH", &FILTER_WIDTH}, {"FILTER_HEIGHT", &FILTER_HEIGHT}};
+int n_problem_parameters = 5;
 
 unsigned char* padded_input_g;
 unsigned char* filter_g;
@@ -86,38 +94,55 @@ int index(int x, int y, int width, int padding){
     return padding*(width+2*padding) + y*(width+2*padding) + x + padding;
 }
 
-void median_cpu(unsigned char* input, unsigned char* output, int width, int height, int padding){
-
-  for(int w = 0; w < width; w++){
-      for(int h = 0; h < height; h++){
-
-          int fw = floor(FILTER_WIDTH/2);
-          int fh = floor(FILTER_HEIGHT/2);
-
-          int to_sort[FILTER_WIDTH*FILTER_HEIGHT];
-          int to_sort_index = 0;
-
-          for(int i = -fw; i <= fw; i++){
-              for(int j = -fh; j <= fh; j++){
+// Number of pixels of a row that are sorted at once
+#define MEDIAN_BLOCK 256
+
+typedef struct{
+    unsigned char* padded_input;
+    unsigned char* output;
+} median_reference;
+
+// Computes rows [start, end) of the output. The neighbourhoods of a block of pixels are sorted together,
+// with a network of min and max over the block, until the middle element is in place.
+void median_rows(int start, int end, void* arg){
+    median_reference* r = (median_reference*)arg;
+    int fw = FILTER_WIDTH/2;
+    int fh = FILTER_HEIGHT/2;
+    const int n = FILTER_WIDTH*FILTER_HEIGHT;
+    unsigned char values[n][MEDIAN_BLOCK];
+
+    for(int h = start; h < end; h++){
+        for(int w = 0; w < IMAGE_WIDTH; w += MEDIAN_BLOCK){
+            int block = IMAGE_WIDTH - w < MEDIAN_BLOCK ? IMAGE_WIDTH - w : MEDIAN_BLOCK;
+
+            int k = 0;
+            for(int i = -fw; i <= fw; i++){
+                for(int j = -fh; j <= fh; j++){
+                    memcpy(values[k++], r->padded_input + index(w+i, h+j, IMAGE_WIDTH, PADDING), block);
+                }
+            }
 
+            for(int i = 0; i <= n/2; i++){
+                for(int j = i+1; j < n; j++){
+                    unsigned char* a = values[i];
+                    unsigned char* b = values[j];
+                    for(int x = 0; x < block; x++){
+                        unsigned char low = a[x] < b[x] ? a[x] : b[x];
+                        unsigned char high = a[x] < b[x] ? b[x] : a[x];
+                        a[x] = low;
+                        b[x] = high;
+                    }
+                }
+            }
 
-                  to_sort[to_sort_index] = input[index(w+i,h+j,width,padding)];
-                  to_sort_index++;
-              }
-          }
+            memcpy(r->output + h*IMAGE_WIDTH + w, values[n/2], block);
+        }
+    }
+}
 
-          for(int i = 0; i < FILTER_WIDTH*FILTER_HEIGHT; i++){
-              for(int j = i; j < FILTER_WIDTH*FILTER_HEIGHT; j++){
-                  if(to_sort[j] < to_sort[i]){
-                      int swap = to_sort[j];
-                      to_sort[j] = to_sort[i];
-                      to_sort[i] = swap;
-                  }
-              }
-          }
-          output[index(w,h,width,PADDING)] = to_sort[FILTER_WIDTH*FILTER_HEIGHT/2];
-      }
-  }
+// Computes the unpadded output on the CPU, in the format of the correct file
+void median_cpu(void* arg){
+    parallel_for(IMAGE_HEIGHT, median_rows, arg);
 }
 
 void print2d(float* buffer, int width, int height){
@@ -130,7 +155,7 @@ void print2d(float* buffer, int width, int height){
     printf("\n");
 }
 
-double median_ocl(unsigned char* input, unsigned char* output, int width, int height, int padding, cl_device_id device, int* config){
+int median_options(bench_session* session, int* config, char* options_buffer){
     
     int lwsx = size_map[config[LOCAL_SIZE_X]];
     int lwsy = size_map[config[LOCAL_SIZE_Y]];
@@ -146,48 +171,64 @@ double median_ocl(unsigned char* input, unsigned char* output, int width, int he
         gwsy = (gwsy/lwsy+ 1)*lwsy;
     }
     const size_t global_work_size[2] = {gwsx,gwsy};
-    //printf("%d, %d, %d, %d, %d, %d\n", lwsx, lwsy, eptx, epty, gwsx, gwsy);
     
-    if(invalid_work_group_size_static(device, 2, local_work_size, global_work_size)){
-        return -1;
+    if(invalid_work_group_size_static(session->device, 2, local_work_size, global_work_size)){
+        return 0;
     }
     
-    cl_int error;
-    cl_context context;
-    cl_command_queue queue;
-    cl_kernel kernel;
-    
-    
-    context = clCreateContext(NULL, 1, &device, NULL, NULL, &error);
-    clError("Couldn't get context", error);
-    
-    queue = clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &error);
-    clError("Couldn't create command queue", error);
-    
-    char* kernelName = "median.cl";
-    char options_buffer [300];
     sprintf(options_buffer, "-D ELEMENTS_PER_THREAD_X=%d -D ELEMENTS_PER_THREAD_Y=%d"
-    " -D LOCAL_SIZE_X=%d -D LOCAL_SIZE_Y=%d -D FILTER_WIDTH=%d -D FILTER_HEIGHT=%d"
-    " -D USE_TEXTURE=%d -D USE_LOCAL=%d -D PADDING=%d "
+    " -D LOCAL_SIZE_X=%d -D LOCAL_SIZE_Y=%d"
+    " -D USE_TEXTURE=%d -D USE_LOCAL=%d"
     " -D ALGORITHM=%d -D LOCAL_FOR_SORT=%d",
             size_map[config[ELEMENTS_PER_THREAD_X]],
             size_map[config[ELEMENTS_PER_THREAD_Y]],
             size_map[config[LOCAL_SIZE_X]],
             size_map[config[LOCAL_SIZE_Y]],
-            FILTER_WIDTH,
-            FILTER_HEIGHT,
             config[USE_TEXTURE],
             config[USE_LOCAL],
-            PADDING,
             config[ALGORITHM],
             config[LOCAL_FOR_SORT]
     );
+    append_problem_options(options_buffer);
+    
+    return 1;
+}
+
+// If checker is given, the output is only read back if it is wrong, otherwise output_checked is set
+double median_ocl(unsigned char* input, unsigned char* output, int width, int height, int padding, bench_session* session, int* config, kernel_timing* timing, device_checker* checker, int* output_checked){
+    
+    cl_device_id device = session->device;
+    cl_context context = session->context;
+    cl_command_queue queue = session->queue;
+    
+    int lwsx = size_map[config[LOCAL_SIZE_X]];
+    int lwsy = size_map[config[LOCAL_SIZE_Y]];
+    int eptx = size_map[config[ELEMENTS_PER_THREAD_X]];
+    int epty = size_map[config[ELEMENTS_PER_THREAD_Y]];
+    const size_t local_work_size[2] = {lwsx,lwsy};
+    int gwsx = (IMAGE_WIDTH/eptx);
+    int gwsy = (IMAGE_HEIGHT/epty);
+    if(gwsx % lwsx != 0){
+        gwsx = (gwsx/lwsx + 1)*lwsx;
+    }
+    if(gwsy % lwsy != 0){
+        gwsy = (gwsy/lwsy+ 1)*lwsy;
+    }
+    const size_t global_work_size[2] = {gwsx,gwsy};
+    //printf("%d, %d, %d, %d, %d, %d\n", lwsx, lwsy, eptx, epty, gwsx, gwsy);
     
-    kernel = buildKernel(kernelName, "median", options_buffer, context, device, &error);
+    cl_int error;
+    cl_kernel kernel;
+    
+    char* kernelName = "median.cl";
+    char options_buffer[MAX_OPTIONS_LENGTH];
+    if(!median_options(session, config, options_buffer)){
+        return -1;
+    }
+    
+    kernel = build_session_kernel(session, kernelName, "median", options_buffer, &error);
     if(error != CL_SUCCESS){
         clReleaseKernel(kernel);
-        clReleaseCommandQueue(queue);
-        clReleaseContext(context);
         return -3.0;
     }
     
@@ -206,37 +247,20 @@ double median_ocl(unsigned char* input, unsigned char* output, int width, int he
         cl_image_format image_format;
         image_format.image_channel_order = CL_R;
         image_format.image_channel_data_type = CL_UNSIGNED_INT8;
-        input_device = clCreateImage2D(context,
-                                       CL_MEM_READ_ONLY|CL_MEM_COPY_HOST_PTR,
-                                       &image_format,
-                                       width+2*PADDING,
-                                       height+2*PADDING,
-                                       (width+2*PADDING)*sizeof(unsigned char),
-                                       input,
-                                       &error);
-    }else{
-        input_device = clCreateBuffer(context,
-                                      CL_MEM_READ_WRITE,
-                                      pitched_size*sizeof(unsigned char),
-                                      NULL,
-                                      &error);
-        
-        error = clEnqueueWriteBufferRect(queue,
-                                         input_device,
-                                         CL_TRUE,
-                                         buffer_origin,
-                                         host_origin,
-                                         region,
-                                         pitch,
-                                         0,
-                                         0,
-                                         0,
+        input_device = get_input_image2d(session,
+                                         &image_format,
+                                         width+2*PADDING,
+                                         height+2*PADDING,
+                                         (width+2*PADDING)*sizeof(unsigned char),
                                          input,
-                                         0,
-                                         NULL,
-                                         NULL);
-        
-        
+                                         &error);
+    }else{
+        input_device = get_input_pitched_buffer(session,
+                                                region[0],
+                                                region[1],
+                                                pitch,
+                                                input,
+                                                &error);
     }
     cl_mem output_device = clCreateBuffer(context, CL_MEM_READ_WRITE, pitched_size*sizeof(unsigned char), NULL, &error);
     clError("Error allocating memory",error);
@@ -261,39 +285,16 @@ double median_ocl(unsigned char* input, unsigned char* output, int width, int he
     error = clSetKernelArg(kernel, 5, sizeof(cl_int), &pitch_in_floats);
     clError("Error setting kernel argument 6",error);
     
-    cl_event event;
     double time;
     if(invalid_work_group_size(device, kernel, 2, local_work_size, global_work_size)){
         time = -1.0;
     }
     else{
-        error = clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global_work_size, local_work_size, 0, NULL, &event);
-        clError("enqueue kernel", error);
-        if(error != CL_SUCCESS){
-            clReleaseKernel(kernel);
-            clReleaseCommandQueue(queue);
-            clReleaseContext(context);
-            clReleaseMemObject(input_device);
-            clReleaseMemObject(output_device);
-            //clWaitForEvents(1, &event);
-            //clReleaseEvent(event);
-            return -4.0;
-        }
-        
-        error = clFinish(queue);
-        clError("Error waiting for kernel",error);
-        if(error != CL_SUCCESS){
-            return -1.0;
+        time = time_kernel(queue, kernel, 2, global_work_size, local_work_size, timing);
+        if(time >= 0 && checker != NULL && count_wrong_elements(checker, session, output_device, padding*pitch + padding, pitch, 0) == 0){
+            *output_checked = 1;
         }
-        else{
-            cl_ulong start_time, end_time;
-            error = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start_time, NULL);
-            error = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end_time, NULL);
-            time = (double)(end_time-start_time)/1000.0;
-            clError("Error timing",error);
-            
-            
-            
+        else if(time >= 0){
             error = clEnqueueReadBufferRect(queue,
                                             output_device,
                                             CL_TRUE,
@@ -310,48 +311,32 @@ double median_ocl(unsigned char* input, unsigned char* output, int width, int he
                                             NULL);
             clError("Error reading stuff", error);
         }
-        clWaitForEvents(1, &event);
-        clReleaseEvent(event);
     }
     
-    clReleaseMemObject(input_device);
     clReleaseMemObject(output_device);
     clReleaseKernel(kernel);
-    clReleaseCommandQueue(queue);
-    clReleaseContext(context);
     
     return time;
 }
 
 
 
-char* timestamp(){
-    time_t ltime; /* calendar time */
-    ltime=time(NULL); /* get current cal time */
-    char* ts = malloc(50);
-    sprintf(ts, "%s",asctime( localtime(&ltime) ) );
-    return ts;
-}
-
 int compare(unsigned char * a, unsigned char * b, int length){
     
     if(a == NULL || b == NULL){
         return 1;
     }
     
-    int n_errors = 0;
-    for(int i = 0; i < length; i++){
-        int diff = fabs(a[i] - b[i]);
-        float rel_diff = diff/fmax(fabs(a[i]), fabs(b[i]));
-        if(rel_diff > 1e-5){
-            fprintf(stderr,"Error at: %d: %d %.12f, %u, %u\n", i, diff, rel_diff, a[i], b[i]);
-            n_errors++;
-        }
-        if(n_errors > 10){
-            break;
-        }
+    compare_result result;
+    compare_uchar(a, b, length, 0, &result);
+    for(int k = 0; k < result.n_positions; k++){
+        int i = result.positions[k];
+        fprintf(stderr,"Error at: %d: %d, %u, %u\n", i, abs(a[i] - b[i]), a[i], b[i]);
+    }
+    if(result.n_errors > 0){
+        fprintf(stderr,"%d errors in total\n", result.n_errors);
     }
-    return n_errors == 0;
+    return result.n_errors == 0;
 }
 
 
@@ -367,91 +352,82 @@ void print_comment(cl_device_id device, char** argv){
     printf("# %s\n", name);
     printf("\n");
 
-    printf("# IMAGE_HEIGHT %d\n", IMAGE_HEIGHT);
-    printf("# IMAGE_WIDTH %d\n", IMAGE_WIDTH);
-    printf("# PADDING %d\n", PADDING);
-    printf("# FILTER_WIDTH %d\n", FILTER_WIDTH);
-    printf("# FILTER_HEIGHT %d\n", FILTER_HEIGHT);
+    print_problem_parameters();
+    print_device_limits(device);
+    print_reference_time();
     printf("\n");
 }
 
-void run_on_configurations(int* configurations,
-                           int n_run_configurations,
-                           int n_total_configurations,
-                           unsigned char* padded_input,
-                           unsigned char* padded_correct_output,
-                           char** argv){
-    
-    unsigned char* padded_output = (unsigned char*)malloc(sizeof(unsigned char)*(IMAGE_WIDTH+(2*PADDING))*(IMAGE_HEIGHT+(2*PADDING)));
-    unsigned char* output = (unsigned char*)calloc(sizeof(unsigned char),IMAGE_WIDTH*IMAGE_HEIGHT);
-    unsigned char* correct_output = NULL;
-    if(padded_correct_output){
-        correct_output = (unsigned char*)calloc(sizeof(unsigned char),IMAGE_WIDTH*IMAGE_HEIGHT);
-        copy_from_padded(correct_output, padded_correct_output, IMAGE_WIDTH, IMAGE_HEIGHT, PADDING);
+typedef struct{
+    unsigned char* padded_input;
+    unsigned char* padded_correct_output;
+    
+    unsigned char* padded_output;
+    unsigned char* output;
+    unsigned char* correct_output;
+    device_checker* checker;
+    int output_checked;
+} median_data;
+
+void* median_setup(bench_session* session, void* data){
+    median_data* state = (median_data*)malloc(sizeof(median_data));
+    *state = *(median_data*)data;
+    
+    state->padded_output = (unsigned char*)malloc(sizeof(unsigned char)*(IMAGE_WIDTH+(2*PADDING))*(IMAGE_HEIGHT+(2*PADDING)));
+    state->output = (unsigned char*)calloc(sizeof(unsigned char),IMAGE_WIDTH*IMAGE_HEIGHT);
+    state->correct_output = NULL;
+    if(state->padded_correct_output){
+        state->correct_output = (unsigned char*)calloc(sizeof(unsigned char),IMAGE_WIDTH*IMAGE_HEIGHT);
+        copy_from_padded(state->correct_output, state->padded_correct_output, IMAGE_WIDTH, IMAGE_HEIGHT, PADDING);
     }
+    state->checker = NULL;
+    if(state->correct_output && get_check_on_device()){
+        state->checker = create_device_checker(session, CHECK_UCHAR, state->correct_output, IMAGE_WIDTH, IMAGE_HEIGHT, 1, 0);
+    }
+    return state;
+}
 
-    cl_device_id device = get_selected_device();
-
-    print_comment(device, argv);
-
-    int i = get_start_iteration();
-    int j = 0;
-    while(i < n_total_configurations && j < n_run_configurations){
-        int* temp_config = get_config_for_number(configurations[i], param_limits, n_parameters);
-      
-
-        fprintf(stderr, "%d\t", i);
-        for(int p = 0; p < n_parameters; p++){
-            fprintf(stderr, "%d ", temp_config[p]);
-        }
-        fprintf(stderr, "%s\n", timestamp());
-        
-
-
-        double time = median_ocl(padded_input, padded_output, IMAGE_WIDTH, IMAGE_HEIGHT, PADDING, device, temp_config);
-        copy_from_padded(output, padded_output, IMAGE_WIDTH, IMAGE_HEIGHT, PADDING);
-
-
-        if(time > 0 && correct_output){
-            if(!compare(output, correct_output,IMAGE_HEIGHT*IMAGE_WIDTH)){
-                time = -2.0;
-            }
-        }
+double median_run(bench_session* session, int* config, kernel_timing* timing, void* state){
+    median_data* d = (median_data*)state;
+    d->output_checked = 0;
+    double time = median_ocl(d->padded_input, d->padded_output, IMAGE_WIDTH, IMAGE_HEIGHT, PADDING, session, config, timing, d->checker, &d->output_checked);
+    if(!d->output_checked){
+        copy_from_padded(d->output, d->padded_output, IMAGE_WIDTH, IMAGE_HEIGHT, PADDING);
+    }
+    return time;
+}
 
-        if(get_print_problem_sizes()){
-            printf("%d ", IMAGE_WIDTH);
-            printf("%d ", IMAGE_HEIGHT);
-            printf("%d ", FILTER_WIDTH);
-            printf("%d ", FILTER_HEIGHT);
-        }
-        for(int p = 0; p < n_parameters; p++){
-            printf("%d ", temp_config[p]);
-        }
-        printf("%f\n", time);
-        
-        if(ignore_crashes_when_counting()){
-            j++;
-        }
-        else{
-            if(time > 0){
-                j++;
-            }
-        }
-        
-        i++;
-        free(temp_config);
+int median_verify(void* state){
+    median_data* d = (median_data*)state;
+    if(d->output_checked){
+        return 1;
     }
+    return compare(d->output, d->correct_output, IMAGE_HEIGHT*IMAGE_WIDTH);
+}
+
+void median_teardown(void* state){
+    median_data* d = (median_data*)state;
+    release_device_checker(d->checker);
+    free(d->padded_output);
+    free(d->output);
+    free(d->correct_output);
+    free(d);
 }
 
 
 int main(int argc, char** argv){
 
+    parse_args(argc, argv);
+    set_problem_parameters(problem_parameters, n_problem_parameters);
+
     if(FILTER_WIDTH*FILTER_HEIGHT > 256){
         fprintf(stderr, "ERRORS!! histogram size\n");
         exit(-1);
     }
-    
-    parse_args(argc, argv);
+    if(PADDING < FILTER_WIDTH/2 || PADDING < FILTER_HEIGHT/2){
+        fprintf(stderr, "PADDING must be at least half of FILTER_WIDTH and FILTER_HEIGHT, exiting\n");
+        exit(-1);
+    }
 
     unsigned char* input = create_input(IMAGE_WIDTH, IMAGE_HEIGHT);
     unsigned char* padded_input = copy_to_padded(input, IMAGE_WIDTH, IMAGE_HEIGHT, PADDING);
@@ -465,6 +441,27 @@ int main(int argc, char** argv){
     
     if(get_correct_file() != NULL){
         output_gold = load_raw_buffer(get_correct_file(), IMAGE_WIDTH*IMAGE_HEIGHT);
+        if(output_gold == NULL){
+            exit(-1);
+        }
+    }
+    if(get_cpu_reference()){
+        unsigned char* reference_output = (unsigned char*)malloc(sizeof(unsigned char)*IMAGE_WIDTH*IMAGE_HEIGHT);
+        median_reference reference = {padded_input, reference_output};
+        double time = time_reference(median_cpu, &reference);
+        if(output_gold == NULL){
+            output_gold = reference_output;
+        }
+        if(!perform_self_test() && get_output_file() != NULL){
+            printf("CPU reference time: %f\n", time);
+            printf("Writing output to %s\n", get_output_file());
+            if(write_raw_buffer(get_output_file(), reference_output, IMAGE_WIDTH*IMAGE_HEIGHT) != 0){
+                exit(-1);
+            }
+            return 0;
+        }
+    }
+    if(output_gold != NULL){
         padded_output_gold = copy_to_padded(output_gold, IMAGE_WIDTH, IMAGE_HEIGHT, PADDING);
     }
     else{
@@ -473,30 +470,38 @@ int main(int argc, char** argv){
     
     int n_run_configurations;
     int n_total_configurations;
-    int* configurations = create_configurations(param_limits, n_parameters, argc, argv, &n_run_configurations, &n_total_configurations);
+    configuration_order* configurations = create_configurations(param_limits, n_parameters, argc, argv, &n_run_configurations, &n_total_configurations);
     
     
     if(perform_self_test()){
         cl_device_id device = get_selected_device();
+        bench_session* session = create_session(device);
         
         print_comment(device, argv);
         
-        double time = median_ocl(padded_input, padded_output, IMAGE_WIDTH, IMAGE_HEIGHT, PADDING, device, global_config);
+        kernel_timing timing = {0};
+        double time = median_ocl(padded_input, padded_output, IMAGE_WIDTH, IMAGE_HEIGHT, PADDING, session, global_config, &timing, NULL, NULL);
         copy_from_padded(output, padded_output, IMAGE_WIDTH, IMAGE_HEIGHT, PADDING);
         if(compare(output, output_gold, (IMAGE_WIDTH)*(IMAGE_HEIGHT)))
             printf("Self test successfull, time: %f\n", time);
         if(get_output_file() != NULL){
             printf("Writing output to %s\n", get_output_file());
-            write_raw_buffer(get_output_file(), output, IMAGE_WIDTH * IMAGE_HEIGHT);
+            if(write_raw_buffer(get_output_file(), output, IMAGE_WIDTH * IMAGE_HEIGHT) != 0){
+                exit(-1);
+            }
         }
+        release_session(session);
     }
     else{
         
-        run_on_configurations(configurations,
+        median_data data = {padded_input, padded_output_gold};
+        benchmark bench = {"median.cl", "median", "median.constraints", param_limits, param_names, n_parameters, median_options, print_comment, &data,
+                           median_setup, median_run, median_verify, median_teardown};
+        
+        run_on_configurations(&bench,
+                              configurations,
                               n_run_configurations,
                               n_total_configurations,
-                              padded_input,
-                              padded_output_gold,
                               argv);
     }
     
@@ -18,13 +18,25 @@
 #include "../common/configurations.h"
 #include "../common/io.h"
 #include "../common/parser.h"
+#include "../common/session.h"
+#include "../common/pipeline.h"
+#include "../common/timing.h"
+#include "../common/driver.h"
+#include "../common/compare.h"
+#include "../common/reference.h"
+#include "../common/problem.h"
+#include "../common/constraints.h"
 
-//Problem parameters
-#define IMAGE_HEIGHT (512)
-#define IMAGE_WIDTH (512)
-#define DATA_DIM 128
-#define TRANSFER_FUNC_SIZE 128
-#define USE_TRILINEAR 1
+//Problem parameters, can be set with -D
+int IMAGE_HEIGHT = 512;
+int IMAGE_WIDTH = 512;
+int DATA_DIM = 128;
+int TRANSFER_FUNC_SIZE = 128;
+int USE_TRILINEAR = 1;
+
+problem_parameter problem_parameters[] = {{"IMAGE_HEIGHT", &IMAGE_HEIGHT}, {"IMAGE_WIDTH", &IMAGE_WIDTH}, {"DATA_DIM", &DATA_DIM},
+                                          {"TRANSFER_FUNC_SIZE", &TRANSFER_FUNC_SIZE}, {"USE_TRILINEAR", &USE_TRILINEAR}};
+int n_problem_parameters = 5;
 
 //Tuning parameters
 
@@ -41,6 +53,7 @@ int UNROLL_FACTOR =             9;
 
 int global_config[] = {3,3,1,1,1,1,0,0,0,0};
 int param_limits[] = {8,8,8,8,2,2,2,2,2,5}; //Or, rather, the limit + 1
+char* param_names[] = {"LOCAL_SIZE_X", "LOCAL_SIZE_Y", "ELEMENTS_PER_THREAD_X", "ELEMENTS_PER_THREAD_Y", "USE_TEXTURE_DATA", "USE_TEXTURE_TRANSFER", "USE_SHARED_TRANSFER", "USE_CONSTANT_TRANSFER", "INTERLEAVED", "UNROLL_FACTOR"};
 int n_parameters = 10;
 
 
@@ -146,37 +159,17 @@ int check_image(int* correct, int* image){
         return 1;
     }
     
-    int n_errors = 0;
-    
-    for(int i = 0; i < IMAGE_WIDTH*IMAGE_HEIGHT; i++){
-        int ri = (image[i] & 0xFF000000) >> 24;
-        int gi = (image[i] & 0x00FF0000) >> 16;
-        int bi = (image[i] & 0x0000FF00) >> 8;
-        int ai = (image[i] & 0x000000FF);
-        
-        int rc = (correct[i] & 0xFF000000) >> 24;
-        int gc = (correct[i] & 0x00FF0000) >> 16;
-        int bc = (correct[i] & 0x0000FF00) >> 8;
-        int ac = (correct[i] & 0x000000FF);
-        
-        int dr = abs(ri - rc);
-        int dg = abs(gi - gc);
-        int db = abs(bi - bc);
-        int da = abs(ai - ac);
-        
-        if(dr > 1 || dg > 1 || db > 1 || da > 1){
-            if(n_errors < 10){
-                fprintf(stderr,"Error at : %d, expected %x, found %x\n", i, correct[i], image[i]);
-                
-            }
-            n_errors++;
-        }
+    compare_result result;
+    compare_rgba(image, correct, IMAGE_WIDTH*IMAGE_HEIGHT, 1, &result);
+    for(int k = 0; k < result.n_positions; k++){
+        int i = result.positions[k];
+        fprintf(stderr,"Error at : %d, expected %x, found %x\n", i, correct[i], image[i]);
     }
-    if(n_errors > 0){
-        fprintf(stderr,"%d errors in total\n", n_errors-10);
+    if(result.n_errors > 0){
+        fprintf(stderr,"%d errors in total\n", result.n_errors);
     }
     
-    return n_errors == 0;
+    return result.n_errors == 0;
 }
 
 
@@ -201,12 +194,181 @@ cl_float4* create_transfer(){
 }
 
 
-char* timestamp(){
-    time_t ltime;
-    ltime=time(NULL);
-    char* ts = malloc(50);
-    sprintf(ts, "%s",asctime( localtime(&ltime) ) );
-    return ts;
+// Port of the kernel for the reference, with the data in a buffer and without unrolling
+
+typedef struct{
+    float x;
+    float y;
+    float z;
+} float3;
+
+float3 make_float3(float x, float y, float z){
+    float3 a = {x, y, z};
+    return a;
+}
+
+float3 add3(float3 a, float3 b){
+    return make_float3(a.x + b.x, a.y + b.y, a.z + b.z);
+}
+
+float3 sub3(float3 a, float3 b){
+    return make_float3(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+float3 scale3(float3 a, float b){
+    return make_float3(a.x * b, a.y * b, a.z * b);
+}
+
+float3 cross3(float3 a, float3 b){
+    return make_float3(a.y*b.z - a.z*b.y, a.z*b.x - a.x*b.z, a.x*b.y - a.y*b.x);
+}
+
+float3 normalize3(float3 a){
+    return scale3(a, 1.0f/sqrtf(a.x*a.x + a.y*a.y + a.z*a.z));
+}
+
+int inside_float(float3 pos){
+    int x = (pos.x >= 0.5 && pos.x < DATA_DIM-0.5);
+    int y = (pos.y >= 0.5 && pos.y < DATA_DIM-0.5);
+    int z = (pos.z >= 0.5 && pos.z < DATA_DIM-0.5);
+    
+    return x && y && z;
+}
+
+int data_index(int z, int y, int x){
+    return z * DATA_DIM*DATA_DIM + y*DATA_DIM + x;
+}
+
+float value_at(float3 pos, float* data){
+    if(!inside_float(pos)){
+        return 0;
+    }
+    
+    int x = floor(pos.x-0.5);
+    int y = floor(pos.y-0.5);
+    int z = floor(pos.z-0.5);
+    
+    if(!USE_TRILINEAR){
+        return data[data_index(z,y,x)];
+    }
+    
+    int x_u = x+1;
+    int y_u = y+1;
+    int z_u = z+1;
+    
+    float rx = pos.x - 0.5 - x;
+    float ry = pos.y - 0.5 - y;
+    float rz = pos.z - 0.5 - z;
+    
+    return (1-rx) * (1-ry) * (1-rz) * data[data_index(z,y,x)] +
+           (rx) * (1-ry) * (1-rz) * data[data_index(z,y,x_u)] +
+           (1-rx) * (ry) * (1-rz) * data[data_index(z,y_u,x)] +
+           (rx) * (ry) * (1-rz) * data[data_index(z,y_u,x_u)] +
+           (1-rx) * (1-ry) * (rz) * data[data_index(z_u,y,x)] +
+           (rx) * (1-ry) * (rz) * data[data_index(z_u,y,x_u)] +
+           (1-rx) * (ry) * (rz) * data[data_index(z_u,y_u,x)] +
+           (rx) * (ry) * (rz) * data[data_index(z_u,y_u,x_u)];
+}
+
+float4 color_at(float3 pos, float* data, cl_float4* transfer){
+    float v = value_at(pos, data);
+    float4 c = {0, 0, 0, 0};
+    if(v == 0 || v > 1.0f){
+        return c;
+    }
+    int i = (int)(v * (float)(TRANSFER_FUNC_SIZE-1));
+    
+    c.x = transfer[i].s[0];
+    c.y = transfer[i].s[1];
+    c.z = transfer[i].s[2];
+    c.w = transfer[i].s[3];
+    return c;
+}
+
+int rgba_to_int(float4 color){
+    color.x *= color.w;
+    color.y *= color.w;
+    color.z *= color.w;
+    
+    color.x = color.x > 1.0 ? 1.0 : color.x;
+    color.y = color.y > 1.0 ? 1.0 : color.y;
+    color.z = color.z > 1.0 ? 1.0 : color.z;
+    
+    return ((unsigned int)(color.w*255)<<24) | ((unsigned int)(color.z*255)<<16) | ((unsigned int)(color.y*255)<<8) | (unsigned int)(color.x*255);
+}
+
+void intersect_box(float3 ray, float3 camera, float3 boxmin, float3 boxmax, float* tnear, float* tfar){
+    float3 inv_ray = make_float3(1.0f/ray.x, 1.0f/ray.y, 1.0f/ray.z);
+    float3 tbot = make_float3(inv_ray.x*(boxmin.x - camera.x), inv_ray.y*(boxmin.y - camera.y), inv_ray.z*(boxmin.z - camera.z));
+    float3 ttop = make_float3(inv_ray.x*(boxmax.x - camera.x), inv_ray.y*(boxmax.y - camera.y), inv_ray.z*(boxmax.z - camera.z));
+    
+    float3 tmin = make_float3(fminf(ttop.x, tbot.x), fminf(ttop.y, tbot.y), fminf(ttop.z, tbot.z));
+    float3 tmax = make_float3(fmaxf(ttop.x, tbot.x), fmaxf(ttop.y, tbot.y), fmaxf(ttop.z, tbot.z));
+    
+    *tnear = fmaxf(fmaxf(tmin.x, tmin.y), fmaxf(tmin.x, tmin.z));
+    *tfar = fminf(fminf(tmax.x, tmax.y), fminf(tmax.x, tmax.z));
+}
+
+typedef struct{
+    float* data;
+    cl_float4* transfer;
+    int* image;
+} raycast_reference;
+
+// Computes rows [start, end) of the image, one ray per pixel
+void raycast_rows(int start, int end, void* arg){
+    raycast_reference* r = (raycast_reference*)arg;
+    
+    float3 camera = make_float3(500, 500, 500);
+    float3 forward = make_float3(-1, -1, -1);
+    float3 z_axis = make_float3(0, 0, 1);
+    
+    float3 right = cross3(forward, z_axis);
+    float3 up = cross3(right, forward);
+    
+    forward = normalize3(forward);
+    right = normalize3(right);
+    up = normalize3(up);
+    
+    float fov = 3.14/6;
+    float pixel_width = tanf(fov/2.0f)/(IMAGE_WIDTH/2);
+    float pixel_height = pixel_width;
+    float step_size = 0.5;
+    float3 screen_center = add3(camera, forward);
+    
+    for(int y = start - IMAGE_HEIGHT/2; y < end - IMAGE_HEIGHT/2; y++){
+        for(int x = -IMAGE_WIDTH/2; x < IMAGE_WIDTH/2; x++){
+            float3 ray = add3(add3(screen_center, scale3(scale3(right, x), pixel_width)), scale3(scale3(up, y), pixel_height));
+            ray = normalize3(sub3(ray, camera));
+            
+            float near, far;
+            intersect_box(ray, camera, make_float3(0, 0, 0), make_float3(DATA_DIM, DATA_DIM, DATA_DIM), &near, &far);
+            float3 pos = add3(camera, scale3(ray, near));
+            
+            float i = 0;
+            float4 color = {0, 0, 0, 0};
+            while(color.w < 1.0 && i < (far-near)){
+                i += step_size;
+                pos = add3(pos, scale3(ray, step_size));
+                float4 c = color_at(pos, r->data, r->transfer);
+                c.x *= c.w;
+                c.y *= c.w;
+                c.z *= c.w;
+                float remaining = 1.0f - color.w;
+                color.x += remaining*c.x;
+                color.y += remaining*c.y;
+                color.z += remaining*c.z;
+                color.w += remaining*c.w;
+            }
+            
+            r->image[(y+(IMAGE_HEIGHT/2)) * IMAGE_WIDTH + (x+(IMAGE_WIDTH/2))] = rgba_to_int(color);
+        }
+    }
+}
+
+// Computes the image on the CPU, in the format of the correct file
+void raycast_cpu(void* arg){
+    parallel_for(IMAGE_HEIGHT, raycast_rows, arg);
 }
 
 
@@ -222,16 +384,14 @@ void print_comment(cl_device_id device, char** argv){
     printf("# %s\n", name);
     printf("\n");
     
-    printf("# IMAGE_HEIGHT %d\n", IMAGE_HEIGHT);
-    printf("# IMAGE_WIDTH %d\n", IMAGE_WIDTH);
-    printf("# DATA_DIM %d\n", DATA_DIM);
-    printf("# TRANSFER_FUNC_SIZE %d\n", TRANSFER_FUNC_SIZE);
-    printf("# USE_TRILINEAR %d\n", USE_TRILINEAR);
+    print_problem_parameters();
+    print_device_limits(device);
+    print_reference_time();
     printf("\n");
 }
 
 
-double raycast_ocl(float* data_host, cl_float4* transfer_host, int* image_host, cl_device_id device, int* config){
+int raycast_options(bench_session* session, int* config, char* options_buffer){
     
     int lwsx = pow(2, config[LOCAL_SIZE_X]);
     int lwsy = pow(2, config[LOCAL_SIZE_Y]);
@@ -240,40 +400,46 @@ double raycast_ocl(float* data_host, cl_float4* transfer_host, int* image_host,
     const size_t local_work_size[2] = {lwsx,lwsy};
     const size_t global_work_size[2] = {(IMAGE_WIDTH/eptx),IMAGE_HEIGHT/epty};
     
-    if(invalid_work_group_size_static(device, 2, local_work_size, global_work_size)){
-        return -1;
+    if(invalid_work_group_size_static(session->device, 2, local_work_size, global_work_size)){
+        return 0;
     }
     
-    char options_buffer [300];
-    cl_int error;
-    
-    cl_context context = clCreateContext(NULL, 1, &device, NULL, NULL, &error);
-    clError("Couldn't get context", error);
-    
-    cl_command_queue queue = clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &error);
-    clError("Couldn't create command queue", error);
-    
-    
-    sprintf(options_buffer, "-D DATA_DIM=%d -D IMAGE_HEIGHT=%d -D IMAGE_WIDTH=%d -D TRANSFER_FUNC_SIZE=%d -D ELEMENTS_PER_THREAD_X=%d -D ELEMENTS_PER_THREAD_Y=%d -D USE_TEXTURE_DATA=%d -D USE_TEXTURE_TRANSFER=%d -D USE_TRILINEAR=%d -D INTERLEAVED=%d -D USE_SHARED_TRANSFER=%d -D USE_CONSTANT_TRANSFER=%d -D UNROLL_FACTOR=%d",
-            DATA_DIM,
-            IMAGE_HEIGHT,
-            IMAGE_WIDTH,
-            TRANSFER_FUNC_SIZE,
+    sprintf(options_buffer, "-D ELEMENTS_PER_THREAD_X=%d -D ELEMENTS_PER_THREAD_Y=%d -D USE_TEXTURE_DATA=%d -D USE_TEXTURE_TRANSFER=%d -D INTERLEAVED=%d -D USE_SHARED_TRANSFER=%d -D USE_CONSTANT_TRANSFER=%d -D UNROLL_FACTOR=%d",
             (int)pow(2,config[ELEMENTS_PER_THREAD_X]),
             (int)pow(2,config[ELEMENTS_PER_THREAD_Y]),
             config[USE_TEXTURE_DATA],
             config[USE_TEXTURE_TRANSFER],
-            USE_TRILINEAR,
             config[INTERLEAVED],
             config[USE_SHARED_TRANSFER],
             config[USE_CONSTANT_TRANSFER],
             (int)pow(2,config[UNROLL_FACTOR])
     );
+    append_problem_options(options_buffer);
     
-    cl_kernel kernel = buildKernel("raycast.cl", "raycast", options_buffer, context, device, &error);
+    return 1;
+}
+
+double raycast_ocl(float* data_host, cl_float4* transfer_host, int* image_host, bench_session* session, int* config, kernel_timing* timing){
+    
+    cl_device_id device = session->device;
+    cl_context context = session->context;
+    cl_command_queue queue = session->queue;
+    
+    int lwsx = pow(2, config[LOCAL_SIZE_X]);
+    int lwsy = pow(2, config[LOCAL_SIZE_Y]);
+    int eptx = pow(2, config[ELEMENTS_PER_THREAD_X]);
+    int epty = pow(2, config[ELEMENTS_PER_THREAD_Y]);
+    const size_t local_work_size[2] = {lwsx,lwsy};
+    const size_t global_work_size[2] = {(IMAGE_WIDTH/eptx),IMAGE_HEIGHT/epty};
+    
+    char options_buffer[MAX_OPTIONS_LENGTH];
+    if(!raycast_options(session, config, options_buffer)){
+        return -1;
+    }
+    
+    cl_int error;
+    cl_kernel kernel = build_session_kernel(session, "raycast.cl", "raycast", options_buffer, &error);
     if(error != CL_SUCCESS){
-        clReleaseCommandQueue(queue);
-        clReleaseContext(context);
         return -3.0;
     }
     
@@ -283,25 +449,24 @@ double raycast_ocl(float* data_host, cl_float4* transfer_host, int* image_host,
         image_format_data.image_channel_order = CL_R;
         image_format_data.image_channel_data_type = CL_FLOAT;
         
-        data_device = clCreateImage3D(context,
-                                      CL_MEM_READ_ONLY|CL_MEM_COPY_HOST_PTR,
-                                      &image_format_data,
-                                      DATA_DIM,
-                                      DATA_DIM,
-                                      DATA_DIM,
-                                      DATA_DIM*sizeof(float),
-                                      DATA_DIM*DATA_DIM*sizeof(float),
-                                      data_host,
-                                      &error);
+        data_device = get_input_image3d(session,
+                                        &image_format_data,
+                                        DATA_DIM,
+                                        DATA_DIM,
+                                        DATA_DIM,
+                                        DATA_DIM*sizeof(float),
+                                        DATA_DIM*DATA_DIM*sizeof(float),
+                                        data_host,
+                                        &error);
         
         
     }
     else{
-        data_device = clCreateBuffer(context,
-                                     CL_MEM_COPY_HOST_PTR|CL_MEM_READ_WRITE,
-                                     sizeof(float)*DATA_DIM*DATA_DIM*DATA_DIM,
-                                     data_host,
-                                     &error);
+        data_device = get_input_buffer(session,
+                                       CL_MEM_READ_WRITE,
+                                       sizeof(float)*DATA_DIM*DATA_DIM*DATA_DIM,
+                                       data_host,
+                                       &error);
     }
     
     
@@ -313,30 +478,29 @@ double raycast_ocl(float* data_host, cl_float4* transfer_host, int* image_host,
         image_format_transfer.image_channel_order = CL_RGBA;
         image_format_transfer.image_channel_data_type = CL_FLOAT;
         
-        transfer_device = clCreateImage2D(context,
-                                          CL_MEM_READ_ONLY|CL_MEM_COPY_HOST_PTR,
-                                          &image_format_transfer,
-                                          TRANSFER_FUNC_SIZE,
-                                          1,
-                                          TRANSFER_FUNC_SIZE*sizeof(cl_float4),
-                                          transfer_host,
-                                          &error);
+        transfer_device = get_input_image2d(session,
+                                            &image_format_transfer,
+                                            TRANSFER_FUNC_SIZE,
+                                            1,
+                                            TRANSFER_FUNC_SIZE*sizeof(cl_float4),
+                                            transfer_host,
+                                            &error);
     }
     else{
         
         if(config[USE_CONSTANT_TRANSFER]){
-            transfer_device = clCreateBuffer(context,
-                                             CL_MEM_READ_ONLY|CL_MEM_COPY_HOST_PTR,
-                                             sizeof(cl_float4)*TRANSFER_FUNC_SIZE,
-                                             transfer_host,
-                                             &error);
+            transfer_device = get_input_buffer(session,
+                                               CL_MEM_READ_ONLY,
+                                               sizeof(cl_float4)*TRANSFER_FUNC_SIZE,
+                                               transfer_host,
+                                               &error);
         }
         else{
-            transfer_device = clCreateBuffer(context,
-                                             CL_MEM_READ_WRITE|CL_MEM_COPY_HOST_PTR,
-                                             sizeof(cl_float4)*TRANSFER_FUNC_SIZE,
-                                             transfer_host,
-                                             &error);
+            transfer_device = get_input_buffer(session,
+                                               CL_MEM_READ_WRITE,
+                                               sizeof(cl_float4)*TRANSFER_FUNC_SIZE,
+                                               transfer_host,
+                                               &error);
         }
         
     }
@@ -357,172 +521,133 @@ double raycast_ocl(float* data_host, cl_float4* transfer_host, int* image_host,
     
     
     
-    double time = 0.0;    
-    
+    double time;
     if(invalid_work_group_size(device, kernel, 2, local_work_size, global_work_size)){
         time = -1.0;
     }
     else{
-        cl_event event;
-        //printf("%zu %zu %zu %zu\n", global_work_size[0], global_work_size[1], local_work_size[0], local_work_size[1]);
-        error = clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global_work_size, local_work_size, 0, NULL, &event);
-        if(error != CL_SUCCESS){
-            clReleaseKernel(kernel);
-            clReleaseCommandQueue(queue);
-            clReleaseContext(context);
-            clReleaseMemObject(data_device);
-            clReleaseMemObject(image_device);
-            clReleaseMemObject(transfer_device);
-            //clWaitForEvents(1, &event);
-            //clReleaseEvent(event);
-            return -4.0;
-        }
-        
-        
-        error = clFinish(queue);
-        clError("Error waiting for kernel",error);
-        if(error != CL_SUCCESS){
-            time = -1.0;
-        }
-        else{
-            cl_ulong start_time, end_time;
-            error = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start_time, NULL);
-            error = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end_time, NULL);
-            time = (double)((end_time-start_time)/1000.0);
-            clError("Error timing",error);    
-            
-            clEnqueueReadBuffer(queue,
-                                image_device,
-                                CL_TRUE,
-                                0,
-                                sizeof(int)*IMAGE_WIDTH*IMAGE_HEIGHT,
-                                image_host,
-                                0,
-                                NULL,
-                                NULL);
+        time = time_kernel(queue, kernel, 2, global_work_size, local_work_size, timing);
+        if(time >= 0){
+            error = clEnqueueReadBuffer(queue,
+                                        image_device,
+                                        CL_TRUE,
+                                        0,
+                                        sizeof(int)*IMAGE_WIDTH*IMAGE_HEIGHT,
+                                        image_host,
+                                        0,
+                                        NULL,
+                                        NULL);
             clError("Error reading stuff", error);
         }
-        clWaitForEvents(1, &event);
-        clReleaseEvent(event);
     }
     
     
     
-    clReleaseMemObject(data_device);
     clReleaseMemObject(image_device);
-    clReleaseMemObject(transfer_device);
     clReleaseKernel(kernel);
-    clReleaseCommandQueue(queue);
-    clReleaseContext(context);
     
     return time;
 }
 
-void run_on_configurations(int* configurations, int n_run_configurations, int n_total_configurations, float* data_host, cl_float4* transfer_host, int* correct_image, char** argv){
-    
-    
-    
-    int* image_host = (int*)calloc(sizeof(int),IMAGE_WIDTH*IMAGE_HEIGHT);
-    cl_device_id device = get_selected_device();
-    
-    print_comment(device, argv);
+typedef struct{
+    float* data_host;
+    cl_float4* transfer_host;
+    int* correct_image;
     
-    int i = get_start_iteration();
-    int j = 0;
-    while(i < n_total_configurations && j < n_run_configurations){
-        int* temp_config = get_config_for_number(configurations[i], param_limits, n_parameters);
-        
-        
-        fprintf(stderr, "%d\t", i);
-        for(int p = 0; p < n_parameters; p++){
-            fprintf(stderr, "%d ", temp_config[p]);
-        }
-        fprintf(stderr, "%s\n", timestamp());
-        
-        
-        double time = raycast_ocl(data_host,
-                                  transfer_host,
-                                  image_host,
-                                  device,
-                                  temp_config);
-        
-        
-        
-        if(time > 0){
-            if(!check_image(image_host, correct_image)){
-                time = -2.0;
-            }
-        }        
-        
-        
-        for(int p = 0; p < n_parameters; p++){
-            printf("%d ", temp_config[p]);
-        }
-        //printf("\n");
-        printf("%f\n", time);
-        
-        if(ignore_crashes_when_counting()){
-            j++;
-        }
-        else{
-            if(time > 0){
-                j++;
-            }
-        }
-        
-        i++;
-        free(temp_config);
+    int* image_host;
+} raycast_data;
 
-        if(get_use_time_threshold() && time > get_time_threshold() && j >= get_min_second_stage()){
-            break;
-        }
-        if(get_use_time_threshold() && j >= get_max_second_stage()){
-            break;
-        }
-    }
+void* raycast_setup(bench_session* session, void* data){
+    raycast_data* state = (raycast_data*)malloc(sizeof(raycast_data));
+    *state = *(raycast_data*)data;
+    state->image_host = (int*)calloc(sizeof(int),IMAGE_WIDTH*IMAGE_HEIGHT);
+    return state;
+}
+
+double raycast_run(bench_session* session, int* config, kernel_timing* timing, void* state){
+    raycast_data* d = (raycast_data*)state;
+    return raycast_ocl(d->data_host, d->transfer_host, d->image_host, session, config, timing);
+}
+
+int raycast_verify(void* state){
+    raycast_data* d = (raycast_data*)state;
+    return check_image(d->image_host, d->correct_image);
+}
+
+void raycast_teardown(void* state){
+    raycast_data* d = (raycast_data*)state;
+    free(d->image_host);
+    free(d);
 }
 
           
 int main(int argc, char** argv){
     
     parse_args(argc, argv);
+    set_problem_parameters(problem_parameters, n_problem_parameters);
     
     float* data_host = create_data();
     
     int* correct_image = NULL;
     if(get_correct_file() != NULL){
         correct_image = load_correct(get_correct_file(), IMAGE_WIDTH, IMAGE_HEIGHT);
+        if(correct_image == NULL){
+            exit(-1);
+        }
     }
-    else{
+    cl_float4* transfer_host = create_transfer();
+    if(get_cpu_reference()){
+        int* reference_image = (int*)malloc(sizeof(int)*IMAGE_WIDTH*IMAGE_HEIGHT);
+        raycast_reference reference = {data_host, transfer_host, reference_image};
+        double time = time_reference(raycast_cpu, &reference);
+        if(correct_image == NULL){
+            correct_image = reference_image;
+        }
+        if(!perform_self_test() && get_output_file() != NULL){
+            printf("CPU reference time: %f\n", time);
+            printf("Writing output to %s\n", get_output_file());
+            if(write_image_raw(get_output_file(), reference_image, IMAGE_WIDTH, IMAGE_HEIGHT) != 0){
+                exit(-1);
+            }
+            return 0;
+        }
+    }
+    if(correct_image == NULL){
         printf("#WARNING: No correct file provided, output check will not be performed\n");
     }
-    cl_float4* transfer_host = create_transfer();
     
     int n_run_configurations;
     int n_total_configurations;
-    int* configurations = create_configurations(param_limits, n_parameters, argc, argv, &n_run_configurations, &n_total_configurations);
+    configuration_order* configurations = create_configurations(param_limits, n_parameters, argc, argv, &n_run_configurations, &n_total_configurations);
     
     
                         
     if(perform_self_test()){
         int* image_host = (int*)malloc(sizeof(int)*IMAGE_WIDTH*IMAGE_HEIGHT);
         cl_device_id device = get_selected_device();
+        bench_session* session = create_session(device);
         print_comment(device, argv);
-        double time = raycast_ocl(data_host, transfer_host, image_host, device, global_config);
+        kernel_timing timing = {0};
+        double time = raycast_ocl(data_host, transfer_host, image_host, session, global_config, &timing);
         if(check_image(image_host, correct_image))
             printf("Self test sucessfull, time: %f\n", time);
         if(get_output_file() != NULL){
             printf("Writing output to %s\n", get_output_file());
-            write_image_raw(get_output_file(), image_host, IMAGE_WIDTH, IMAGE_HEIGHT);
+            if(write_image_raw(get_output_file(), image_host, IMAGE_WIDTH, IMAGE_HEIGHT) != 0){
+                exit(-1);
+            }
         }
+        release_session(session);
     }
     else{
-        run_on_configurations(configurations,
+        raycast_data data = {data_host, transfer_host, correct_image};
+        benchmark bench = {"raycast.cl", "raycast", "raycast.constraints", param_limits, param_names, n_parameters, raycast_options, print_comment, &data,
+                           raycast_setup, raycast_run, raycast_verify, raycast_teardown};
+        
+        run_on_configurations(&bench,
+                              configurations,
                               n_run_configurations,
                               n_total_configurations,
-                              data_host,
-                              transfer_host,
-                              correct_image,
                               argv);
     }
     
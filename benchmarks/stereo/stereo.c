@@ -14,9 +14,18 @@
 #include "../common/configurations.h"
 #include "../common/io.h"
 #include "../common/parser.h"
+#include "../common/session.h"
+#include "../common/pipeline.h"
+#include "../common/timing.h"
+#include "../common/driver.h"
+#include "../common/compare.h"
+#include "../common/reference.h"
+#include "../common/problem.h"
+#include "../common/constraints.h"
 
 int config[] = {3,3,0,0,0,0,0,0,0,0};
 int limits[] = {8,8,8,8,2,2,4,3,3,2,2};
+char* param_names[] = {"LOCAL_SIZE_X", "LOCAL_SIZE_Y", "ELEMENTS_PER_THREAD_X", "ELEMENTS_PER_THREAD_Y", "USE_TEXTURE_LEFT", "USE_TEXTURE_RIGHT", "UNROLL_DISPARITY_LOOP_FACTOR", "UNROLL_RADIUS_X_FACTOR", "UNROLL_RADIUS_Y_FACTOR", "USE_LOCAL_LEFT", "USE_LOCAL_RIGHT"};
 int n_parameters = 11;
 
 #define LOCAL_SIZE_X            0
@@ -31,20 +40,16 @@ int n_parameters = 11;
 #define USE_LOCAL_LEFT          9
 #define USE_LOCAL_RIGHT         10
 
-const int MIN_DISPARITY = -8;
-const int MAX_DISPARITY = 8;
-const int RADIUS = 2;
-const int IMAGE_WIDTH = 256;
-const int IMAGE_HEIGHT = 256;
+//Problem parameters, can be set with -D
+int MIN_DISPARITY = -8;
+int MAX_DISPARITY = 8;
+int RADIUS = 2;
+int IMAGE_WIDTH = 256;
+int IMAGE_HEIGHT = 256;
 
-
-char* timestamp(){
-    time_t ltime; /* calendar time */
-    ltime=time(NULL); /* get current cal time */
-    char* ts = malloc(50);
-    sprintf(ts, "%s",asctime( localtime(&ltime) ) );
-    return ts;
-}
+problem_parameter problem_parameters[] = {{"MIN_DISPARITY", &MIN_DISPARITY}, {"MAX_DISPARITY", &MAX_DISPARITY}, {"RADIUS", &RADIUS},
+                                          {"IMAGE_WIDTH", &IMAGE_WIDTH}, {"IMAGE_HEIGHT", &IMAGE_HEIGHT}};
+int n_problem_parameters = 5;
 
 
 void print_comment(cl_device_id device, char** argv){
@@ -59,11 +64,9 @@ void print_comment(cl_device_id device, char** argv){
     printf("# %s\n", name);
     printf("\n");
     
-    printf("# MIN_DISPARITY: %d\n", MIN_DISPARITY);
-    printf("# MAX_DISPARITY %d\n", MAX_DISPARITY);
-    printf("# RADIUS %d\n", RADIUS);
-    printf("# IMAGE_WIDTH %d\n", IMAGE_WIDTH);
-    printf("# IMAGE_HEIGHT %d\n", IMAGE_HEIGHT);
+    print_problem_parameters();
+    print_device_limits(device);
+    print_reference_time();
     
     printf("\n");
 }
@@ -74,116 +77,120 @@ int check_image(int* image, int* correct, int width, int height){
         return 1;
     }
     
-    int n_errors = 0;
-    for(int i = 0; i < height; i++){
-        for(int j = 0; j < width; j++){
-            
-            if(image[i*width + j] != correct[i*width + j]){
-                n_errors += 1;
-                if(n_errors < 10){
-                    fprintf(stderr, "Error at %d,%d, expected %d, found %d\n", i, j, correct[i*width+j], image[i*width+j]);
-                }
-            }
-        }
+    compare_result result;
+    compare_rgba(image, correct, width*height, 0, &result);
+    for(int k = 0; k < result.n_positions; k++){
+        int i = result.positions[k] / width;
+        int j = result.positions[k] % width;
+        fprintf(stderr, "Error at %d,%d, expected %d, found %d\n", i, j, correct[i*width+j], image[i*width+j]);
     }
-    if(n_errors > 0){
-        fprintf(stderr,"%d errors in total\n", n_errors);
+    if(result.n_errors > 0){
+        fprintf(stderr,"%d errors in total\n", result.n_errors);
     }
     
-    return n_errors == 0;
+    return result.n_errors == 0;
 }
 
 
-int* compute_disparity_cpu(int* left_image, int* right_image, int width, int height, int min_disparity, int max_disparity, int radius){
-    
-    int* disparity = (int*)malloc(sizeof(int)* width * height);
-        
-    for(int y = 0; y < height; y++){
-        for(int x = 0; x < width; x++){
-            
-            
-            int min = 999999;
-            int min_d = 0;
-            for(int d = min_disparity; d <= max_disparity; d++){
-                
+typedef struct{
+    int* left_image;
+    int* right_image;
+    int* disparity;
+} stereo_reference;
+
+int clamp(int v, int low, int high){
+    return v < low ? low : (v > high ? high : v);
+}
+
+// Sum of absolute differences of the four channels of two pixels
+int pixel_difference(int left, int right){
+    unsigned char* left_pixel = (unsigned char*)&left;
+    unsigned char* right_pixel = (unsigned char*)&right;
+    int absdiff = 0;
+    for(int k = 0; k < 4; k++){
+        absdiff += abs((int)(left_pixel[k] - right_pixel[k]));
+    }
+    return absdiff;
+}
+
+// Computes rows [start, end) of the disparity. For each disparity, the window sums of a row are computed as
+// sums of the column sums over the window height, instead of summing the whole window for each pixel.
+// Coordinates are clamped to the image like in the kernel, and ties go to the lowest disparity.
+void stereo_rows(int start, int end, void* arg){
+    stereo_reference* r = (stereo_reference*)arg;
+    int extended_width = IMAGE_WIDTH + 2*RADIUS;
+    int* column_sum = (int*)malloc(sizeof(int)*extended_width);
+    int* min = (int*)malloc(sizeof(int)*IMAGE_WIDTH);
+    int* min_d = (int*)malloc(sizeof(int)*IMAGE_WIDTH);
+
+    for(int y = start; y < end; y++){
+        for(int x = 0; x < IMAGE_WIDTH; x++){
+            min[x] = 999999;
+            min_d[x] = 0;
+        }
+
+        for(int d = MIN_DISPARITY; d <= MAX_DISPARITY; d++){
+            for(int u = 0; u < extended_width; u++){
+                column_sum[u] = 0;
+            }
+            for(int j = -RADIUS; j <= RADIUS; j++){
+                int yy = clamp(y + j, 0, IMAGE_HEIGHT-1);
+                int* left_row = r->left_image + yy*IMAGE_WIDTH;
+                int* right_row = r->right_image + yy*IMAGE_WIDTH;
+                for(int u = 0; u < extended_width; u++){
+                    int xx = clamp(u - RADIUS, 0, IMAGE_WIDTH-1);
+                    int xxd = clamp(u - RADIUS + d, 0, IMAGE_WIDTH-1);
+                    column_sum[u] += pixel_difference(left_row[xx], right_row[xxd]);
+                }
+            }
+
+            for(int x = 0; x < IMAGE_WIDTH; x++){
                 int sum = 0;
-                for(int i = -radius; i <= radius; i++){
-                    for(int j = -radius; j <= radius; j++){
-                        
-                        int xxd = x + i + d;
-                        int xx = x + i;
-                        int yy = y + j;
-                        
-                        if( xx >= width) xx = width-1;
-                        if( xx < 0) xx = 0;
-                        
-                        if( xxd >= width) xxd = width-1;
-                        if( xxd < 0) xxd = 0;
-                        
-                        if( yy >= height) yy = height-1;
-                        if( yy < 0) yy = 0;
-                        
-                        int index1 = yy*width + xx;
-                        int index2 = yy*width + xxd;
-                
-                
-                                              
-                        unsigned char* left_pixel = (unsigned char *)&left_image[index1];
-                        unsigned char* right_pixel = (unsigned char *)&right_image[index2];
-                        int absdiff = 0;
-                        for (int k=0; k<4; k++){
-                            absdiff += abs((int)(left_pixel[k] - right_pixel[k]));
-                        }
-                        sum += absdiff;
-                    }
+                for(int i = 0; i <= 2*RADIUS; i++){
+                    sum += column_sum[x + i];
                 }
-                
-                if(sum < min){
-                    min = sum;
-                    min_d = d;
+                if(sum < min[x]){
+                    min[x] = sum;
+                    min_d[x] = d;
                 }
             }
-            disparity[y*width + x] = ((min_d+max_disparity)*5);
+        }
+
+        for(int x = 0; x < IMAGE_WIDTH; x++){
+            r->disparity[y*IMAGE_WIDTH + x] = ((min_d[x]+MAX_DISPARITY)*5);
         }
     }
-    
-    return disparity;
+
+    free(column_sum);
+    free(min);
+    free(min_d);
 }
 
+// Computes the disparity on the CPU, in the format of the correct file
+void compute_disparity_cpu(void* arg){
+    parallel_for(IMAGE_HEIGHT, stereo_rows, arg);
+}
 
-double compute_disparity_ocl(int* left_image, int* right_image, int* disparity, int width, int height, int min_disparity, int max_disparity, int radius, cl_device_id device, int* temp_config){
+
+// The kernels are always built for the problem given by the constants above
+int stereo_options(bench_session* session, int* temp_config, char* options_buffer){
     
     int lwsx = pow(2, temp_config[LOCAL_SIZE_X]);
     int lwsy = pow(2, temp_config[LOCAL_SIZE_Y]);
     int eptx = pow(2, temp_config[ELEMENTS_PER_THREAD_X]);
     int epty = pow(2, temp_config[ELEMENTS_PER_THREAD_Y]);
     const size_t local_work_size[2] = {lwsx,lwsy};
-    const size_t global_work_size[2] = {(width/eptx),height/epty};
+    const size_t global_work_size[2] = {(IMAGE_WIDTH/eptx),IMAGE_HEIGHT/epty};
     
-    if(invalid_work_group_size_static(device, 2, local_work_size, global_work_size)){
-        return -1;
+    if(invalid_work_group_size_static(session->device, 2, local_work_size, global_work_size)){
+        return 0;
     }
     
-    cl_int error;
-    
-    cl_context context = clCreateContext(NULL, 1, &device, NULL, NULL, &error);
-    clError("Couldn't get context", error);
-    
-    cl_command_queue queue = clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &error);
-    clError("Couldn't create command queue", error);
-    
-    char options_buffer[400];
-    sprintf(options_buffer, "-D IMAGE_HEIGHT=%d -D IMAGE_WIDTH=%d -D MIN_DISPARITY=%d"
-    " -D MAX_DISPARITY=%d -D RADIUS=%d -D ELEMENTS_PER_THREAD_X=%d"
+    sprintf(options_buffer, "-D ELEMENTS_PER_THREAD_X=%d"
     " -D ELEMENTS_PER_THREAD_Y=%d -D LOCAL_SIZE_X=%d -D LOCAL_SIZE_Y=%d"
     " -D USE_TEXTURE_LEFT=%d -D USE_TEXTURE_RIGHT=%d -D UNROLL_DISPARITY_LOOP_FACTOR=%d"
     " -D USE_LOCAL_LEFT=%d -D USE_LOCAL_RIGHT=%d -D UNROLL_RADIUS_X_FACTOR=%d"
     " -D UNROLL_RADIUS_Y_FACTOR=%d",
-    height,
-    width,
-    min_disparity,
-    max_disparity,
-    radius,
     (int)pow(2,temp_config[ELEMENTS_PER_THREAD_X]),
             (int)pow(2,temp_config[ELEMENTS_PER_THREAD_Y]),
             (int)pow(2,temp_config[LOCAL_SIZE_X]),
@@ -196,12 +203,35 @@ double compute_disparity_ocl(int* left_image, int* right_image, int* disparity,
             (int)pow(2,temp_config[UNROLL_RADIUS_X_FACTOR]),
             (int)pow(2,temp_config[UNROLL_RADIUS_Y_FACTOR])
     );
-    cl_kernel kernel = buildKernel("stereo.cl", "stereo", options_buffer, context, device, &error);
+    append_problem_options(options_buffer);
+    
+    return 1;
+}
+
+
+double compute_disparity_ocl(int* left_image, int* right_image, int* disparity, int width, int height, int min_disparity, int max_disparity, int radius, bench_session* session, int* temp_config, kernel_timing* timing){
+    
+    cl_device_id device = session->device;
+    cl_context context = session->context;
+    cl_command_queue queue = session->queue;
+    
+    int lwsx = pow(2, temp_config[LOCAL_SIZE_X]);
+    int lwsy = pow(2, temp_config[LOCAL_SIZE_Y]);
+    int eptx = pow(2, temp_config[ELEMENTS_PER_THREAD_X]);
+    int epty = pow(2, temp_config[ELEMENTS_PER_THREAD_Y]);
+    const size_t local_work_size[2] = {lwsx,lwsy};
+    const size_t global_work_size[2] = {(width/eptx),height/epty};
+    
+    cl_int error;
+    
+    char options_buffer[MAX_OPTIONS_LENGTH];
+    if(!stereo_options(session, temp_config, options_buffer)){
+        return -1;
+    }
+    cl_kernel kernel = build_session_kernel(session, "stereo.cl", "stereo", options_buffer, &error);
     
     if(error != CL_SUCCESS){
         clReleaseKernel(kernel);
-        clReleaseCommandQueue(queue);
-        clReleaseContext(context);
         return -3.0;
     }
     
@@ -213,21 +243,20 @@ double compute_disparity_ocl(int* left_image, int* right_image, int* disparity,
         image_format_left.image_channel_order = CL_R;
         image_format_left.image_channel_data_type = CL_SIGNED_INT32;
         
-        left_image_device = clCreateImage2D(context,
-                                            CL_MEM_READ_ONLY|CL_MEM_COPY_HOST_PTR,
-                                            &image_format_left,
-                                            width,
-                                            height,
-                                            width*sizeof(int),
-                                            left_image,
-                                            &error);
+        left_image_device = get_input_image2d(session,
+                                              &image_format_left,
+                                              width,
+                                              height,
+                                              width*sizeof(int),
+                                              left_image,
+                                              &error);
     }
     else{
-        left_image_device = clCreateBuffer(context,
-                                           CL_MEM_COPY_HOST_PTR|CL_MEM_READ_WRITE,
-                                           sizeof(int)*width*height,
-                                           left_image,
-                                           &error);
+        left_image_device = get_input_buffer(session,
+                                             CL_MEM_READ_WRITE,
+                                             sizeof(int)*width*height,
+                                             left_image,
+                                             &error);
     }
     clError("Couldn't allocate left memory", error);
     
@@ -237,22 +266,21 @@ double compute_disparity_ocl(int* left_image, int* right_image, int* disparity,
         image_format_right.image_channel_order = CL_R;
         image_format_right.image_channel_data_type = CL_SIGNED_INT32;
         
-        right_image_device = clCreateImage2D(context,
-                                             CL_MEM_READ_ONLY|CL_MEM_COPY_HOST_PTR,
-                                             &image_format_right,
-                                             width,
-                                             height,
-                                             width*sizeof(int),
-                                             right_image,
-                                             &error);
+        right_image_device = get_input_image2d(session,
+                                               &image_format_right,
+                                               width,
+                                               height,
+                                               width*sizeof(int),
+                                               right_image,
+                                               &error);
     }
     else{
         
-        right_image_device = clCreateBuffer(context,
-                                            CL_MEM_COPY_HOST_PTR|CL_MEM_READ_WRITE,
-                                            sizeof(int)*width*height,
-                                            right_image,
-                                            &error);
+        right_image_device = get_input_buffer(session,
+                                              CL_MEM_READ_WRITE,
+                                              sizeof(int)*width*height,
+                                              right_image,
+                                              &error);
     }
     clError("Couldn't allocate right memory", error);
     
@@ -275,135 +303,71 @@ double compute_disparity_ocl(int* left_image, int* right_image, int* disparity,
     
     double time;
     if(invalid_work_group_size(device, kernel, 2, local_work_size, global_work_size)){
-        
         time = -1.0;
     }
     else{
-        //printf("%zu %zu, %zu, %zu\n", global_work_size[0], global_work_size[1], local_work_size[0], local_work_size[1]);
-        cl_event event;
-        error = clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global_work_size, local_work_size, 0, NULL, &event);
-        if(error != CL_SUCCESS){
-            clReleaseKernel(kernel);
-            clReleaseCommandQueue(queue);
-            clReleaseContext(context);
-            clReleaseMemObject(left_image_device);
-            clReleaseMemObject(right_image_device);
-            clReleaseMemObject(disparity_device);
-            //clWaitForEvents(1, &event);
-            //clReleaseEvent(event);
-            return -4.0;
+        time = time_kernel(queue, kernel, 2, global_work_size, local_work_size, timing);
+        if(time >= 0){
+            error = clEnqueueReadBuffer(queue,
+                                        disparity_device,
+                                        CL_TRUE,
+                                        0,
+                                        sizeof(int)*width*height,
+                                        disparity,
+                                        0,
+                                        NULL,
+                                        NULL);
+            clError("Error reading stuff", error);
         }
-        
-        error = clFinish(queue);
-        clError("Error waiting for kernel",error);
-        
-        cl_ulong start_time, end_time;
-        error = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start_time, NULL);
-        error = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end_time, NULL);
-        time = (double)((end_time-start_time)/1000.0);
-        clError("Error timing",error); 
-        
-        
-        error = clEnqueueReadBuffer(queue,
-                                    disparity_device,
-                                    CL_TRUE,
-                                    0,
-                                    sizeof(int)*width*height,
-                                    disparity,
-                                    0,
-                                    NULL,
-                                    NULL);
-        clError("Error reading stuff", error);
-        
-        clWaitForEvents(1, &event);
-        clReleaseEvent(event);
     }
     
-    clReleaseMemObject(left_image_device);
-    clReleaseMemObject(right_image_device);
     clReleaseMemObject(disparity_device);
     
     clReleaseKernel(kernel);
-    clReleaseCommandQueue(queue);
-    clReleaseContext(context);
     
     return time;
 }
 
-int check_config(int* temp_config){
-    int r = (LOCAL_SIZE_X*ELEMENTS_PER_THREAD_X+2*RADIUS)*(LOCAL_SIZE_Y*ELEMENTS_PER_THREAD_Y+2*RADIUS)*USE_LOCAL_RIGHT;
-    int l = (LOCAL_SIZE_X*ELEMENTS_PER_THREAD_X+2*RADIUS)*(LOCAL_SIZE_Y*ELEMENTS_PER_THREAD_Y+2*RADIUS)*USE_LOCAL_LEFT;
-    
-    printf("%x\n", (unsigned int)(r+l*sizeof(int)));
-    if((r + l)*sizeof(int) > 0xc000){
-        return 0;
-    }
-    return 1;
-}
-
 
-void run_on_configurations(int* configurations, int n_total_configurations, int n_run_configurations, int* left_image, int* right_image, int* disparity_correct, int height, int width, char** argv){
-
-    int* disparity = (int*)malloc(sizeof(int)*width*height);
-    cl_device_id device = get_selected_device();
+typedef struct{
+    int* left_image;
+    int* right_image;
+    int* disparity_correct;
+    
+    int* disparity;
+} stereo_data;
 
-    print_comment(device, argv);
-        
-    int i = get_start_iteration();
-    int j = 0;
-    while(i < n_total_configurations && j < n_run_configurations){
-        int* temp_config = get_config_for_number(configurations[i], limits, n_parameters);
-        
-        fprintf(stderr, "%d\t", i);
-        for(int p = 0; p < n_parameters; p++){
-            fprintf(stderr, "%d ", temp_config[p]);
-        }
-        fprintf(stderr, "%s\n", timestamp());
-        
-        double time = compute_disparity_ocl(left_image,
-                                            right_image,
-                                            disparity,
-                                            width,
-                                            height,
-                                            MIN_DISPARITY,
-                                            MAX_DISPARITY,
-                                            RADIUS,
-                                            device,
-                                            temp_config
-                                           );
-        
+void* stereo_setup(bench_session* session, void* data){
+    stereo_data* state = (stereo_data*)malloc(sizeof(stereo_data));
+    *state = *(stereo_data*)data;
+    state->disparity = (int*)malloc(sizeof(int)*IMAGE_WIDTH*IMAGE_HEIGHT);
+    return state;
+}
 
-        if(time > 0){
-            if(!check_image(disparity, disparity_correct, width, height)){
-                time = -2.0;
-            }
-        }        
-        
-        for(int p = 0; p < n_parameters; p++){
-            printf("%d ", temp_config[p]);
-        }
-        //printf("\n");
-        printf("%f\n", time);
+double stereo_run(bench_session* session, int* config, kernel_timing* timing, void* state){
+    stereo_data* d = (stereo_data*)state;
+    return compute_disparity_ocl(d->left_image,
+                                 d->right_image,
+                                 d->disparity,
+                                 IMAGE_WIDTH,
+                                 IMAGE_HEIGHT,
+                                 MIN_DISPARITY,
+                                 MAX_DISPARITY,
+                                 RADIUS,
+                                 session,
+                                 config,
+                                 timing);
+}
 
-        if(ignore_crashes_when_counting()){
-            j++;
-        }
-        else{
-            if(time > 0){
-                j++;
-            }
-        }
-        
-        i++;
-        free(temp_config);
+int stereo_verify(void* state){
+    stereo_data* d = (stereo_data*)state;
+    return check_image(d->disparity, d->disparity_correct, IMAGE_WIDTH, IMAGE_HEIGHT);
+}
 
-        if(get_use_time_threshold() && time > get_time_threshold() && j >= get_min_second_stage()){
-            break;
-        }
-        if(get_use_time_threshold() && j >= get_max_second_stage()){
-            break;
-        }
-    }
+void stereo_teardown(void* state){
+    stereo_data* d = (stereo_data*)state;
+    free(d->disparity);
+    free(d);
 }
 
 
@@ -432,16 +396,39 @@ int main(int argc, char** argv){
 
     //int height, width;
     parse_args(argc, argv);
+    set_problem_parameters(problem_parameters, n_problem_parameters);
+    if(MIN_DISPARITY > MAX_DISPARITY || RADIUS < 0){
+        fprintf(stderr, "MIN_DISPARITY can not be larger than MAX_DISPARITY, nor RADIUS negative, exiting\n");
+        exit(-1);
+    }
     
     int* left_image = generate_test_pattern(IMAGE_WIDTH, IMAGE_HEIGHT, 10);
     int* right_image = generate_test_pattern(IMAGE_WIDTH, IMAGE_HEIGHT, 0);
     
-    //int* disparity_correct = compute_disparity_cpu(left_image, right_image, IMAGE_WIDTH, IMAGE_HEIGHT, MIN_DISPARITY, MAX_DISPARITY, RADIUS);
     int* disparity_correct = NULL;
     if(get_correct_file() != NULL){
         disparity_correct = load_correct(get_correct_file(), IMAGE_WIDTH, IMAGE_HEIGHT);
+        if(disparity_correct == NULL){
+            exit(-1);
+        }
     }
-    else{
+    if(get_cpu_reference()){
+        int* reference_disparity = (int*)malloc(sizeof(int)*IMAGE_WIDTH*IMAGE_HEIGHT);
+        stereo_reference reference = {left_image, right_image, reference_disparity};
+        double time = time_reference(compute_disparity_cpu, &reference);
+        if(disparity_correct == NULL){
+            disparity_correct = reference_disparity;
+        }
+        if(!perform_self_test() && get_output_file() != NULL){
+            printf("CPU reference time: %f\n", time);
+            printf("Writing output to %s\n", get_output_file());
+            if(write_image_raw(get_output_file(), reference_disparity, IMAGE_WIDTH, IMAGE_HEIGHT) != 0){
+                exit(-1);
+            }
+            return 0;
+        }
+    }
+    if(disparity_correct == NULL){
         printf("#Warning: No correct file provided, output check will not be performed\n");
     }
     
@@ -450,32 +437,37 @@ int main(int argc, char** argv){
     
     int n_run_configurations;
     int n_total_configurations;
-    int* configurations = create_configurations(limits, n_parameters, argc, argv, &n_run_configurations, &n_total_configurations);
+    configuration_order* configurations = create_configurations(limits, n_parameters, argc, argv, &n_run_configurations, &n_total_configurations);
 
 
    
     if(perform_self_test()){
         cl_device_id device = get_selected_device();
+        bench_session* session = create_session(device);
         print_comment(device, argv);
         int* disparity = (int*)malloc(sizeof(int)*IMAGE_WIDTH*IMAGE_HEIGHT);
-        double time = compute_disparity_ocl(left_image, right_image, disparity, IMAGE_WIDTH, IMAGE_HEIGHT, MIN_DISPARITY, MAX_DISPARITY, RADIUS, device, config);
+        kernel_timing timing = {0};
+        double time = compute_disparity_ocl(left_image, right_image, disparity, IMAGE_WIDTH, IMAGE_HEIGHT, MIN_DISPARITY, MAX_DISPARITY, RADIUS, session, config, &timing);
         if(check_image(disparity, disparity_correct, IMAGE_WIDTH, IMAGE_HEIGHT)){
             printf("Self test successfull, time: %f\n", time);
         }
         if(get_output_file() != NULL){
             printf("Writing output to %s\n", get_output_file());
-            write_image_raw(get_output_file(), disparity, IMAGE_WIDTH, IMAGE_HEIGHT);
+            if(write_image_raw(get_output_file(), disparity, IMAGE_WIDTH, IMAGE_HEIGHT) != 0){
+                exit(-1);
+            }
         }
+        release_session(session);
     }
     else{
-        run_on_configurations(configurations,
-                              n_total_configurations,
+        stereo_data data = {left_image, right_image, disparity_correct};
+        benchmark bench = {"stereo.cl", "stereo", "stereo.constraints", limits, param_names, n_parameters, stereo_options, print_comment, &data,
+                           stereo_setup, stereo_run, stereo_verify, stereo_teardown};
+        
+        run_on_configurations(&bench,
+                              configurations,
                               n_run_configurations,
-                              left_image,
-                              right_image,
-                              disparity_correct,
-                              IMAGE_HEIGHT,
-                              IMAGE_WIDTH,
+                              n_total_configurations,
                               argv);
     }
     